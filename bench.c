@@ -0,0 +1,158 @@
+/*
+** Point location benchmark.
+** builds a partition of random points one at a time, then locates random
+** points one at a time (PartitionLocate) - with the cells in memory in the
+** order they were added, and again after PartitionOptimizeLayout - and in
+** batches (PartitionLocateBatch), checks that all agree and prints the
+** queries per second of each.
+**
+** build:
+**   gcc -std=c99 -O2 [-mavx2] -pthread bench.c partition.c gentree.c \
+**       linpartition.c workpool.c locindex.c outbuffer.c snapshot.c \
+**       pointbuckets.c -o bench
+** run:
+**   ./bench [cells] [queries]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "partition.h"
+
+#define DEFAULT_CELLS 1000000
+#define DEFAULT_QUERIES 10000000
+#define QUERY_BLOCK_SIZE 4096
+
+/*************************************************************************
+Function name	: NextRandom
+Description		: returns the next number of a 64 bit linear congruential
+				  generator, as a double in [0, 1)
+Paramerters		: state - the generator state
+Return value	: double - the number
+************************************************************************/
+static double NextRandom(unsigned long long* state);
+
+/*************************************************************************
+Function name	: FillRandom
+Description		: fills n random points
+Paramerters		: state - the generator state, xs,ys - the points,
+				  n - the amount of points
+Return value	: none
+************************************************************************/
+static void FillRandom(unsigned long long* state, double* xs, double* ys, size_t n);
+
+/*************************************************************************
+Function name	: Seconds
+Description		: returns the processor time used so far
+Paramerters		: none
+Return value	: double - the time in seconds
+************************************************************************/
+static double Seconds();
+
+/*************************************************************************
+Function name	: TimeLocate
+Description		: locates random points one at a time
+Paramerters		: part - the partition, numQueries - the amount of points,
+				  xs,ys - room for QUERY_BLOCK_SIZE points,
+				  keySum - updated with the sum of the keys located
+Return value	: double - the time taken in seconds
+************************************************************************/
+static double TimeLocate(pPartition part, size_t numQueries, double* xs, double* ys, long long* keySum);
+
+static double NextRandom(unsigned long long* state) {
+	*state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+	return (double)(*state >> 11) / 9007199254740992.0;
+}
+
+static void FillRandom(unsigned long long* state, double* xs, double* ys, size_t n) {
+	for (size_t i = 0; i < n; i++) {
+		xs[i] = NextRandom(state);
+		ys[i] = NextRandom(state);
+	}
+}
+
+static double Seconds() {
+	return (double)clock() / CLOCKS_PER_SEC;
+}
+
+static double TimeLocate(pPartition part, size_t numQueries, double* xs, double* ys, long long* keySum) {
+	unsigned long long queryState = 2;
+	*keySum = 0;
+	double start = Seconds();
+	for (size_t done = 0; done < numQueries; done += QUERY_BLOCK_SIZE) {
+		size_t n = (numQueries - done < QUERY_BLOCK_SIZE) ? numQueries - done : QUERY_BLOCK_SIZE;
+		FillRandom(&queryState, xs, ys, n);
+		for (size_t i = 0; i < n; i++) {
+			PartitionCell cell;
+			PartitionLocate(part, xs[i], ys[i], &cell);
+			*keySum += cell.key;
+		}
+	}
+	return Seconds() - start;
+}
+
+int main(int argc, char* argv[])
+{
+	size_t numCells = (argc > 1) ? (size_t)atol(argv[1]) : DEFAULT_CELLS;
+	size_t numQueries = (argc > 2) ? (size_t)atol(argv[2]) : DEFAULT_QUERIES;
+	unsigned long long state = 1;
+	double* xs = (double*)malloc(QUERY_BLOCK_SIZE * sizeof(double));
+	double* ys = (double*)malloc(QUERY_BLOCK_SIZE * sizeof(double));
+	PartitionCell* cells = (PartitionCell*)malloc(QUERY_BLOCK_SIZE * sizeof(PartitionCell));
+	pPartition part = PartitionCreate(NULL);
+	if (xs == NULL || ys == NULL || cells == NULL || part == NULL) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	//one point at a time, which leaves the cells in memory in the order they were added:
+	for (size_t done = 0; done < numCells; done += QUERY_BLOCK_SIZE) {
+		size_t n = (numCells - done < QUERY_BLOCK_SIZE) ? numCells - done : QUERY_BLOCK_SIZE;
+		FillRandom(&state, xs, ys, n);
+		for (size_t i = 0; i < n; i++) {
+			PartitionRefine(part, xs[i], ys[i]);
+		}
+	}
+
+	//one at a time, before and after the layout:
+	long long keySum, layoutKeySum;
+	double singleTime = TimeLocate(part, numQueries, xs, ys, &keySum);
+	double start = Seconds();
+	PartitionOptimizeLayout(part);
+	double layoutTime = Seconds() - start;
+	double layoutSingleTime = TimeLocate(part, numQueries, xs, ys, &layoutKeySum);
+
+	//the first batch builds the index:
+	start = Seconds();
+	PartitionLocateBatch(part, xs, ys, 1, cells);
+	double buildTime = Seconds() - start;
+
+	unsigned long long queryState = 2;
+	long long batchKeySum = 0;
+	start = Seconds();
+	for (size_t done = 0; done < numQueries; done += QUERY_BLOCK_SIZE) {
+		size_t n = (numQueries - done < QUERY_BLOCK_SIZE) ? numQueries - done : QUERY_BLOCK_SIZE;
+		FillRandom(&queryState, xs, ys, n);
+		PartitionLocateBatch(part, xs, ys, n, cells);
+		for (size_t i = 0; i < n; i++) {
+			batchKeySum += cells[i].key;
+		}
+	}
+	double batchTime = Seconds() - start;
+
+	printf("cells: %lu, queries: %lu\n", (unsigned long)numCells, (unsigned long)numQueries);
+	printf("PartitionLocate:      %.0f queries/s, %.1f ns each\n",
+		numQueries / singleTime, 1e9 * singleTime / numQueries);
+	printf("  after the layout:   %.0f queries/s, %.1f ns each (laid out in %.3f s)\n",
+		numQueries / layoutSingleTime, 1e9 * layoutSingleTime / numQueries, layoutTime);
+	printf("PartitionLocateBatch: %.0f queries/s (index built in %.3f s)\n",
+		numQueries / batchTime, buildTime);
+	if (keySum != layoutKeySum || keySum != batchKeySum) {
+		printf("MISMATCH between single and batch results\n");
+		return 1;
+	}
+	PartitionDestroy(part);
+	free(xs);
+	free(ys);
+	free(cells);
+	return 0;
+}
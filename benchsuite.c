@@ -0,0 +1,473 @@
+/*
+** Partition benchmark suite.
+** every workload is a seeded stream of points, the same for a given seed
+** on every machine. for each workload and size (powers of 10 from --min
+** to --max) a child process builds a partition point by point, prints it
+** and initializes it again, then reports one result:
+**   add_ns_per_op     - ns per ADD (PartitionRefine)
+**   print_ms          - PRINT_PARTITION of the whole partition to /dev/null
+**   init_ms           - INIT_PARTITION of the full partition, timed as
+**                       PartitionReset
+**   cells, depth      - size and depth of the partition built
+**   peak_rss_kb       - peak resident memory of the child
+**   add_allocs, add_alloc_bytes, print_allocs, init_frees - calls to the
+**                       allocator in each phase, -1 unless built with
+**                       BENCH_WRAP_ALLOC (see below)
+** results are printed one per line, as JSON objects (the default) or CSV.
+**
+** workloads:
+**   uniform    - uniform points in the unit square
+**   clustered  - gaussian clusters around a few random centers
+**   duplicates - few distinct points, each one added many times
+**   boundary   - x or y exactly 0.5 or 1.0, the other one uniform
+**   deepchain  - one point added DEEP_CHAIN_LENGTH times in a row, then
+**                the next point, building long chains of cells
+**
+** build (linux):
+**   gcc -std=c99 -O2 -pthread -DBENCH_WRAP_ALLOC \
+**       -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free \
+**       benchsuite.c partition.c gentree.c linpartition.c workpool.c \
+**       locindex.c outbuffer.c snapshot.c pointbuckets.c -o benchsuite -lm
+** run:
+**   ./benchsuite [--workload name|all] [--min n] [--max n] [--seed s]
+**                [--format json|csv]
+**   ./benchsuite --emit name n [--seed s]
+**       prints the command stream of a workload, for ./hmw3
+*/
+#define _POSIX_C_SOURCE 200809L//fork, clock_gettime, getrusage
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "partition.h"
+
+#define DEFAULT_MIN_SIZE 1000
+#define DEFAULT_MAX_SIZE 1000000
+#define DEFAULT_SEED 1
+#define CLUSTER_COUNT 16
+#define CLUSTER_SIGMA 0.01
+#define DUPLICATE_RATIO 16// adds of every distinct point
+#define DEEP_CHAIN_LENGTH 256
+#define PI 3.14159265358979323846
+
+typedef enum { FORMAT_JSON, FORMAT_CSV } OutputFormat;
+
+typedef void (*GenerateFunction)(unsigned long long* state, double* xs, double* ys, size_t n);
+
+/* definition of a workload */
+typedef struct _bench_workload {
+  const char* name;
+  GenerateFunction generate;
+} BENCHWORKLOAD;
+
+/* definition of the result of one run */
+typedef struct _bench_result {
+  size_t cells;
+  int depth;
+  double addNsPerOp;
+  double printMs;
+  double initMs;
+  long peakRssKb;
+  long addAllocs;
+  long addAllocBytes;
+  long printAllocs;
+  long initFrees;
+} BENCHRESULT;
+
+/*************************************************************************
+Function name	: NextRandom
+Description		: returns the next number of a 64 bit linear congruential
+				  generator, as a double in [0, 1)
+Paramerters		: state - the generator state
+Return value	: double - the number
+************************************************************************/
+static double NextRandom(unsigned long long* state);
+
+/*************************************************************************
+Function name	: GenUniform, GenClustered, GenDuplicates, GenBoundary,
+				  GenDeepChain
+Description		: fill n points of a workload
+Paramerters		: state - the generator state, xs,ys - the points,
+				  n - the amount of points
+Return value	: none
+************************************************************************/
+static void GenUniform(unsigned long long* state, double* xs, double* ys, size_t n);
+static void GenClustered(unsigned long long* state, double* xs, double* ys, size_t n);
+static void GenDuplicates(unsigned long long* state, double* xs, double* ys, size_t n);
+static void GenBoundary(unsigned long long* state, double* xs, double* ys, size_t n);
+static void GenDeepChain(unsigned long long* state, double* xs, double* ys, size_t n);
+
+/*************************************************************************
+Function name	: FindWorkload
+Description		: finds a workload by name
+Paramerters		: name - the name
+Return value	: const BENCHWORKLOAD* - the workload, NULL if not found
+************************************************************************/
+static const BENCHWORKLOAD* FindWorkload(const char* name);
+
+/*************************************************************************
+Function name	: NowNs
+Description		: returns the monotonic time
+Paramerters		: none
+Return value	: double - the time in ns
+************************************************************************/
+static double NowNs();
+
+/*************************************************************************
+Function name	: RunWorkload
+Description		: builds, prints and initializes a partition of n points
+				  of a workload, measuring every phase
+Paramerters		: workload - the workload, n - the amount of points,
+				  seed - the generator seed, result - updated with the result
+Return value	: Result - SUCCESS, FAILURE on allocation failure
+************************************************************************/
+static Result RunWorkload(const BENCHWORKLOAD* workload, size_t n,
+	unsigned long long seed, BENCHRESULT* result);
+
+/*************************************************************************
+Function name	: RunIsolated
+Description		: runs a workload in a child process, so that its peak
+				  memory is its own, and prints its result
+Paramerters		: workload - the workload, n - the amount of points,
+				  seed - the generator seed, format - the output format
+Return value	: Result - SUCCESS, FAILURE if the run failed
+************************************************************************/
+static Result RunIsolated(const BENCHWORKLOAD* workload, size_t n,
+	unsigned long long seed, OutputFormat format);
+
+/*************************************************************************
+Function name	: PrintResult
+Description		: prints the result of a run as one line
+Paramerters		: workload - the workload, n - the amount of points,
+				  seed - the generator seed, result - the result,
+				  format - the output format
+Return value	: none
+************************************************************************/
+static void PrintResult(const BENCHWORKLOAD* workload, size_t n,
+	unsigned long long seed, const BENCHRESULT* result, OutputFormat format);
+
+/*************************************************************************
+Function name	: EmitCommands
+Description		: prints the command stream of a workload: INIT_PARTITION,
+				  an ADD per point and PRINT_PARTITION
+Paramerters		: workload - the workload, n - the amount of points,
+				  seed - the generator seed
+Return value	: Result - SUCCESS, FAILURE on allocation failure
+************************************************************************/
+static Result EmitCommands(const BENCHWORKLOAD* workload, size_t n, unsigned long long seed);
+
+static const BENCHWORKLOAD workloads[] = {
+	{ "uniform", GenUniform },
+	{ "clustered", GenClustered },
+	{ "duplicates", GenDuplicates },
+	{ "boundary", GenBoundary },
+	{ "deepchain", GenDeepChain },
+};
+#define WORKLOAD_COUNT (sizeof(workloads) / sizeof(workloads[0]))
+
+//////////////////////// allocation counting ////////////////////////////
+
+static long allocCalls = 0;
+static long allocBytes = 0;
+static long freeCalls = 0;
+
+#ifdef BENCH_WRAP_ALLOC
+#define ALLOC_COUNTED TRUE
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void __real_free(void* ptr);
+
+//the batch pool threads allocate too, so the counters are atomic:
+void* __wrap_malloc(size_t size) {
+	__atomic_add_fetch(&allocCalls, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&allocBytes, (long)size, __ATOMIC_RELAXED);
+	return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+	__atomic_add_fetch(&allocCalls, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&allocBytes, (long)(count * size), __ATOMIC_RELAXED);
+	return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+	__atomic_add_fetch(&allocCalls, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&allocBytes, (long)size, __ATOMIC_RELAXED);
+	return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void* ptr) {
+	if (ptr != NULL) __atomic_add_fetch(&freeCalls, 1, __ATOMIC_RELAXED);
+	__real_free(ptr);
+}
+#else
+#define ALLOC_COUNTED FALSE
+#endif
+
+/////////////////////////////////////////////////////////////////////////
+
+static double NextRandom(unsigned long long* state) {
+	*state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+	return (double)(*state >> 11) / 9007199254740992.0;
+}
+
+static void GenUniform(unsigned long long* state, double* xs, double* ys, size_t n) {
+	for (size_t i = 0; i < n; i++) {
+		xs[i] = NextRandom(state);
+		ys[i] = NextRandom(state);
+	}
+}
+
+static void GenClustered(unsigned long long* state, double* xs, double* ys, size_t n) {
+	double cx[CLUSTER_COUNT], cy[CLUSTER_COUNT];
+	for (int c = 0; c < CLUSTER_COUNT; c++) {
+		cx[c] = 0.1 + 0.8 * NextRandom(state);
+		cy[c] = 0.1 + 0.8 * NextRandom(state);
+	}
+	for (size_t i = 0; i < n; i++) {
+		int c = (int)(NextRandom(state) * CLUSTER_COUNT);
+		do {// box-muller, redrawn until the point is in the square
+			double r = sqrt(-2.0 * log(1.0 - NextRandom(state))) * CLUSTER_SIGMA;
+			double a = 2.0 * PI * NextRandom(state);
+			xs[i] = cx[c] + r * cos(a);
+			ys[i] = cy[c] + r * sin(a);
+		} while (xs[i] < 0.0 || xs[i] >= 1.0 || ys[i] < 0.0 || ys[i] >= 1.0);
+	}
+}
+
+static void GenDuplicates(unsigned long long* state, double* xs, double* ys, size_t n) {
+	size_t distinct = n / DUPLICATE_RATIO + 1;
+	//the distinct points come first, the rest of the points repeat them:
+	GenUniform(state, xs, ys, (distinct < n) ? distinct : n);
+	for (size_t i = distinct; i < n; i++) {
+		size_t j = (size_t)(NextRandom(state) * distinct);
+		xs[i] = xs[j];
+		ys[i] = ys[j];
+	}
+}
+
+static void GenBoundary(unsigned long long* state, double* xs, double* ys, size_t n) {
+	for (size_t i = 0; i < n; i++) {
+		double edge = (NextRandom(state) < 0.5) ? 0.5 : 1.0;
+		double other = NextRandom(state);
+		Bool onX = NextRandom(state) < 0.5;
+		xs[i] = onX ? edge : other;
+		ys[i] = onX ? other : edge;
+	}
+}
+
+static void GenDeepChain(unsigned long long* state, double* xs, double* ys, size_t n) {
+	for (size_t i = 0; i < n; i++) {
+		if (i % DEEP_CHAIN_LENGTH == 0) {
+			xs[i] = NextRandom(state);
+			ys[i] = NextRandom(state);
+		}
+		else {
+			xs[i] = xs[i - 1];
+			ys[i] = ys[i - 1];
+		}
+	}
+}
+
+static const BENCHWORKLOAD* FindWorkload(const char* name) {
+	for (size_t i = 0; i < WORKLOAD_COUNT; i++) {
+		if (strcmp(workloads[i].name, name) == 0) return &workloads[i];
+	}
+	return NULL;
+}
+
+static double NowNs() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static Result RunWorkload(const BENCHWORKLOAD* workload, size_t n,
+	unsigned long long seed, BENCHRESULT* result) {
+	double* xs = (double*)malloc(n * sizeof(double));
+	double* ys = (double*)malloc(n * sizeof(double));
+	pPartition part = PartitionCreate(NULL);
+	FILE* devNull = fopen("/dev/null", "w");
+	if (xs == NULL || ys == NULL || part == NULL || devNull == NULL) {
+		free(xs);
+		free(ys);
+		PartitionDestroy(part);
+		if (devNull != NULL) fclose(devNull);
+		return FAILURE;
+	}
+	unsigned long long state = seed;
+	workload->generate(&state, xs, ys, n);
+	memset(result, 0, sizeof(BENCHRESULT));
+	result->cells = 1;
+
+	long allocsBefore = allocCalls, bytesBefore = allocBytes;
+	double start = NowNs();
+	for (size_t i = 0; i < n; i++) {
+		if (PartitionRefine(part, xs[i], ys[i]) == SUCCESS) result->cells++;
+	}
+	result->addNsPerOp = (NowNs() - start) / (double)n;
+	result->addAllocs = allocCalls - allocsBefore;
+	result->addAllocBytes = allocBytes - bytesBefore;
+
+	allocsBefore = allocCalls;
+	start = NowNs();
+	PartitionPrint(part, devNull);
+	fflush(devNull);
+	result->printMs = (NowNs() - start) / 1e6;
+	result->printAllocs = allocCalls - allocsBefore;
+
+	//every cell was added by a point, so the deepest point gives the depth:
+	for (size_t i = 0; i < n; i++) {
+		PartitionCell cell;
+		if (PartitionLocate(part, xs[i], ys[i], &cell) == SUCCESS && cell.depth > result->depth) {
+			result->depth = cell.depth;
+		}
+	}
+
+	long freesBefore = freeCalls;
+	start = NowNs();
+	PartitionReset(part, NULL);
+	result->initMs = (NowNs() - start) / 1e6;
+	result->initFrees = freeCalls - freesBefore;
+	if (!ALLOC_COUNTED) {
+		result->addAllocs = result->addAllocBytes = result->printAllocs = result->initFrees = -1;
+	}
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	result->peakRssKb = usage.ru_maxrss;
+
+	PartitionDestroy(part);
+	fclose(devNull);
+	free(xs);
+	free(ys);
+	return SUCCESS;
+}
+
+static void PrintResult(const BENCHWORKLOAD* workload, size_t n,
+	unsigned long long seed, const BENCHRESULT* result, OutputFormat format) {
+	if (format == FORMAT_CSV) {
+		printf("%s,%lu,%llu,%lu,%d,%.1f,%.3f,%.3f,%ld,%ld,%ld,%ld,%ld\n",
+			workload->name, (unsigned long)n, seed, (unsigned long)result->cells,
+			result->depth, result->addNsPerOp, result->printMs, result->initMs,
+			result->peakRssKb, result->addAllocs, result->addAllocBytes,
+			result->printAllocs, result->initFrees);
+	}
+	else {
+		printf("{\"workload\": \"%s\", \"size\": %lu, \"seed\": %llu, \"cells\": %lu, "
+			"\"depth\": %d, \"add_ns_per_op\": %.1f, \"print_ms\": %.3f, \"init_ms\": %.3f, "
+			"\"peak_rss_kb\": %ld, \"add_allocs\": %ld, \"add_alloc_bytes\": %ld, "
+			"\"print_allocs\": %ld, \"init_frees\": %ld}\n",
+			workload->name, (unsigned long)n, seed, (unsigned long)result->cells,
+			result->depth, result->addNsPerOp, result->printMs, result->initMs,
+			result->peakRssKb, result->addAllocs, result->addAllocBytes,
+			result->printAllocs, result->initFrees);
+	}
+	fflush(stdout);
+}
+
+static Result RunIsolated(const BENCHWORKLOAD* workload, size_t n,
+	unsigned long long seed, OutputFormat format) {
+	fflush(stdout);//not to be printed twice by the child
+	pid_t child = fork();
+	if (child < 0) return FAILURE;
+	if (child == 0) {
+		BENCHRESULT result;
+		if (RunWorkload(workload, n, seed, &result) == FAILURE) _exit(1);
+		PrintResult(workload, n, seed, &result, format);
+		_exit(0);
+	}
+	int status;
+	if (waitpid(child, &status, 0) < 0) return FAILURE;
+	return (WIFEXITED(status) && WEXITSTATUS(status) == 0) ? SUCCESS : FAILURE;
+}
+
+static Result EmitCommands(const BENCHWORKLOAD* workload, size_t n, unsigned long long seed) {
+	double* xs = (double*)malloc(n * sizeof(double));
+	double* ys = (double*)malloc(n * sizeof(double));
+	if (xs == NULL || ys == NULL) {
+		free(xs);
+		free(ys);
+		return FAILURE;
+	}
+	unsigned long long state = seed;
+	workload->generate(&state, xs, ys, n);
+	printf("INIT_PARTITION\n");
+	for (size_t i = 0; i < n; i++) {
+		printf("ADD %.17g %.17g\n", xs[i], ys[i]);
+	}
+	printf("PRINT_PARTITION\n");
+	free(xs);
+	free(ys);
+	return SUCCESS;
+}
+
+int main(int argc, char* argv[])
+{
+	const BENCHWORKLOAD* only = NULL;//NULL runs all the workloads
+	size_t minSize = DEFAULT_MIN_SIZE;
+	size_t maxSize = DEFAULT_MAX_SIZE;
+	unsigned long long seed = DEFAULT_SEED;
+	OutputFormat format = FORMAT_JSON;
+	const BENCHWORKLOAD* emit = NULL;
+	size_t emitSize = 0;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--workload") == 0 && i + 1 < argc) {
+			i++;
+			if (strcmp(argv[i], "all") == 0) continue;
+			if ((only = FindWorkload(argv[i])) == NULL) {
+				fprintf(stderr, "unknown workload %s\n", argv[i]);
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--min") == 0 && i + 1 < argc) {
+			minSize = (size_t)strtoull(argv[++i], NULL, 10);
+		}
+		else if (strcmp(argv[i], "--max") == 0 && i + 1 < argc) {
+			maxSize = (size_t)strtoull(argv[++i], NULL, 10);
+		}
+		else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+			seed = strtoull(argv[++i], NULL, 10);
+		}
+		else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+			format = (strcmp(argv[++i], "csv") == 0) ? FORMAT_CSV : FORMAT_JSON;
+		}
+		else if (strcmp(argv[i], "--emit") == 0 && i + 2 < argc) {
+			if ((emit = FindWorkload(argv[i + 1])) == NULL) {
+				fprintf(stderr, "unknown workload %s\n", argv[i + 1]);
+				return 1;
+			}
+			emitSize = (size_t)strtoull(argv[i + 2], NULL, 10);
+			i += 2;
+		}
+		else {
+			fprintf(stderr, "usage: %s [--workload name|all] [--min n] [--max n] [--seed s]"
+				" [--format json|csv] [--emit name n]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (emit != NULL) return (EmitCommands(emit, emitSize, seed) == SUCCESS) ? 0 : 1;
+	if (minSize < 1) minSize = 1;
+
+	if (format == FORMAT_CSV) {
+		printf("workload,size,seed,cells,depth,add_ns_per_op,print_ms,init_ms,"
+			"peak_rss_kb,add_allocs,add_alloc_bytes,print_allocs,init_frees\n");
+	}
+	int failures = 0;
+	for (size_t w = 0; w < WORKLOAD_COUNT; w++) {
+		if (only != NULL && only != &workloads[w]) continue;
+		for (size_t n = minSize; n <= maxSize; n *= 10) {
+			if (RunIsolated(&workloads[w], n, seed, format) == FAILURE) {
+				fprintf(stderr, "%s %lu: run failed\n", workloads[w].name, (unsigned long)n);
+				failures++;
+			}
+		}
+	}
+	return (failures == 0) ? 0 : 1;
+}
@@ -15,15 +15,57 @@ typedef struct _ELEMENT{
   int childrenCount;
 } ELEMENT, *PELEMENT;
 
+/* definition of a slot in the key index (open addressing, linear probing) */
+typedef struct _KEYSLOT{
+  int key;
+  PELEMENT elem;// NULL marks an empty slot
+} KEYSLOT, *PKEYSLOT;
+
+#define INDEX_INIT_CAPACITY 16
+#define INDEX_HASH_MULT 2654435769u
+
+/* definition of an arena slab - a block of equally sized chunks, each
+   holding an ELEMENT, its k children pointers and (optionally) its node */
+typedef struct _SLAB{
+  struct _SLAB* next;
+} SLAB, *PSLAB;
+
+#define SLAB_BYTES 65536
+#define CHUNK_ALIGN 16
+#define ALIGN_UP(n, a) (((n) + (a) - 1) / (a) * (a))
+
+#define ITER_INIT_CAPACITY 32
+
+#ifdef TREE_STATS
+#define TREE_STAT_ADD(tree, field, value) ((tree)->stats.field += (value))
+#else
+#define TREE_STAT_ADD(tree, field, value) ((void)0)
+#endif
+
 /* definition of the tree structure */    
 typedef struct _tree{
   PELEMENT head;
   int k;// number of children in the tree
   int nodeCount;
+  PKEYSLOT index;// key->element table, NULL if the tree has no index
+  int indexCapacity;// always a power of 2
+  int indexCount;
+  TreeAllocPolicy allocPolicy;
+  size_t objSize;// size of a node stored inline in its chunk, 0 to use cloneFunc
+  size_t objOffset;// offset of the node in its chunk
+  size_t chunkSize;
+  size_t chunksPerSlab;
+  PSLAB slabs;// all slabs of the arena, most recent first
+  char* slabCursor;// next unused chunk in the most recent slab
+  char* slabEnd;
+  void* freeChunks;// chunks released by TreeDelLeaf, linked through their first bytes
   GetKeyFunction getKeyFunc;
   CloneFunction cloneFunc;
   PrintFunction printFunc;
   DelFunction delFunc;
+#ifdef TREE_STATS
+  TreeStats stats;
+#endif
 } Tree, *pTree;
 
 /* *** complete the interface functions implementation *** */
@@ -33,9 +75,46 @@ pTree TreeCreate(GetKeyFunction getKeyFunc,
 	PrintFunction printFunc,
 	DelFunction delFunc,
 	int k) {
+	return TreeCreateEx(getKeyFunc, cloneFunc, printFunc, delFunc, k, NULL);
+}
+
+pTree TreeCreateEx(GetKeyFunction getKeyFunc,
+	CloneFunction cloneFunc,
+	PrintFunction printFunc,
+	DelFunction delFunc,
+	int k,
+	const TreeParams* params) {
 	pTree newTree;
 	if( ( newTree = (pTree)malloc(sizeof(Tree)) ) == NULL) return NULL;
 	newTree->head = NULL;
+	newTree->index = NULL;
+	newTree->indexCapacity = 0;
+	newTree->indexCount = 0;
+#ifdef TREE_STATS
+	memset(&newTree->stats, 0, sizeof(TreeStats));
+#endif
+	if (params == NULL || params->useIndex) {
+		TREE_STAT_ADD(newTree, allocations, 1);
+		TREE_STAT_ADD(newTree, allocBytes, INDEX_INIT_CAPACITY * sizeof(KEYSLOT));
+		newTree->index = (PKEYSLOT)calloc(INDEX_INIT_CAPACITY, sizeof(KEYSLOT));
+		if (newTree->index != NULL) newTree->indexCapacity = INDEX_INIT_CAPACITY;
+	}
+	newTree->allocPolicy = (params != NULL) ? params->allocPolicy : TREE_ALLOC_HEAP;
+	newTree->objSize = 0;
+	newTree->objOffset = 0;
+	newTree->chunkSize = 0;
+	newTree->chunksPerSlab = 0;
+	newTree->slabs = NULL;
+	newTree->slabCursor = NULL;
+	newTree->slabEnd = NULL;
+	newTree->freeChunks = NULL;
+	if (newTree->allocPolicy == TREE_ALLOC_ARENA) {
+		newTree->objSize = params->objSize;
+		newTree->objOffset = ALIGN_UP(sizeof(ELEMENT) + k * sizeof(PELEMENT), CHUNK_ALIGN);
+		newTree->chunkSize = newTree->objOffset + ALIGN_UP(params->objSize, CHUNK_ALIGN);
+		newTree->chunksPerSlab = (SLAB_BYTES - CHUNK_ALIGN) / newTree->chunkSize;
+		if (newTree->chunksPerSlab == 0) newTree->chunksPerSlab = 1;
+	}
 	newTree->cloneFunc = cloneFunc;
 	newTree->getKeyFunc = getKeyFunc;
 	newTree->printFunc = printFunc;
@@ -47,20 +126,41 @@ pTree TreeCreate(GetKeyFunction getKeyFunc,
 ///////////////////  internal static functions ///////////////////////////
 
 /*************************************************************************
-Function name	: RecurTreeDestroy
-Description		: 
-Paramerters		: 
-Return value	: 
+Function name	: DetachElement
+Description		: removes a childless element from its parent's children,
+				  or from the head of the tree if it is the root
+Paramerters		: tree - a pointer to the tree, pElem - the element
+Return value	: none
 ************************************************************************/
-static void RecurTreeDestroy(pTree tree, PELEMENT head);
+static void DetachElement(pTree tree, PELEMENT pElem);
 
 /*************************************************************************
-Function name	: RecurElementPrint
-Description		:
-Paramerters		:
-Return value	:
+Function name	: FreeSubtree
+Description		: detaches and frees an element and every element below
+				  it without allocating anything, by walking down to a leaf
+				  and back up through the parent pointers
+Paramerters		: tree - a pointer to the tree, top - the top element
+Return value	: int - the amount of elements freed
+************************************************************************/
+static int FreeSubtree(pTree tree, PELEMENT top);
+
+/*************************************************************************
+Function name	: DestroyInPlace
+Description		: frees every element left in the tree with FreeSubtree.
+				  used when TreeDestroy runs out of memory for its iterator.
+Paramerters		: tree - a pointer to the tree
+Return value	: none
 ************************************************************************/
-static void RecurElementPrint(pTree tree, PELEMENT head);
+static void DestroyInPlace(pTree tree);
+
+/*************************************************************************
+Function name	: IterReserve
+Description		: makes room in an iterator for 'extra' more elements,
+				  doubling its stack (or unwrapping its queue) if needed
+Paramerters		: iter - the iterator, extra - the amount of new elements
+Return value	: Result - SUCCESS, FAILURE on allocation failure
+************************************************************************/
+static Result IterReserve(pTreeIter iter, size_t extra);
 
 /*************************************************************************
 Function name	: CreateElement
@@ -70,34 +170,371 @@ Return value	:
 ************************************************************************/
 static PELEMENT CreateElement(pTree tree, pNode newNode, PELEMENT parentNode);
 
-/*************************************************************************
-Function name	: RecurTreeGetElem
-Description		:
-Paramerters		:
-Return value	:
+/*************************************************************************
+Function name	: FreeElement
+Description		: frees an element, its children array and its node
+Paramerters		: tree - a pointer to the tree, pElem - the element
+Return value	: none
+************************************************************************/
+static void FreeElement(pTree tree, PELEMENT pElem);
+
+/*************************************************************************
+Function name	: ArenaAlloc
+Description		: takes a chunk from the free list, or the next unused chunk
+				  of the arena, adding a slab when the last one is full
+Paramerters		: tree - a pointer to the tree
+Return value	: void* - the chunk, NULL on allocation failure
 ************************************************************************/
-static PELEMENT RecurTreeGetElem(pTree tree, int key, PELEMENT treeElem);
+static void* ArenaAlloc(pTree tree);
+
+/*************************************************************************
+Function name	: ArenaRelease
+Description		: frees all the slabs of the arena at once
+Paramerters		: tree - a pointer to the tree
+Return value	: none
+************************************************************************/
+static void ArenaRelease(pTree tree);
+
+/*************************************************************************
+Function name	: TreeGetElem
+Description		: finds the element whose key is 'key', through the key index
+				  when the tree has one, else by searching the whole tree
+Paramerters		: tree - a pointer to the tree,
+				  key - the key of the desired element
+Return value	: PELEMENT - the element, NULL if not found
+************************************************************************/
+static PELEMENT TreeGetElem(pTree tree, int key);
+
+/*************************************************************************
+Function name	: IndexSlot
+Description		: returns the first probe position of 'key' in the index
+Paramerters		: tree - a pointer to the tree, key - the key to hash
+Return value	: int - a position in [0, indexCapacity)
+************************************************************************/
+static int IndexSlot(pTree tree, int key);
+
+/*************************************************************************
+Function name	: IndexInsert
+Description		: maps 'key' to 'elem' in the index, growing it when it is
+				  half full. if growing fails the index is dropped and the
+				  tree falls back to searching.
+Paramerters		: tree - a pointer to the tree,
+				  key - the key of the element, elem - the element
+Return value	: none
+************************************************************************/
+static void IndexInsert(pTree tree, int key, PELEMENT elem);
+
+/*************************************************************************
+Function name	: IndexRemove
+Description		: removes the mapping of 'key' to 'elem' from the index,
+				  shifting back the following entries of the probe sequence
+Paramerters		: tree - a pointer to the tree,
+				  key - the key of the element, elem - the element
+Return value	: none
+************************************************************************/
+static void IndexRemove(pTree tree, int key, PELEMENT elem);
 
 /////////////////////////////////////////////////////////////////////////
 
-// destroys recursively the head and all its children
-static void RecurTreeDestroy(pTree tree, PELEMENT head) {
-	if (head == NULL) return;//input check
-	if (head->childrenCount > 0) {
-		for (int i = 0; i < tree->k; i++) {
-			RecurTreeDestroy(tree, head->children[i] );
+static int IndexSlot(pTree tree, int key) {
+	unsigned int hash = (unsigned int)key * INDEX_HASH_MULT;
+	return (int)(hash & (unsigned int)(tree->indexCapacity - 1));
+}
+
+static void IndexInsert(pTree tree, int key, PELEMENT elem) {
+	if (tree->index == NULL) return;
+	if (2 * (tree->indexCount + 1) > tree->indexCapacity) {
+		// rehash all entries into a table twice as big:
+		PKEYSLOT oldIndex = tree->index;
+		int oldCapacity = tree->indexCapacity;
+		TREE_STAT_ADD(tree, allocations, 1);
+		TREE_STAT_ADD(tree, allocBytes, 2 * oldCapacity * sizeof(KEYSLOT));
+		tree->index = (PKEYSLOT)calloc(2 * oldCapacity, sizeof(KEYSLOT));
+		if (tree->index == NULL) {
+			free(oldIndex);
+			tree->indexCapacity = 0;
+			tree->indexCount = 0;
+			return;
+		}
+		tree->indexCapacity = 2 * oldCapacity;
+		for (int i = 0; i < oldCapacity; i++) {
+			if (oldIndex[i].elem == NULL) continue;
+			int j = IndexSlot(tree, oldIndex[i].key);
+			while (tree->index[j].elem != NULL) j = (j + 1) & (tree->indexCapacity - 1);
+			tree->index[j] = oldIndex[i];
+		}
+		free(oldIndex);
+	}
+	int i = IndexSlot(tree, key);
+	while (tree->index[i].elem != NULL) {
+		if (tree->index[i].key == key) return;// keys are unique, keep the first
+		i = (i + 1) & (tree->indexCapacity - 1);
+	}
+	tree->index[i].key = key;
+	tree->index[i].elem = elem;
+	tree->indexCount++;
+}
+
+static void IndexRemove(pTree tree, int key, PELEMENT elem) {
+	if (tree->index == NULL) return;
+	int mask = tree->indexCapacity - 1;
+	int i = IndexSlot(tree, key);
+	while (tree->index[i].elem != elem) {
+		if (tree->index[i].elem == NULL) return;// not indexed
+		i = (i + 1) & mask;
+	}
+	// backward shift deletion - no tombstones are left behind:
+	int j = i;
+	while (1) {
+		j = (j + 1) & mask;
+		if (tree->index[j].elem == NULL) break;
+		int home = IndexSlot(tree, tree->index[j].key);
+		// move the entry at j to the hole at i unless its home lies in (i, j]
+		if (((j - home) & mask) >= ((j - i) & mask)) {
+			tree->index[i] = tree->index[j];
+			i = j;
+		}
+	}
+	tree->index[i].elem = NULL;
+	tree->indexCount--;
+}
+
+static PELEMENT TreeGetElem(pTree tree, int key) {
+	TREE_STAT_ADD(tree, lookups, 1);
+	if (tree->index == NULL) {
+		// no index - search the whole tree, the first match in pre-order:
+		TreeIter iter;
+		PELEMENT elem;
+		TreeIterBegin(tree, &iter, TREE_ITER_PREORDER);
+		while ((elem = TreeIterNext(&iter)) != NULL) {
+			TREE_STAT_ADD(tree, lookupVisits, 1);
+			if (tree->getKeyFunc(elem->obj) == key) break;
+		}
+		TreeIterEnd(&iter);
+		return elem;
+	}
+	int i = IndexSlot(tree, key);
+	while (tree->index[i].elem != NULL) {
+		TREE_STAT_ADD(tree, lookupVisits, 1);
+		if (tree->index[i].key == key) return tree->index[i].elem;
+		i = (i + 1) & (tree->indexCapacity - 1);
+	}
+	TREE_STAT_ADD(tree, lookupVisits, 1);// the empty slot ending the search
+	return NULL;
+}
+
+static void* ArenaAlloc(pTree tree) {
+	void* chunk = tree->freeChunks;
+	if (chunk != NULL) {
+		tree->freeChunks = *(void**)chunk;
+		return chunk;
+	}
+	if (tree->slabCursor == tree->slabEnd) {
+		// the slab header takes the first CHUNK_ALIGN bytes, keeping the chunks aligned
+		TREE_STAT_ADD(tree, allocations, 1);
+		TREE_STAT_ADD(tree, allocBytes, CHUNK_ALIGN + tree->chunksPerSlab * tree->chunkSize);
+		PSLAB newSlab = (PSLAB)malloc(CHUNK_ALIGN + tree->chunksPerSlab * tree->chunkSize);
+		if (newSlab == NULL) return NULL;
+		newSlab->next = tree->slabs;
+		tree->slabs = newSlab;
+		tree->slabCursor = (char*)newSlab + CHUNK_ALIGN;
+		tree->slabEnd = tree->slabCursor + tree->chunksPerSlab * tree->chunkSize;
+	}
+	chunk = tree->slabCursor;
+	tree->slabCursor += tree->chunkSize;
+	return chunk;
+}
+
+static void ArenaRelease(pTree tree) {
+	while (tree->slabs != NULL) {
+		PSLAB next = tree->slabs->next;
+		free(tree->slabs);
+		tree->slabs = next;
+	}
+	tree->slabCursor = NULL;
+	tree->slabEnd = NULL;
+	tree->freeChunks = NULL;
+}
+
+static void FreeElement(pTree tree, PELEMENT pElem) {
+	TREE_STAT_ADD(tree, deletes, 1);
+	if (tree->allocPolicy == TREE_ALLOC_ARENA) {
+		if (tree->objSize == 0) tree->delFunc(pElem->obj);
+		*(void**)pElem = tree->freeChunks;
+		tree->freeChunks = pElem;
+	}
+	else {
+		tree->delFunc(pElem->obj);
+		free(pElem->children);
+		free(pElem);
+	}
+}
+
+static void DetachElement(pTree tree, PELEMENT pElem) {
+	if (pElem->parent == NULL) {
+		tree->head = NULL;
+		return;
+	}
+	for (int i = 0; i < tree->k; i++) {
+		if (pElem->parent->children[i] == pElem) {
+			pElem->parent->children[i] = NULL;
+			pElem->parent->childrenCount--;
+			return;
+		}
+	}
+}
+
+static int FreeSubtree(pTree tree, PELEMENT top) {
+	PELEMENT elem = top;
+	int freed = 0;
+	while (TRUE) {
+		int i = 0;
+		if (elem->childrenCount > 0) {
+			while (i < tree->k && elem->children[i] == NULL) i++;
+			if (i < tree->k) {
+				elem = elem->children[i];
+				continue;
+			}
+		}
+		PELEMENT parent = elem->parent;
+		Bool last = (elem == top);
+		DetachElement(tree, elem);
+		IndexRemove(tree, tree->getKeyFunc(elem->obj), elem);
+		FreeElement(tree, elem);
+		tree->nodeCount--;
+		freed++;
+		if (last) return freed;
+		elem = parent;
+	}
+}
+
+static void DestroyInPlace(pTree tree) {
+	if (tree->head != NULL) FreeSubtree(tree, tree->head);
+}
+
+static Result IterReserve(pTreeIter iter, size_t extra) {
+	if (iter->count + extra <= iter->capacity) return SUCCESS;
+	size_t oldCapacity = iter->capacity;
+	size_t newCapacity = (oldCapacity == 0) ? ITER_INIT_CAPACITY : 2 * oldCapacity;
+	while (newCapacity < iter->count + extra) newCapacity *= 2;
+	PELEMENT* newItems = (PELEMENT*)realloc(iter->items, newCapacity * sizeof(PELEMENT));
+	if (newItems == NULL) return FAILURE;
+	iter->items = newItems;
+	if (iter->order == TREE_ITER_POSTORDER) {
+		int* newSlots = (int*)realloc(iter->nextSlots, newCapacity * sizeof(int));
+		if (newSlots == NULL) return FAILURE;
+		iter->nextSlots = newSlots;
+	}
+	// a queue that wraps around continues right after its old end:
+	if (iter->head + iter->count > oldCapacity) {
+		size_t wrapped = iter->head + iter->count - oldCapacity;
+		memcpy(newItems + oldCapacity, newItems, wrapped * sizeof(PELEMENT));
+	}
+	iter->capacity = newCapacity;
+	return SUCCESS;
+}
+
+Result TreeIterBegin(pTree tree, pTreeIter iter, TreeIterOrder order) {
+	if (iter == NULL) return FAILURE;//input check
+	iter->tree = tree;
+	iter->order = order;
+	iter->items = NULL;
+	iter->nextSlots = NULL;
+	iter->head = 0;
+	iter->count = 0;
+	iter->capacity = 0;
+	iter->failed = FALSE;
+	if (tree == NULL) return FAILURE;
+	if (tree->head == NULL) return SUCCESS;
+	if (IterReserve(iter, 1) == FAILURE) {
+		iter->failed = TRUE;
+		return FAILURE;
+	}
+	iter->items[0] = tree->head;
+	if (order == TREE_ITER_POSTORDER) iter->nextSlots[0] = 0;
+	iter->count = 1;
+	return SUCCESS;
+}
+
+PELEMENT TreeIterNext(pTreeIter iter) {
+	if (iter == NULL || iter->failed || iter->count == 0) return NULL;
+	int k = iter->tree->k;
+	PELEMENT elem;
+	switch (iter->order) {
+	case TREE_ITER_PREORDER:
+		elem = iter->items[iter->count - 1];
+		if (IterReserve(iter, elem->childrenCount) == FAILURE) break;
+		iter->count--;
+		// pushed last to first, so that the first child is popped first:
+		for (int i = k - 1; i >= 0; i--) {
+			if (elem->children[i] != NULL) iter->items[iter->count++] = elem->children[i];
+		}
+		return elem;
+	case TREE_ITER_LEVELORDER:
+		elem = iter->items[iter->head];
+		if (IterReserve(iter, elem->childrenCount) == FAILURE) break;
+		iter->head = (iter->head + 1) % iter->capacity;
+		iter->count--;
+		for (int i = 0; i < k; i++) {
+			if (elem->children[i] != NULL) {
+				iter->items[(iter->head + iter->count) % iter->capacity] = elem->children[i];
+				iter->count++;
+			}
+		}
+		return elem;
+	case TREE_ITER_POSTORDER:
+		while (iter->count > 0) {
+			size_t top = iter->count - 1;
+			int slot = iter->nextSlots[top];
+			elem = iter->items[top];
+			while (slot < k && elem->children[slot] == NULL) slot++;
+			if (slot == k) {
+				iter->count--;
+				return elem;
+			}
+			if (IterReserve(iter, 1) == FAILURE) break;
+			// the slot is passed only once its child is on the stack:
+			iter->nextSlots[top] = slot + 1;
+			iter->items[iter->count] = elem->children[slot];
+			iter->nextSlots[iter->count] = 0;
+			iter->count++;
 		}
+		if (iter->count == 0) return NULL;
+		break;
 	}
-	tree->delFunc(head->obj);
-	free(head->children);
-	free(head);
+	iter->failed = TRUE;
+	return NULL;
+}
+
+Result TreeIterEnd(pTreeIter iter) {
+	if (iter == NULL) return FAILURE;//input check
+	free(iter->items);
+	free(iter->nextSlots);
+	iter->items = NULL;
+	iter->nextSlots = NULL;
+	iter->count = 0;
+	iter->capacity = 0;
+	return iter->failed ? FAILURE : SUCCESS;
 }
+
 //destroys tree
 void TreeDestroy(pTree tree) {
 	if (tree == NULL) return;
-	if(tree->head != NULL){
-		RecurTreeDestroy(tree, tree->head);
+	// an arena holding its nodes inline is released slab by slab:
+	Bool perNode = (tree->allocPolicy == TREE_ALLOC_HEAP || tree->objSize == 0);
+	if(tree->head != NULL && perNode){
+		// post-order, so every element is freed after its children:
+		TreeIter iter;
+		PELEMENT elem;
+		TreeIterBegin(tree, &iter, TREE_ITER_POSTORDER);
+		while ((elem = TreeIterNext(&iter)) != NULL) {
+			DetachElement(tree, elem);
+			FreeElement(tree, elem);
+		}
+		if (TreeIterEnd(&iter) == FAILURE) DestroyInPlace(tree);
 	}
+	ArenaRelease(tree);
+	free(tree->index);
 	free(tree);
 }
 
@@ -106,26 +543,55 @@ int TreeNodesCount(pTree tree) {
 	return tree->nodeCount;
 }
 
-static void RecurElementPrint(pTree tree, PELEMENT head) {
-	if (head == NULL) return;
-	tree->printFunc(head->obj);
-	if (head->childrenCount > 0) {
-		for (int i = 0;i < tree->k; i++) {
-			if (head->children + i != NULL) {
-				RecurElementPrint(tree, head->children[i]);
-			}	
-		}
-	}
+Result TreeGetStats(pTree tree, TreeStats* stats) {
+	if (tree == NULL || stats == NULL) return FAILURE;//input check
+#ifdef TREE_STATS
+	*stats = tree->stats;
+	return SUCCESS;
+#else
+	return FAILURE;
+#endif
 }
+
 void TreePrint(pTree tree) {
 	if (tree == NULL) return;
 	if (tree->head == NULL) return; 
-	RecurElementPrint(tree, tree->head);
+	TreeIter iter;
+	PELEMENT elem;
+	TreeIterBegin(tree, &iter, TREE_ITER_PREORDER);
+	while ((elem = TreeIterNext(&iter)) != NULL) {
+		tree->printFunc(elem->obj);
+	}
+	TreeIterEnd(&iter);
 }
 
 
 static PELEMENT CreateElement(pTree tree, pNode newNode, PELEMENT parentNode) {
 
+	if (tree->allocPolicy == TREE_ALLOC_ARENA) {
+		// one chunk: the element, its children array and its node
+		PELEMENT newElement = (PELEMENT)ArenaAlloc(tree);
+		if (newElement == NULL) return NULL;
+		TREE_STAT_ADD(tree, clones, 1);
+		newElement->children = (PELEMENT*)(newElement + 1);
+		if (tree->objSize > 0) {
+			newElement->obj = (char*)newElement + tree->objOffset;
+			memcpy(newElement->obj, newNode, tree->objSize);
+		}
+		else {
+			newElement->obj = tree->cloneFunc(newNode);
+		}
+		newElement->parent = parentNode;
+		newElement->childrenCount = 0;
+		for (int i = 0; i < tree->k; i++) {
+			newElement->children[i] = NULL;
+		}
+		return newElement;
+	}
+
+	TREE_STAT_ADD(tree, allocations, 2);
+	TREE_STAT_ADD(tree, allocBytes, sizeof(ELEMENT) + tree->k * sizeof(PELEMENT));
+	TREE_STAT_ADD(tree, clones, 1);
 	PELEMENT newElement = (PELEMENT)malloc(sizeof(ELEMENT)); // Create a new element
 	if (newElement == NULL) return NULL;
 	newElement->obj = tree->cloneFunc(newNode);
@@ -152,55 +618,52 @@ Result TreeAddLeaf(pTree tree, int parentKey, pNode newNode) {
 		if (newElement == NULL) return FAILURE;
 		tree->head = newElement;
 		tree->nodeCount++;
+		IndexInsert(tree, tree->getKeyFunc(newElement->obj), newElement);
 	}
 	else {
 		// find the tree element with desired key value:
-		PELEMENT parentElem = RecurTreeGetElem(tree, parentKey,tree->head); 
-		if (parentElem == NULL || parentElem->childrenCount == tree->k) return FAILURE;
-		PELEMENT newElement = CreateElement(tree, newNode, parentElem); // Create a new element
-		if (newElement == NULL) return FAILURE;
-		for (int i = 0; i < tree->k; i++) { // Add the new element to the parent node's children, in the first free place
-			if (parentElem->children[i] == NULL) {
-				parentElem->children[i] = newElement;
-				break;
-			}
-		}
-		parentElem->childrenCount++;
-		tree->nodeCount++;
+		PELEMENT parentElem = TreeGetElem(tree, parentKey);
+		if (parentElem == NULL) return FAILURE;
+		if (TreeElemAddLeaf(tree, parentElem, newNode, NULL) == NULL) return FAILURE;
 	}
 	return SUCCESS;
 
 }
-pNode TreeGetRoot(pTree tree) {
-	if (tree == NULL) return NULL;
-	return tree->cloneFunc(tree->head->obj);
-}
 
-static PELEMENT RecurTreeGetElem(pTree tree, int key, PELEMENT treeElem) {
-	if (treeElem == NULL || tree == NULL) return NULL;//input check
-	if (tree->getKeyFunc(treeElem->obj) == key) return treeElem;
-	else {
-		if (treeElem->childrenCount > 0) {
-			PELEMENT tmpResult = NULL;
-			for (int i = 0; i < tree->k; i++) {
-				tmpResult = RecurTreeGetElem(tree, key, *(treeElem->children + i));
-				if (tmpResult != NULL) return tmpResult;
-			}
+PELEMENT TreeElemAddLeaf(pTree tree, PELEMENT pParent, pNode newNode, int* slot) {
+	if (tree == NULL || pParent == NULL || newNode == NULL) return NULL;//input check
+	if (pParent->childrenCount == tree->k) return NULL;
+	PELEMENT newElement = CreateElement(tree, newNode, pParent); // Create a new element
+	if (newElement == NULL) return NULL;
+	for (int i = 0; i < tree->k; i++) { // Add the new element to the parent node's children, in the first free place
+		if (pParent->children[i] == NULL) {
+			pParent->children[i] = newElement;
+			if (slot != NULL) *slot = i;
+			break;
 		}
-		return NULL;
 	}
+	pParent->childrenCount++;
+	tree->nodeCount++;
+	IndexInsert(tree, tree->getKeyFunc(newElement->obj), newElement);
+	return newElement;
+}
+pNode TreeGetRoot(pTree tree) {
+	if (tree == NULL) return NULL;
+	return tree->cloneFunc(tree->head->obj);
 }
 
 pNode TreeGetNode(pTree tree, int key) {
 	if (tree == NULL) return NULL;
 	if (tree->head == NULL) return NULL;
-	return tree->cloneFunc(RecurTreeGetElem(tree, key, tree->head)->obj);
+	PELEMENT pElem = TreeGetElem(tree, key);
+	if (pElem == NULL) return NULL;
+	return tree->cloneFunc(pElem->obj);
 }
 
 pNode* TreeGetChildren(pTree tree, int key) {
 	if (tree == NULL) return NULL;//input check
 	if (tree->head == NULL) return NULL;//check if tree is empty
-	PELEMENT parentElem = RecurTreeGetElem(tree, key,tree->head);
+	PELEMENT parentElem = TreeGetElem(tree, key);
 	if (parentElem == NULL) return NULL;
 	pNode* childArr = (pNode*)malloc((tree->k) * sizeof(pNode));
 	if (childArr == NULL) return NULL;
@@ -218,7 +681,7 @@ pNode* TreeGetChildren(pTree tree, int key) {
 Result TreeNodeIsActive(pTree tree, int key, Bool* isActive) {
 	if (tree == NULL) return FAILURE;//input check
 	if (tree->head == NULL) return FAILURE;//check if tree is empty
-	PELEMENT pElem = RecurTreeGetElem(tree, key, tree->head);
+	PELEMENT pElem = TreeGetElem(tree, key);
 	if (pElem == NULL) return FAILURE;
 	if (pElem->childrenCount < tree->k) {
 		*isActive = TRUE;
@@ -232,7 +695,7 @@ Result TreeNodeIsActive(pTree tree, int key, Bool* isActive) {
 Result TreeNodeIsLeaf(pTree tree, int key, Bool* isLeaf) {
 	if (tree == NULL) return FAILURE;//input check
 	if (tree->head == NULL) return FAILURE;//check if tree is empty
-	PELEMENT pElem = RecurTreeGetElem(tree, key, tree->head);
+	PELEMENT pElem = TreeGetElem(tree, key);
 	if (pElem == NULL) return FAILURE;
 	if (pElem->childrenCount == 0) {
 		*isLeaf = TRUE;
@@ -246,24 +709,13 @@ Result TreeNodeIsLeaf(pTree tree, int key, Bool* isLeaf) {
 Result TreeDelLeaf(pTree tree, int key) {
 	if (tree == NULL) return FAILURE;//input check
 	if (tree->head == NULL) return FAILURE;//check if tree is empty
-	PELEMENT pElem = RecurTreeGetElem(tree, key, tree->head);
+	PELEMENT pElem = TreeGetElem(tree, key);
 	if (pElem == NULL) return FAILURE;
 
 	if (pElem->childrenCount == 0) {
-		if (pElem->parent != NULL) {//if not root element
-			// Updating parent's data:
-			pElem->parent->childrenCount--;
-			PELEMENT tmpChild = NULL;
-			for (int i = 0; i < tree->k; i++) {
-				tmpChild = pElem->parent->children[i];
-				if (tree->getKeyFunc(tmpChild->obj) == tree->getKeyFunc(pElem->obj)) {
-					pElem->parent->children[i] = NULL;
-					break;
-				}
-			}
-		}
-		tree->delFunc(pElem->obj);
-		free(pElem);
+		DetachElement(tree, pElem);
+		IndexRemove(tree, key, pElem);
+		FreeElement(tree, pElem);//with its children array
 		tree->nodeCount--;
 		return SUCCESS;
 	}
@@ -271,3 +723,78 @@ Result TreeDelLeaf(pTree tree, int key) {
 		return FAILURE;
 	}
 }
+
+int TreeDelSubtree(pTree tree, int key) {
+	if (tree == NULL) return -1;//input check
+	if (tree->head == NULL) return -1;//check if tree is empty
+	PELEMENT pElem = TreeGetElem(tree, key);
+	if (pElem == NULL) return -1;
+	return FreeSubtree(tree, pElem);
+}
+
+pcNode TreePeekRoot(pTree tree) {
+	if (tree == NULL || tree->head == NULL) return NULL;
+	return tree->head->obj;
+}
+
+pcNode TreePeekNode(pTree tree, int key) {
+	if (tree == NULL || tree->head == NULL) return NULL;
+	PELEMENT pElem = TreeGetElem(tree, key);
+	if (pElem == NULL) return NULL;
+	return pElem->obj;
+}
+
+pcNode TreePeekChild(pTree tree, int key, int slot) {
+	if (tree == NULL || tree->head == NULL) return NULL;
+	if (slot < 0 || slot >= tree->k) return NULL;
+	PELEMENT pElem = TreeGetElem(tree, key);
+	if (pElem == NULL || pElem->children[slot] == NULL) return NULL;
+	return pElem->children[slot]->obj;
+}
+
+Result TreePeekChildren(pTree tree, int key, pcNode* childArr) {
+	if (tree == NULL || childArr == NULL) return FAILURE;//input check
+	if (tree->head == NULL) return FAILURE;//check if tree is empty
+	PELEMENT pElem = TreeGetElem(tree, key);
+	if (pElem == NULL) return FAILURE;
+	for (int i = 0; i < tree->k; i++) {
+		childArr[i] = (pElem->children[i] != NULL) ? pElem->children[i]->obj : NULL;
+	}
+	return SUCCESS;
+}
+
+int TreeVisitChildren(pTree tree, int key, VisitFunction visitFunc, void* ctx) {
+	if (tree == NULL || visitFunc == NULL) return -1;//input check
+	if (tree->head == NULL) return -1;//check if tree is empty
+	PELEMENT pElem = TreeGetElem(tree, key);
+	if (pElem == NULL) return -1;
+	int visited = 0;
+	for (int i = 0; i < tree->k && visited < pElem->childrenCount; i++) {
+		if (pElem->children[i] != NULL) {
+			visitFunc(pElem->children[i]->obj, ctx);
+			visited++;
+		}
+	}
+	return visited;
+}
+
+PELEMENT TreeRootElem(pTree tree) {
+	if (tree == NULL) return NULL;
+	return tree->head;
+}
+
+PELEMENT TreeElemChild(pTree tree, PELEMENT pElem, int slot) {
+	if (tree == NULL || pElem == NULL) return NULL;//input check
+	if (slot < 0 || slot >= tree->k) return NULL;
+	return pElem->children[slot];
+}
+
+pNode TreeElemNode(PELEMENT pElem) {
+	if (pElem == NULL) return NULL;
+	return pElem->obj;
+}
+
+int TreeElemChildrenCount(PELEMENT pElem) {
+	if (pElem == NULL) return -1;
+	return pElem->childrenCount;
+}
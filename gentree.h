@@ -1,11 +1,14 @@
 #ifndef TREE_H
 #define TREE_H
 
+#include <stddef.h>
 #include "defs.h"
 
 
 
 typedef void* pNode;
+//a borrowed, read only pointer to a node stored in the tree:
+typedef const void* pcNode;
 //the tree data structure:
 typedef struct _tree Tree, *pTree;
 //the basic element that comprises the tree:
@@ -44,9 +47,48 @@ Return value	: none
 ************************************************************************/
 typedef void (*DelFunction)(pNode e);
 
+/*************************************************************************
+Function name	: VisitFunction
+Description		: called by TreeVisitChildren for every child of a node
+Paramerters		: e - a borrowed pointer to the child node,
+				  ctx - the context given to TreeVisitChildren
+Return value	: none
+************************************************************************/
+typedef void (*VisitFunction)(pcNode e, void* ctx);
+
+/* how the tree allocates its elements */
+typedef enum {
+	TREE_ALLOC_HEAP,// every element, children array and node is malloc'ed
+	TREE_ALLOC_ARENA// elements are carved out of large slabs, see TreeParams
+} TreeAllocPolicy;
+
+/* optional settings for TreeCreateEx */
+typedef struct _tree_params {
+	Bool useIndex;// keep a key->element index so that every key based call
+				  // costs O(1) expected time. keys must then be unique.
+	TreeAllocPolicy allocPolicy;
+	size_t objSize;// with TREE_ALLOC_ARENA and objSize > 0, nodes have a fixed
+				   // size and are stored inside their element's chunk: they
+				   // are copied in with memcpy instead of cloneFunc, are not
+				   // passed to delFunc, and TreeDestroy frees whole slabs
+				   // without walking the tree.
+} TreeParams;
+
+/* counters of the work done by a tree, kept only when built with TREE_STATS */
+typedef struct _tree_stats {
+	unsigned long long lookups;// key lookups - TreeGetNode, TreeAddLeaf...
+	unsigned long long lookupVisits;// index slots probed, or elements visited
+									// with no index, by all the lookups
+	unsigned long long clones;// nodes copied into the tree
+	unsigned long long deletes;// nodes released from the tree
+	unsigned long long allocations;// calls to malloc/calloc by the tree itself
+	unsigned long long allocBytes;// bytes asked for by those calls
+} TreeStats;
+
 /*************************************************************************
 Function name	: TreeCreate
-Description		: creates an empty tree
+Description		: creates an empty tree, with the default settings of
+				  TreeCreateEx
 Paramerters		: pointer to the different functions to handle the
                  user-defined node
 Return value	: pTree - a pointer to the new tree
@@ -57,6 +99,23 @@ pTree TreeCreate(GetKeyFunction getKeyFunc,
 	DelFunction delFunc,
 	int k);
 
+/*************************************************************************
+Function name	: TreeCreateEx
+Description		: creates an empty tree with the given settings. a tree
+				  created without the index finds keys by searching the
+				  whole tree.
+Paramerters		: pointer to the different functions to handle the
+                 user-defined node, k - the max number of children,
+				  params - the settings, NULL for the defaults (indexed, heap)
+Return value	: pTree - a pointer to the new tree
+************************************************************************/
+pTree TreeCreateEx(GetKeyFunction getKeyFunc,
+	CloneFunction cloneFunc,
+	PrintFunction printFunc,
+	DelFunction delFunc,
+	int k,
+	const TreeParams* params);
+
 /*************************************************************************
 Function name	: TreeDestroy
 Description		: frees all memory allocations in the tree
@@ -73,6 +132,16 @@ Return value	: int - the amount of nodes
 ************************************************************************/
 int TreeNodesCount(pTree tree);
 
+/*************************************************************************
+Function name	: TreeGetStats
+Description		: returns the counters of a tree, since it was created
+Paramerters		: tree - a pointer to the tree,
+				  stats - updated with the counters
+Return value	: Result - SUCCESS, FAILURE if the tree was built without
+				  TREE_STATS
+************************************************************************/
+Result TreeGetStats(pTree tree, TreeStats* stats);
+
 /*************************************************************************
 Function name	: TreePrint
 Description		: prints every node in a tree in a pre-order manner using the 
@@ -161,4 +230,185 @@ Return value	: Result - SUCCESS if of goes well, FAILURE if key is not
 ************************************************************************/
 Result TreeDelLeaf(pTree tree, int key);
 
+/*************************************************************************
+Function name	: TreeDelSubtree
+Description		: deletes the node whose key is specified by 'key' and
+				  all the nodes below it, in one pass that needs no stack.
+				  with TREE_ALLOC_HEAP their memory is returned to the
+				  allocator, an arena keeps it for the next nodes.
+Paramerters		: tree - a pointer to the tree,
+				key - the key of the top node of the subtree.
+Return value	: int - the amount of nodes deleted, -1 if key is not found
+************************************************************************/
+int TreeDelSubtree(pTree tree, int key);
+
+/************************************************************************
+ borrowing accessors - these return pointers to the nodes stored in the
+ tree without cloning them. the pointers stay valid until the node is
+ deleted, and must not be freed or modified by the user.
+************************************************************************/
+
+/*************************************************************************
+Function name	: TreePeekRoot
+Description		: returns a borrowed pointer to the user-defined root node
+Paramerters		: tree - a pointer to the tree
+Return value	: pcNode - the root node, NULL if the tree is empty
+************************************************************************/
+pcNode TreePeekRoot(pTree tree);
+
+/*************************************************************************
+Function name	: TreePeekNode
+Description		: returns a borrowed pointer to the node whose key is 'key'
+Paramerters		: tree - a pointer to the tree,
+				  key  - the key of the desired node.
+Return value	: pcNode - the node, NULL if key is not found
+************************************************************************/
+pcNode TreePeekNode(pTree tree, int key);
+
+/*************************************************************************
+Function name	: TreePeekChild
+Description		: returns a borrowed pointer to the child in slot 'slot' of
+				  the node whose key is 'key'
+Paramerters		: tree - a pointer to the tree,
+				  key  - the key of the parent node,
+				  slot - the child slot, 0 to k-1
+Return value	: pcNode - the child, NULL if the slot is empty or key is
+				  not found
+************************************************************************/
+pcNode TreePeekChild(pTree tree, int key, int slot);
+
+/*************************************************************************
+Function name	: TreePeekChildren
+Description		: fills a caller-owned array of k slots with borrowed
+				  pointers to the children of the node whose key is 'key'.
+				  empty slots are set to NULL.
+Paramerters		: tree - a pointer to the tree,
+				  key  - the key of the parent node,
+				  childArr - an array of at least k pointers
+Return value	: Result - SUCCESS if all goes well, FAILURE if key is not found
+************************************************************************/
+Result TreePeekChildren(pTree tree, int key, pcNode* childArr);
+
+/*************************************************************************
+Function name	: TreeVisitChildren
+Description		: calls visitFunc on every child of the node whose key is
+				  'key', in slot order
+Paramerters		: tree - a pointer to the tree,
+				  key  - the key of the parent node,
+				  visitFunc - the function to call on each child,
+				  ctx - passed as is to visitFunc
+Return value	: int - the number of children visited, -1 if key is not found
+************************************************************************/
+int TreeVisitChildren(pTree tree, int key, VisitFunction visitFunc, void* ctx);
+
+/************************************************************************
+ element handles - walk and grow the tree through its elements directly,
+ with no key lookups. a PELEMENT stays valid until its node is deleted.
+************************************************************************/
+
+/*************************************************************************
+Function name	: TreeRootElem
+Description		: returns the root element of the tree
+Paramerters		: tree - a pointer to the tree
+Return value	: PELEMENT - the root, NULL if the tree is empty
+************************************************************************/
+PELEMENT TreeRootElem(pTree tree);
+
+/*************************************************************************
+Function name	: TreeElemChild
+Description		: returns the child in slot 'slot' of an element
+Paramerters		: tree - a pointer to the tree,
+				  pElem - the parent element,
+				  slot - the child slot, 0 to k-1
+Return value	: PELEMENT - the child, NULL if the slot is empty
+************************************************************************/
+PELEMENT TreeElemChild(pTree tree, PELEMENT pElem, int slot);
+
+/*************************************************************************
+Function name	: TreeElemNode
+Description		: returns the user-defined node stored in an element. the
+				  user may update the node in place, but not its key.
+Paramerters		: pElem - the element
+Return value	: pNode - the stored node
+************************************************************************/
+pNode TreeElemNode(PELEMENT pElem);
+
+/*************************************************************************
+Function name	: TreeElemChildrenCount
+Description		: returns the amount of children of an element
+Paramerters		: pElem - the element
+Return value	: int - the amount of children, -1 if pElem is NULL
+************************************************************************/
+int TreeElemChildrenCount(PELEMENT pElem);
+
+/*************************************************************************
+Function name	: TreeElemAddLeaf
+Description		: like TreeAddLeaf, adds a new clone of newNode in the
+				  first free slot of the element pParent
+Paramerters		: tree - a pointer to the tree,
+				  pParent - the parent element,
+				  newNode - the node to be added,
+				  slot - if not NULL, updated with the slot of the new leaf
+Return value	: PELEMENT - the new element, NULL if pParent has k
+				  children or on allocation failure
+************************************************************************/
+PELEMENT TreeElemAddLeaf(pTree tree, PELEMENT pParent, pNode newNode, int* slot);
+
+/************************************************************************
+ iterators - walk the whole tree with an explicit stack (or queue) of
+ elements instead of recursion, so a deep tree needs no deep call stack.
+ the stack grows by doubling, a step allocates nothing in the common case.
+************************************************************************/
+
+typedef enum {
+	TREE_ITER_PREORDER,// a node, then its children in slot order
+	TREE_ITER_POSTORDER,// the children in slot order, then their parent
+	TREE_ITER_LEVELORDER// level by level, slot order within a parent
+} TreeIterOrder;
+
+//the iterator, kept by the caller (usually on the stack). its fields are private:
+typedef struct _tree_iter {
+  pTree tree;
+  TreeIterOrder order;
+  PELEMENT* items;// the stack, or the ring buffer of the level-order queue
+  int* nextSlots;// postorder only - the next child slot of every stack item
+  size_t head;// level order only - the oldest queued item
+  size_t count;
+  size_t capacity;
+  Bool failed;
+} TreeIter, *pTreeIter;
+
+/*************************************************************************
+Function name	: TreeIterBegin
+Description		: starts an iteration over all the elements of a tree.
+				  the tree must not be changed while iterating, except that
+				  in postorder the element just returned (whose children
+				  were all returned before it) may be detached and freed.
+Paramerters		: tree - a pointer to the tree,
+				  iter - the iterator to start,
+				  order - the order of the walk
+Return value	: Result - SUCCESS, FAILURE on bad input or allocation
+				  failure. TreeIterEnd must be called either way.
+************************************************************************/
+Result TreeIterBegin(pTree tree, pTreeIter iter, TreeIterOrder order);
+
+/*************************************************************************
+Function name	: TreeIterNext
+Description		: returns the next element of the iteration
+Paramerters		: iter - the iterator
+Return value	: PELEMENT - the next element, NULL when the walk is over
+				  or could not go on (see TreeIterEnd)
+************************************************************************/
+PELEMENT TreeIterNext(pTreeIter iter);
+
+/*************************************************************************
+Function name	: TreeIterEnd
+Description		: frees the stack of an iterator, which may be stopped
+				  before the walk is over
+Paramerters		: iter - the iterator
+Return value	: Result - FAILURE if the walk stopped early on allocation
+				  failure, SUCCESS otherwise
+************************************************************************/
+Result TreeIterEnd(pTreeIter iter);
+
 #endif
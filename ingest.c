@@ -0,0 +1,233 @@
+#if !defined(_WIN32) && !defined(INGEST_NO_MMAP)
+#define _POSIX_C_SOURCE 200809L//fileno, mmap
+#define INGEST_MMAP
+#endif
+
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "defs.h"
+#include "ingest.h"
+
+#ifdef INGEST_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+//a decimal with at most this many digits fits in the 64 bit mantissa:
+#define MAX_FAST_DIGITS 19
+//integers up to 2^53 and powers of ten up to 10^22 are exact doubles:
+#define MAX_EXACT_MANTISSA (1ULL << 53)
+#define MAX_EXACT_POW10 22
+#define MAX_EXPONENT_DIGITS 5
+//longest number text handed to strtod, longer text is cut:
+#define MAX_NUMBER_TEXT 512
+
+/* definition of the reader - the unread input is [pos, end) */
+typedef struct _line_reader {
+  FILE* in;
+  size_t maxLine;
+  const char* pos;
+  const char* end;
+  char* block;// the read buffer, NULL if the input is mapped
+  Bool eof;
+#ifdef INGEST_MMAP
+  void* map;
+  size_t mapSize;
+#endif
+} LineReader, *pLineReader;
+
+static const double pow10Table[MAX_EXACT_POW10 + 1] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+///////////////////  internal static functions ///////////////////////////
+
+/*************************************************************************
+Function name	: MapInput
+Description		: maps the rest of the input, if it is a regular file
+Paramerters		: reader - the reader
+Return value	: Bool - TRUE if the input was mapped
+************************************************************************/
+static Bool MapInput(pLineReader reader);
+
+/*************************************************************************
+Function name	: FillBlock
+Description		: moves the unread input to the start of the block and
+				  reads after it until the block is full or the input ends
+Paramerters		: reader - a reader that is not mapped
+Return value	: none
+************************************************************************/
+static void FillBlock(pLineReader reader);
+
+/*************************************************************************
+Function name	: ParseWithStrtod
+Description		: copies the text to a null terminated buffer and
+				  converts it with strtod
+Paramerters		: str - the text, end - the end of the text
+Return value	: double - the number, 0.0 if there is none
+************************************************************************/
+static double ParseWithStrtod(const char* str, const char* end);
+
+/////////////////////////////////////////////////////////////////////////
+
+static Bool MapInput(pLineReader reader) {
+#ifdef INGEST_MMAP
+	int fd = fileno(reader->in);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) return FALSE;
+	off_t offset = lseek(fd, 0, SEEK_CUR);
+	if (offset < 0 || st.st_size <= offset) return FALSE;
+	void* map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED) return FALSE;
+	posix_madvise(map, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+	reader->map = map;
+	reader->mapSize = (size_t)st.st_size;
+	reader->pos = (const char*)map + offset;
+	reader->end = (const char*)map + st.st_size;
+	reader->eof = TRUE;//all of the input is in [pos, end)
+	return TRUE;
+#else
+	(void)reader;
+	return FALSE;
+#endif
+}
+
+static void FillBlock(pLineReader reader) {
+	size_t left = (size_t)(reader->end - reader->pos);
+	memmove(reader->block, reader->pos, left);
+	size_t got = fread(reader->block + left, 1, INGEST_BLOCK_SIZE - left, reader->in);
+	if (got < INGEST_BLOCK_SIZE - left) reader->eof = TRUE;
+	reader->pos = reader->block;
+	reader->end = reader->block + left + got;
+}
+
+pLineReader LineReaderOpen(FILE* in, size_t maxLine) {
+	if (in == NULL || maxLine == 0 || maxLine > INGEST_BLOCK_SIZE) return NULL;//input check
+	pLineReader reader = (pLineReader)malloc(sizeof(LineReader));
+	if (reader == NULL) return NULL;
+	reader->in = in;
+	reader->maxLine = maxLine;
+	reader->block = NULL;
+	reader->eof = FALSE;
+#ifdef INGEST_MMAP
+	reader->map = NULL;
+	reader->mapSize = 0;
+#endif
+	if (MapInput(reader)) return reader;
+	reader->block = (char*)malloc(INGEST_BLOCK_SIZE);
+	if (reader->block == NULL) {
+		free(reader);
+		return NULL;
+	}
+	reader->pos = reader->block;
+	reader->end = reader->block;
+	return reader;
+}
+
+void LineReaderClose(pLineReader reader) {
+	if (reader == NULL) return;
+#ifdef INGEST_MMAP
+	if (reader->map != NULL) munmap(reader->map, reader->mapSize);
+#endif
+	free(reader->block);
+	free(reader);
+}
+
+Bool LineReaderNext(pLineReader reader, const char** line, size_t* len) {
+	if (reader == NULL || line == NULL || len == NULL) return FALSE;//input check
+	if ((size_t)(reader->end - reader->pos) < reader->maxLine && !reader->eof) {
+		FillBlock(reader);
+	}
+	if (reader->pos == reader->end) return FALSE;
+	size_t left = (size_t)(reader->end - reader->pos);
+	size_t limit = (left < reader->maxLine) ? left : reader->maxLine;
+	const char* newline = (const char*)memchr(reader->pos, '\n', limit);
+	*line = reader->pos;
+	*len = (newline != NULL) ? (size_t)(newline - reader->pos) + 1 : limit;
+	reader->pos += *len;
+	return TRUE;
+}
+
+static double ParseWithStrtod(const char* str, const char* end) {
+	char text[MAX_NUMBER_TEXT];
+	size_t len = (size_t)(end - str);
+	if (len >= MAX_NUMBER_TEXT) len = MAX_NUMBER_TEXT - 1;
+	memcpy(text, str, len);
+	text[len] = '\0';
+	return strtod(text, NULL);
+}
+
+double ParseDouble(const char* str, const char* end) {
+	/*Clinger's fast path: a decimal whose digits fit in 53 bits, scaled by
+	  an exact power of ten, is rounded once - exactly as strtod rounds it.
+	  it needs double arithmetic without extra precision */
+#if FLT_EVAL_METHOD == 0
+	const char* p = str;
+	Bool negative = FALSE;
+	if (p < end && (*p == '-' || *p == '+')) negative = (*p++ == '-');
+	if (end - p >= 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {//hexadecimal
+		return ParseWithStrtod(str, end);
+	}
+	unsigned long long mantissa = 0;
+	int digits = 0, exponent = 0;
+	Bool anyDigit = FALSE;
+	while (p < end && *p >= '0' && *p <= '9') {
+		anyDigit = TRUE;
+		if (mantissa != 0 || *p != '0') {
+			mantissa = mantissa * 10 + (unsigned long long)(*p - '0');
+			digits++;
+		}
+		p++;
+	}
+	if (p < end && *p == '.') {
+		p++;
+		while (p < end && *p >= '0' && *p <= '9') {
+			anyDigit = TRUE;
+			if (mantissa != 0 || *p != '0') {
+				mantissa = mantissa * 10 + (unsigned long long)(*p - '0');
+				digits++;
+			}
+			exponent--;
+			p++;
+		}
+	}
+	if (anyDigit && digits <= MAX_FAST_DIGITS) {
+		if (p < end && (*p == 'e' || *p == 'E')) {
+			const char* q = p + 1;
+			Bool negativeExp = FALSE;
+			if (q < end && (*q == '-' || *q == '+')) negativeExp = (*q++ == '-');
+			if (q < end && *q >= '0' && *q <= '9') {//else the 'e' is not part of the number
+				int expValue = 0, expDigits = 0;
+				while (q < end && *q >= '0' && *q <= '9') {
+					if (expValue != 0 || *q != '0') expDigits++;
+					expValue = expValue * 10 + (*q - '0');
+					if (expDigits > MAX_EXPONENT_DIGITS) return ParseWithStrtod(str, end);
+					q++;
+				}
+				exponent += negativeExp ? -expValue : expValue;
+			}
+		}
+		if (mantissa <= MAX_EXACT_MANTISSA) {
+			double value = (double)mantissa;
+			if (mantissa == 0) {
+				return negative ? -0.0 : 0.0;
+			}
+			if (exponent >= 0 && exponent <= MAX_EXACT_POW10) {
+				value *= pow10Table[exponent];
+				return negative ? -value : value;
+			}
+			if (exponent < 0 && -exponent <= MAX_EXACT_POW10) {
+				value /= pow10Table[-exponent];
+				return negative ? -value : value;
+			}
+		}
+	}
+#endif
+	return ParseWithStrtod(str, end);
+}
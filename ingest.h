@@ -0,0 +1,60 @@
+#ifndef INGEST_H
+#define INGEST_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include "defs.h"
+
+/*
+** Command input reader.
+** a regular file is memory mapped (where mmap exists), any other input is
+** read in large blocks. lines are returned in place, without copying, and
+** split as fgets with a buffer of maxLine + 1 characters would split them.
+** ParseDouble parses a number in place, with the same result as atof.
+*/
+
+#define INGEST_BLOCK_SIZE (1 << 20)
+
+//the reader data structure:
+typedef struct _line_reader LineReader, *pLineReader;
+
+/*************************************************************************
+Function name	: LineReaderOpen
+Description		: creates a reader of a stream that nothing was read
+				  from yet
+Paramerters		: in - the stream, maxLine - the longest line returned,
+				  longer lines are returned in parts
+Return value	: pLineReader - the new reader, NULL on failure
+************************************************************************/
+pLineReader LineReaderOpen(FILE* in, size_t maxLine);
+
+/*************************************************************************
+Function name	: LineReaderClose
+Description		: frees the reader, the stream is not closed
+Paramerters		: reader - the reader
+Return value	: none
+************************************************************************/
+void LineReaderClose(pLineReader reader);
+
+/*************************************************************************
+Function name	: LineReaderNext
+Description		: returns the next line, including its '\n' if it has
+				  one. the line is valid until the next call.
+Paramerters		: reader - the reader, line - updated with the line,
+				  len - updated with its length
+Return value	: Bool - FALSE at the end of the input
+************************************************************************/
+Bool LineReaderNext(pLineReader reader, const char** line, size_t* len);
+
+/*************************************************************************
+Function name	: ParseDouble
+Description		: parses the number at the start of [str, end) as atof
+				  does. plain decimal numbers are converted directly when
+				  that is exact, any other text goes through strtod.
+Paramerters		: str - the text, end - the end of the text, which need
+				  not be null terminated
+Return value	: double - the number, 0.0 if there is none
+************************************************************************/
+double ParseDouble(const char* str, const char* end);
+
+#endif
@@ -0,0 +1,355 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "defs.h"
+#include "linpartition.h"
+
+#define NUM_CHILDREN 4
+//bits of a quadrant index, as in partition.c:
+#define QUAD_RIGHT 1
+#define QUAD_TOP 2
+#define ROOT_LOC 1ULL
+#define EMPTY_LOC 0ULL
+#define ROOT_KEY 0
+#define TABLE_INIT_CAPACITY 64
+#define LOC_HASH_MULT 0x9E3779B97F4A7C15ULL
+//max pending cells while printing or querying: 3 siblings per level plus the last children
+#define PRINT_STACK_SIZE (3 * LIN_MAX_LEVEL + NUM_CHILDREN + 1)
+
+typedef unsigned long long LOCCODE;
+
+/* definition of a cell - one slot of the open addressing cell table */
+typedef struct _lin_cell {
+  LOCCODE loc;// locational code of the cell, EMPTY_LOC marks an empty slot
+  int key;
+  unsigned char childMask;// bit q is set if quadrant q has a child
+  unsigned char childOrder;// quadrants of the children in insertion order, 2 bits each
+  unsigned char childCount;
+} LINCELL, *PLINCELL;
+
+/* definition of the square of a cell, derived while walking down */
+typedef struct _lin_square {
+  LOCCODE loc;
+  double x_left;
+  double x_right;
+  double y_bot;
+  double y_top;
+} LINSQUARE, *PLINSQUARE;
+
+/* definition of the partition */
+typedef struct _lin_partition {
+  PLINCELL cells;
+  int capacity;// always a power of 2
+  int cellCount;
+  int nextKey;
+} LinPartition, *pLinPartition;
+
+///////////////////  internal static functions ///////////////////////////
+
+/*************************************************************************
+Function name	: LocSlot
+Description		: returns the first probe position of a code in the table
+Paramerters		: part - the partition, loc - the locational code
+Return value	: int - a position in [0, capacity)
+************************************************************************/
+static int LocSlot(pLinPartition part, LOCCODE loc);
+
+/*************************************************************************
+Function name	: FindCell
+Description		: finds the cell whose locational code is 'loc'
+Paramerters		: part - the partition, loc - the locational code
+Return value	: PLINCELL - the cell, NULL if not found
+************************************************************************/
+static PLINCELL FindCell(pLinPartition part, LOCCODE loc);
+
+/*************************************************************************
+Function name	: InsertCell
+Description		: adds a childless cell to the table, growing it when it
+				  is 3/4 full. pointers to cells are invalidated.
+Paramerters		: part - the partition, loc - the locational code,
+				  key - the key of the new cell
+Return value	: Result - SUCCESS, FAILURE on allocation failure
+************************************************************************/
+static Result InsertCell(pLinPartition part, LOCCODE loc, int key);
+
+/*************************************************************************
+Function name	: GetQuadrant
+Description		: returns the quadrant of a square that holds x,y, using
+				  the split rule of the tree backend
+Paramerters		: sq - the square, x,y - the point
+Return value	: int - QUAD_RIGHT and QUAD_TOP bits
+************************************************************************/
+static int GetQuadrant(const LINSQUARE* sq, double x, double y);
+
+/*************************************************************************
+Function name	: GetChildSquare
+Description		: computes the square of the child in quadrant 'quad'
+Paramerters		: sq - the parent square, quad - the quadrant,
+				  child - updated with the child square and code
+Return value	: none
+************************************************************************/
+static void GetChildSquare(const LINSQUARE* sq, int quad, PLINSQUARE child);
+
+/*************************************************************************
+Function name	: SquareOverlaps
+Description		: checks if a square, holding [x_left, x_right) x
+				  [y_bot, y_top), has a point of a closed rectangle
+Paramerters		: sq - the square, rect - the rectangle
+Return value	: Bool - TRUE if it does
+************************************************************************/
+static Bool SquareOverlaps(const LINSQUARE* sq, const LINSQUARE* rect);
+
+/*************************************************************************
+Function name	: RectReachesEdge
+Description		: checks if a closed rectangle has a point on the top or
+				  right edge of the unit square - a point of the root
+Paramerters		: rect - the rectangle
+Return value	: Bool - TRUE if it does
+************************************************************************/
+static Bool RectReachesEdge(const LINSQUARE* rect);
+
+/*************************************************************************
+Function name	: PrintSquare
+Description		: prints the boundaries of a square
+Paramerters		: sq - the square, out - the writer to print to
+Return value	: none
+************************************************************************/
+static void PrintSquare(const LINSQUARE* sq, pOutBuffer out);
+
+/////////////////////////////////////////////////////////////////////////
+
+static int LocSlot(pLinPartition part, LOCCODE loc) {
+	return (int)((loc * LOC_HASH_MULT) >> 32) & (part->capacity - 1);
+}
+
+static PLINCELL FindCell(pLinPartition part, LOCCODE loc) {
+	int i = LocSlot(part, loc);
+	while (part->cells[i].loc != EMPTY_LOC) {
+		if (part->cells[i].loc == loc) return &part->cells[i];
+		i = (i + 1) & (part->capacity - 1);
+	}
+	return NULL;
+}
+
+static Result InsertCell(pLinPartition part, LOCCODE loc, int key) {
+	if (4 * (part->cellCount + 1) > 3 * part->capacity) {
+		// rehash all cells into a table twice as big:
+		PLINCELL oldCells = part->cells;
+		int oldCapacity = part->capacity;
+		PLINCELL newCells = (PLINCELL)calloc(2 * (size_t)oldCapacity, sizeof(LINCELL));
+		if (newCells == NULL) return FAILURE;
+		part->cells = newCells;
+		part->capacity = 2 * oldCapacity;
+		for (int i = 0; i < oldCapacity; i++) {
+			if (oldCells[i].loc == EMPTY_LOC) continue;
+			int j = LocSlot(part, oldCells[i].loc);
+			while (part->cells[j].loc != EMPTY_LOC) j = (j + 1) & (part->capacity - 1);
+			part->cells[j] = oldCells[i];
+		}
+		free(oldCells);
+	}
+	int i = LocSlot(part, loc);
+	while (part->cells[i].loc != EMPTY_LOC) i = (i + 1) & (part->capacity - 1);
+	part->cells[i].loc = loc;
+	part->cells[i].key = key;
+	part->cells[i].childMask = 0;
+	part->cells[i].childOrder = 0;
+	part->cells[i].childCount = 0;
+	part->cellCount++;
+	return SUCCESS;
+}
+
+static int GetQuadrant(const LINSQUARE* sq, double x, double y) {
+	double x_mid = sq->x_left + (sq->x_right - sq->x_left) / 2;
+	double y_mid = sq->y_bot + (sq->y_top - sq->y_bot) / 2;
+	int quad = 0;
+	if (!(x < x_mid)) quad |= QUAD_RIGHT;
+	if (!(y < y_mid)) quad |= QUAD_TOP;
+	return quad;
+}
+
+static void GetChildSquare(const LINSQUARE* sq, int quad, PLINSQUARE child) {
+	double x_mid = sq->x_left + (sq->x_right - sq->x_left) / 2;
+	double y_mid = sq->y_bot + (sq->y_top - sq->y_bot) / 2;
+	child->loc = (sq->loc << 2) | (LOCCODE)quad;
+	child->x_left = (quad & QUAD_RIGHT) ? x_mid : sq->x_left;
+	child->x_right = (quad & QUAD_RIGHT) ? sq->x_right : x_mid;
+	child->y_bot = (quad & QUAD_TOP) ? y_mid : sq->y_bot;
+	child->y_top = (quad & QUAD_TOP) ? sq->y_top : y_mid;
+}
+
+static Bool SquareOverlaps(const LINSQUARE* sq, const LINSQUARE* rect) {
+	return sq->x_left <= rect->x_right && rect->x_left < sq->x_right &&
+		sq->y_bot <= rect->y_top && rect->y_bot < sq->y_top;
+}
+
+static Bool RectReachesEdge(const LINSQUARE* rect) {
+	return rect->x_left <= 1.0 && rect->x_right >= 0.0 && rect->y_bot <= 1.0 && rect->y_top >= 0.0 &&
+		(rect->x_right >= 1.0 || rect->y_top >= 1.0);
+}
+
+static void PrintSquare(const LINSQUARE* sq, pOutBuffer out) {
+	OutBufferPutString(out, "([");
+	OutBufferPutDouble(out, sq->x_left);
+	OutBufferPutString(out, ", ");
+	OutBufferPutDouble(out, sq->x_right);
+	OutBufferPutString(out, "], [");
+	OutBufferPutDouble(out, sq->y_bot);
+	OutBufferPutString(out, ", ");
+	OutBufferPutDouble(out, sq->y_top);
+	OutBufferPutString(out, "])");
+}
+
+pLinPartition LinPartitionCreate() {
+	pLinPartition part = (pLinPartition)malloc(sizeof(LinPartition));
+	if (part == NULL) return NULL;
+	part->cells = (PLINCELL)calloc(TABLE_INIT_CAPACITY, sizeof(LINCELL));
+	if (part->cells == NULL) {
+		free(part);
+		return NULL;
+	}
+	part->capacity = TABLE_INIT_CAPACITY;
+	part->cellCount = 0;
+	part->nextKey = ROOT_KEY + 1;
+	InsertCell(part, ROOT_LOC, ROOT_KEY);
+	return part;
+}
+
+void LinPartitionDestroy(pLinPartition part) {
+	if (part == NULL) return;
+	free(part->cells);
+	free(part);
+}
+
+int LinPartitionCellsCount(pLinPartition part) {
+	if (part == NULL) return -1;
+	return part->cellCount;
+}
+
+Result LinPartitionRefine(pLinPartition part, double x, double y) {
+	if (part == NULL) return FAILURE;
+	int key = part->nextKey++;//a key is used up even when no cell is added, as in the tree backend
+	LINSQUARE sq = { ROOT_LOC, 0.0, 1.0, 0.0, 1.0 };
+	PLINCELL cell = FindCell(part, ROOT_LOC);
+	int level = 0;
+	int quad = GetQuadrant(&sq, x, y);
+	//a point on the top or right edge of the square is in no child, it refines the root:
+	if (x < 1.0 && y < 1.0) {
+		while (cell->childMask & (1 << quad)) {
+			GetChildSquare(&sq, quad, &sq);
+			cell = FindCell(part, sq.loc);
+			level++;
+			quad = GetQuadrant(&sq, x, y);
+		}
+	}
+	if ((cell->childMask & (1 << quad)) || level == LIN_MAX_LEVEL) return FAILURE;
+	LOCCODE parentLoc = sq.loc;
+	if (InsertCell(part, (parentLoc << 2) | (LOCCODE)quad, key) == FAILURE) return FAILURE;
+	cell = FindCell(part, parentLoc);//the table may have moved
+	cell->childMask |= (unsigned char)(1 << quad);
+	cell->childOrder |= (unsigned char)(quad << (2 * cell->childCount));
+	cell->childCount++;
+	return SUCCESS;
+}
+
+Result LinPartitionLocate(pLinPartition part, double x, double y, PartitionCell* cell) {
+	if (part == NULL || cell == NULL) return FAILURE;
+	LINSQUARE sq = { ROOT_LOC, 0.0, 1.0, 0.0, 1.0 };
+	PLINCELL lcell = FindCell(part, ROOT_LOC);
+	int level = 0;
+	if (x < 1.0 && y < 1.0) {//as in LinPartitionRefine
+		int quad;
+		while (lcell->childMask & (1 << (quad = GetQuadrant(&sq, x, y)))) {
+			GetChildSquare(&sq, quad, &sq);
+			lcell = FindCell(part, sq.loc);
+			level++;
+		}
+	}
+	cell->x_left = sq.x_left;
+	cell->x_right = sq.x_right;
+	cell->y_bot = sq.y_bot;
+	cell->y_top = sq.y_top;
+	cell->depth = level;
+	cell->key = lcell->key;
+	return SUCCESS;
+}
+
+void LinPartitionPrint(pLinPartition part, Bool withKeys, pOutBuffer out) {
+	if (part == NULL || out == NULL) return;
+	LINSQUARE stack[PRINT_STACK_SIZE];
+	int top = 0;
+	LINSQUARE root = { ROOT_LOC, 0.0, 1.0, 0.0, 1.0 };
+	stack[top++] = root;
+	//pre-order, children in insertion order - the order of the tree backend
+	while (top > 0) {
+		LINSQUARE sq = stack[--top];
+		PLINCELL cell = FindCell(part, sq.loc);
+		LINSQUARE children[NUM_CHILDREN];
+		if (withKeys) {
+			OutBufferPutInt(out, cell->key);
+			OutBufferPutString(out, ": ");
+		}
+		PrintSquare(&sq, out);
+		for (int i = 0; i < cell->childCount; i++) {
+			GetChildSquare(&sq, (cell->childOrder >> (2 * i)) & 3, &children[i]);
+			OutBufferPutChar(out, '\\');
+			PrintSquare(&children[i], out);
+		}
+		OutBufferPutChar(out, '\n');
+		for (int i = cell->childCount - 1; i >= 0; i--) {
+			stack[top++] = children[i];
+		}
+	}
+}
+
+size_t LinPartitionQueryRect(pLinPartition part, double x0, double x1, double y0, double y1,
+	PartitionCellFunction func, void* ctx) {
+	if (part == NULL || !(x0 <= x1 && y0 <= y1)) return 0;//an empty rectangle holds no point
+	LINSQUARE rect = { EMPTY_LOC, x0, x1, y0, y1 };
+	LINSQUARE root = { ROOT_LOC, 0.0, 1.0, 0.0, 1.0 };
+	LINSQUARE stack[PRINT_STACK_SIZE];
+	int levels[PRINT_STACK_SIZE];
+	int top = 0;
+	size_t found = 0;
+	if (!SquareOverlaps(&root, &rect) && !RectReachesEdge(&rect)) return 0;
+	stack[top] = root;
+	levels[top++] = 0;
+	//pre-order, children in quadrant order:
+	while (top > 0) {
+		LINSQUARE sq = stack[--top];
+		int level = levels[top];
+		PLINCELL cell = FindCell(part, sq.loc);
+		LINSQUARE children[NUM_CHILDREN];
+		//a cell holds its quadrants with no child, and the root the edges of the square:
+		Bool holds = (sq.loc == ROOT_LOC && RectReachesEdge(&rect));
+		for (int q = 0; q < NUM_CHILDREN; q++) {
+			GetChildSquare(&sq, q, &children[q]);
+			if (!SquareOverlaps(&children[q], &rect)) {
+				children[q].loc = EMPTY_LOC;
+			}
+			else if (!(cell->childMask & (1 << q))) {
+				holds = TRUE;
+				children[q].loc = EMPTY_LOC;
+			}
+		}
+		if (holds) {
+			found++;
+			if (func != NULL) {
+				PartitionCell pcell;
+				pcell.x_left = sq.x_left;
+				pcell.x_right = sq.x_right;
+				pcell.y_bot = sq.y_bot;
+				pcell.y_top = sq.y_top;
+				pcell.depth = level;
+				pcell.key = cell->key;
+				func(&pcell, ctx);
+			}
+		}
+		for (int q = NUM_CHILDREN - 1; q >= 0; q--) {
+			if (children[q].loc == EMPTY_LOC) continue;
+			stack[top] = children[q];
+			levels[top++] = level + 1;
+		}
+	}
+	return found;
+}
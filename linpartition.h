@@ -0,0 +1,96 @@
+#ifndef LINPARTITION_H
+#define LINPARTITION_H
+
+#include <stdio.h>
+#include "defs.h"
+#include "partition.h"
+#include "outbuffer.h"
+
+/*
+** Linear (pointerless) partition backend.
+** a cell is stored only as its level and the morton code of its path from
+** the root, packed into one locational code: a leading 1 bit followed by
+** 2 bits per level (QUAD_RIGHT | QUAD_TOP of the quadrant taken). cells
+** live in a hash table keyed by that code, so the parent, children and
+** boundaries of a cell are all found by code arithmetic.
+**
+** differences from the tree backend:
+**  - a partition is at most LIN_MAX_LEVEL levels deep, deeper refinements
+**    are ignored.
+**  - a point on the top or right edge of the square refines the root once
+**    per quadrant, instead of adding a duplicate child each time.
+*/
+
+#define LIN_MAX_LEVEL 31
+
+//the partition data structure:
+typedef struct _lin_partition LinPartition, *pLinPartition;
+
+/*************************************************************************
+Function name	: LinPartitionCreate
+Description		: creates a partition holding only the unit square
+Paramerters		: none
+Return value	: pLinPartition - the new partition, NULL on allocation failure
+************************************************************************/
+pLinPartition LinPartitionCreate();
+
+/*************************************************************************
+Function name	: LinPartitionDestroy
+Description		: frees all memory allocations of the partition
+Paramerters		: part - the partition
+Return value	: none
+************************************************************************/
+void LinPartitionDestroy(pLinPartition part);
+
+/*************************************************************************
+Function name	: LinPartitionRefine
+Description		: splits the smallest cell containing x,y, adding the
+				  quadrant that contains the point
+Paramerters		: part - the partition, x,y - the point
+Return value	: Result - SUCCESS if a cell was added, FAILURE otherwise
+************************************************************************/
+Result LinPartitionRefine(pLinPartition part, double x, double y);
+
+/*************************************************************************
+Function name	: LinPartitionLocate
+Description		: finds the smallest cell containing x,y - the one that
+				  LinPartitionRefine would split
+Paramerters		: part - the partition, x,y - the point,
+				  cell - updated with the cell
+Return value	: Result - SUCCESS, FAILURE if the partition is empty
+************************************************************************/
+Result LinPartitionLocate(pLinPartition part, double x, double y, PartitionCell* cell);
+
+/*************************************************************************
+Function name	: LinPartitionQueryRect
+Description		: reports the cells that hold a point of [x0, x1] x [y0, y1],
+				  as PartitionQueryRect does. cells keep no amount of cells
+				  below them, so counting walks the cells as well
+Paramerters		: part - the partition, x0, x1, y0, y1 - the rectangle,
+				  func - called with each cell, NULL to only count them,
+				  ctx - passed to func
+Return value	: size_t - the amount of cells
+************************************************************************/
+size_t LinPartitionQueryRect(pLinPartition part, double x0, double x1, double y0, double y1,
+	PartitionCellFunction func, void* ctx);
+
+/*************************************************************************
+Function name	: LinPartitionPrint
+Description		: prints every cell followed by its children, in the same
+				  order and format as the tree backend
+Paramerters		: part - the partition, withKeys - TRUE to start every
+				  line with the key of its cell, as delta prints do,
+				  out - the writer to print to
+Return value	: none
+************************************************************************/
+void LinPartitionPrint(pLinPartition part, Bool withKeys, pOutBuffer out);
+
+/*************************************************************************
+Function name	: LinPartitionCellsCount
+Description		: returns the amount of cells in the partition
+Paramerters		: part - the partition
+Return value	: int - the amount of cells
+************************************************************************/
+int LinPartitionCellsCount(pLinPartition part);
+
+#endif
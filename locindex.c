@@ -0,0 +1,220 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "defs.h"
+#include "locindex.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define LOC_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LOC_SSE2
+#endif
+
+#define NUM_CHILDREN 4
+//bits of a quadrant index, as in partition.c:
+#define QUAD_RIGHT 1
+#define QUAD_TOP 2
+#define INDEX_INIT_CAPACITY 64
+#define NODE_ALIGN 32
+//points descended together, to keep several cache misses in flight:
+#define FIND_GROUP 8
+//node fields in units of double and of int, for the gathers:
+#define NODE_DOUBLES ((int)(sizeof(LOCNODE) / sizeof(double)))
+#define NODE_INTS ((int)(sizeof(LOCNODE) / sizeof(int)))
+#define CHILD_INT_OFFSET ((int)(2 * sizeof(double) / sizeof(int)))
+
+/* definition of a node - all a descent step reads, in one 32 byte block
+   so a step costs at most one cache miss */
+typedef struct _loc_node {
+  double xMid;
+  double yMid;
+  int child[NUM_CHILDREN];// LOC_NO_NODE if none
+} LOCNODE, *PLOCNODE;
+
+/* definition of the index */
+typedef struct _loc_index {
+  PLOCNODE nodes;// aligned to NODE_ALIGN inside nodesBlock
+  void* nodesBlock;
+  int* depth;// per node, read only for the result
+  const void** data;
+  int nodeCount;
+  int capacity;
+} LocIndex, *pLocIndex;
+
+///////////////////  internal static functions ///////////////////////////
+
+/*************************************************************************
+Function name	: GrowIndex
+Description		: doubles the capacity of the index arrays
+Paramerters		: index - the index
+Return value	: Result - SUCCESS, FAILURE on allocation failure
+************************************************************************/
+static Result GrowIndex(pLocIndex index);
+
+/*************************************************************************
+Function name	: FindOne
+Description		: descends one point from the root
+Paramerters		: index - the index, x,y - the point
+Return value	: int - the deepest node containing the point
+************************************************************************/
+static int FindOne(pLocIndex index, double x, double y);
+
+/////////////////////////////////////////////////////////////////////////
+
+static Result GrowIndex(pLocIndex index) {
+	int newCapacity = (index->capacity == 0) ? INDEX_INIT_CAPACITY : 2 * index->capacity;
+	void* nodesBlock = malloc((size_t)newCapacity * sizeof(LOCNODE) + NODE_ALIGN);
+	if (nodesBlock == NULL) return FAILURE;
+	PLOCNODE nodes = (PLOCNODE)(((size_t)nodesBlock + NODE_ALIGN - 1) & ~(size_t)(NODE_ALIGN - 1));
+	if (index->nodeCount > 0) memcpy(nodes, index->nodes, index->nodeCount * sizeof(LOCNODE));
+	free(index->nodesBlock);
+	index->nodesBlock = nodesBlock;
+	index->nodes = nodes;
+	int* depth = (int*)realloc(index->depth, newCapacity * sizeof(int));
+	if (depth == NULL) return FAILURE;
+	index->depth = depth;
+	const void** data = (const void**)realloc((void*)index->data, newCapacity * sizeof(const void*));
+	if (data == NULL) return FAILURE;
+	index->data = data;
+	index->capacity = newCapacity;
+	return SUCCESS;
+}
+
+static int FindOne(pLocIndex index, double x, double y) {
+	int node = 0;
+	while (TRUE) {
+		const LOCNODE* pNode = &index->nodes[node];
+		int quad = 0;
+		if (!(x < pNode->xMid)) quad |= QUAD_RIGHT;
+		if (!(y < pNode->yMid)) quad |= QUAD_TOP;
+		int next = pNode->child[quad];
+		if (next == LOC_NO_NODE) return node;
+		node = next;
+	}
+}
+
+pLocIndex LocIndexCreate() {
+	pLocIndex index = (pLocIndex)calloc(1, sizeof(LocIndex));
+	return index;
+}
+
+void LocIndexDestroy(pLocIndex index) {
+	if (index == NULL) return;
+	free(index->nodesBlock);
+	free(index->depth);
+	free((void*)index->data);
+	free(index);
+}
+
+void LocIndexClear(pLocIndex index) {
+	if (index == NULL) return;
+	index->nodeCount = 0;
+}
+
+int LocIndexAddNode(pLocIndex index, int parent, int quad, double xMid, double yMid, const void* data) {
+	if (index == NULL) return LOC_NO_NODE;
+	if (index->nodeCount == index->capacity && GrowIndex(index) == FAILURE) return LOC_NO_NODE;
+	int node = index->nodeCount++;
+	index->nodes[node].xMid = xMid;
+	index->nodes[node].yMid = yMid;
+	for (int i = 0; i < NUM_CHILDREN; i++) {
+		index->nodes[node].child[i] = LOC_NO_NODE;
+	}
+	index->data[node] = data;
+	index->depth[node] = 0;
+	if (parent != LOC_NO_NODE) {
+		index->nodes[parent].child[quad] = node;
+		index->depth[node] = index->depth[parent] + 1;
+	}
+	return node;
+}
+
+void LocIndexFind(pLocIndex index, const double* xs, const double* ys, size_t n, int* nodes) {
+	if (index == NULL || index->nodeCount == 0) return;
+	size_t i = 0;
+#if defined(LOC_AVX2)
+	/* 2 groups of 4 points per step: gather the midpoints of their nodes,
+	   compare, and gather the children. a point whose child is missing
+	   keeps its node */
+	const double* base = (const double*)index->nodes;
+	const int* intBase = (const int*)index->nodes;
+	const __m256i pickLow = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+	const __m128i right = _mm_set1_epi32(QUAD_RIGHT);
+	const __m128i top = _mm_set1_epi32(QUAD_TOP);
+	const __m128i noNode = _mm_set1_epi32(LOC_NO_NODE);
+	const __m128i childOffset = _mm_set1_epi32(CHILD_INT_OFFSET);
+	for (; i + FIND_GROUP <= n; i += FIND_GROUP) {
+		__m256d x[2], y[2];
+		__m128i node[2];
+		int doneMask[2];
+		for (int g = 0; g < 2; g++) {
+			x[g] = _mm256_loadu_pd(xs + i + 4 * g);
+			y[g] = _mm256_loadu_pd(ys + i + 4 * g);
+			node[g] = _mm_setzero_si128();
+			doneMask[g] = 0;
+		}
+		while (doneMask[0] != 0xFFFF || doneMask[1] != 0xFFFF) {
+			for (int g = 0; g < 2; g++) {
+				__m128i first = _mm_mullo_epi32(node[g], _mm_set1_epi32(NODE_DOUBLES));
+				__m256d xMid = _mm256_i32gather_pd(base, first, sizeof(double));
+				__m256d yMid = _mm256_i32gather_pd(base + 1, first, sizeof(double));
+				//!(x < mid), true for NaN as in the scalar rule:
+				__m256i isRight = _mm256_castpd_si256(_mm256_cmp_pd(x[g], xMid, _CMP_NLT_UQ));
+				__m256i isTop = _mm256_castpd_si256(_mm256_cmp_pd(y[g], yMid, _CMP_NLT_UQ));
+				__m128i quad = _mm_or_si128(
+					_mm_and_si128(_mm256_castsi256_si128(_mm256_permutevar8x32_epi32(isRight, pickLow)), right),
+					_mm_and_si128(_mm256_castsi256_si128(_mm256_permutevar8x32_epi32(isTop, pickLow)), top));
+				__m128i slot = _mm_add_epi32(_mm_mullo_epi32(node[g], _mm_set1_epi32(NODE_INTS)),
+					_mm_add_epi32(childOffset, quad));
+				__m128i next = _mm_i32gather_epi32(intBase, slot, sizeof(int));
+				__m128i done = _mm_cmpeq_epi32(next, noNode);
+				doneMask[g] = _mm_movemask_epi8(done);
+				node[g] = _mm_blendv_epi8(next, node[g], done);
+			}
+		}
+		_mm_storeu_si128((__m128i*)(nodes + i), node[0]);
+		_mm_storeu_si128((__m128i*)(nodes + i + 4), node[1]);
+	}
+#elif defined(LOC_SSE2)
+	//4 pairs of points per step, the midpoint comparisons of a pair are vectorized:
+	for (; i + FIND_GROUP <= n; i += FIND_GROUP) {
+		int node[FIND_GROUP] = { 0 };
+		int active = (1 << FIND_GROUP) - 1;
+		while (active != 0) {
+			for (int p = 0; p < FIND_GROUP; p += 2) {
+				if (!(active & (3 << p))) continue;
+				const LOCNODE* pNode0 = &index->nodes[node[p]];
+				const LOCNODE* pNode1 = &index->nodes[node[p + 1]];
+				__m128d x = _mm_loadu_pd(xs + i + p);
+				__m128d y = _mm_loadu_pd(ys + i + p);
+				int isRight = _mm_movemask_pd(_mm_cmpnlt_pd(x, _mm_set_pd(pNode1->xMid, pNode0->xMid)));
+				int isTop = _mm_movemask_pd(_mm_cmpnlt_pd(y, _mm_set_pd(pNode1->yMid, pNode0->yMid)));
+				int next0 = pNode0->child[(isRight & 1) | ((isTop & 1) << 1)];
+				int next1 = pNode1->child[(isRight >> 1) | (isTop & 2)];
+				if (next0 == LOC_NO_NODE) active &= ~(1 << p);
+				else node[p] = next0;
+				if (next1 == LOC_NO_NODE) active &= ~(2 << p);
+				else node[p + 1] = next1;
+			}
+		}
+		for (int p = 0; p < FIND_GROUP; p++) {
+			nodes[i + p] = node[p];
+		}
+	}
+#endif
+	for (; i < n; i++) {
+		nodes[i] = FindOne(index, xs[i], ys[i]);
+	}
+}
+
+const void* LocIndexData(pLocIndex index, int node) {
+	if (index == NULL || node < 0 || node >= index->nodeCount) return NULL;
+	return index->data[node];
+}
+
+int LocIndexDepth(pLocIndex index, int node) {
+	if (index == NULL || node < 0 || node >= index->nodeCount) return -1;
+	return index->depth[node];
+}
@@ -0,0 +1,86 @@
+#ifndef LOCINDEX_H
+#define LOCINDEX_H
+
+#include <stddef.h>
+#include "defs.h"
+
+/*
+** Point location index.
+** a read-only copy of the descent structure of a quadtree, flattened into
+** arrays (midpoints, children, depth) in pre order, so that the nodes of a
+** subtree are close in memory. many points are descended at once: with
+** AVX2 4 points per step using gathers, with SSE2 2 points per step, and
+** one point at a time otherwise.
+** a point goes to quadrant QUAD_RIGHT if !(x < xMid) and to QUAD_TOP if
+** !(y < yMid), the split rule of the partition.
+*/
+
+#define LOC_NO_NODE (-1)
+
+//the index data structure:
+typedef struct _loc_index LocIndex, *pLocIndex;
+
+/*************************************************************************
+Function name	: LocIndexCreate
+Description		: creates an empty index
+Paramerters		: none
+Return value	: pLocIndex - the new index, NULL on allocation failure
+************************************************************************/
+pLocIndex LocIndexCreate();
+
+/*************************************************************************
+Function name	: LocIndexDestroy
+Description		: frees all memory allocations of the index
+Paramerters		: index - the index
+Return value	: none
+************************************************************************/
+void LocIndexDestroy(pLocIndex index);
+
+/*************************************************************************
+Function name	: LocIndexClear
+Description		: removes all nodes, keeping the memory for a rebuild
+Paramerters		: index - the index
+Return value	: none
+************************************************************************/
+void LocIndexClear(pLocIndex index);
+
+/*************************************************************************
+Function name	: LocIndexAddNode
+Description		: adds a node, with no children, as the child of 'parent'
+				  in quadrant 'quad'. the first node added is the root.
+Paramerters		: index - the index, parent - a node, LOC_NO_NODE for the
+				  root, quad - the quadrant in the parent,
+				  xMid,yMid - the split point of the node,
+				  data - returned by LocIndexData
+Return value	: int - the new node, LOC_NO_NODE on allocation failure
+************************************************************************/
+int LocIndexAddNode(pLocIndex index, int parent, int quad, double xMid, double yMid, const void* data);
+
+/*************************************************************************
+Function name	: LocIndexFind
+Description		: descends n points from the root down to the deepest
+				  node containing each of them
+Paramerters		: index - a non empty index, xs,ys - the points,
+				  n - the amount of points, nodes - updated with the node
+				  of every point
+Return value	: none
+************************************************************************/
+void LocIndexFind(pLocIndex index, const double* xs, const double* ys, size_t n, int* nodes);
+
+/*************************************************************************
+Function name	: LocIndexData
+Description		: returns the data of a node
+Paramerters		: index - the index, node - the node
+Return value	: const void* - the data given to LocIndexAddNode
+************************************************************************/
+const void* LocIndexData(pLocIndex index, int node);
+
+/*************************************************************************
+Function name	: LocIndexDepth
+Description		: returns the depth of a node, 0 for the root
+Paramerters		: index - the index, node - the node
+Return value	: int - the depth
+************************************************************************/
+int LocIndexDepth(pLocIndex index, int node);
+
+#endif
@@ -3,40 +3,587 @@
 #endif // !_CRT_SECURE_NO_WARNINGS
 
 #include "partition.h"
+#include "ingest.h"
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#if !defined(_WIN32)
+#define SNAPSHOT_THREADS
+#include <pthread.h>
+#endif
 
 #define MAX_LINE_SIZE 255
+#define BATCH_CHUNK_SIZE 4096
+#define NUM_SIDES 4
 
-int main()
+//names of the sides of a cell, in PartitionSide order:
+static const char* sideNames[NUM_SIDES] = { "LEFT", "RIGHT", "BOTTOM", "TOP" };
+
+//points read and not refined yet:
+static double pendingXs[BATCH_CHUNK_SIZE], pendingYs[BATCH_CHUNK_SIZE];
+static size_t pendingCount = 0;
+
+/* definition of the print of a PRINT_SNAPSHOT command */
+typedef struct _snapshot_print {
+  pPartitionVersion version;
+  FILE* out;
+} SnapshotPrint;
+
+//the last PRINT_SNAPSHOT, printed by snapshotThread while the commands go on:
+static SnapshotPrint snapshotPrint;
+#ifdef SNAPSHOT_THREADS
+static pthread_t snapshotThread;
+static Bool snapshotRunning = FALSE;
+#endif
+
+/*************************************************************************
+Function name	: QueuePoint
+Description		: adds a point to refine, refining the queued points
+				  when the queue is full
+Paramerters		: x, y - the point
+Return value	: none
+************************************************************************/
+static void QueuePoint(double x, double y)
+{
+  pendingXs[pendingCount] = x;
+  pendingYs[pendingCount] = y;
+  if (++pendingCount == BATCH_CHUNK_SIZE) {
+	RefineCellBatch(pendingXs, pendingYs, pendingCount);
+	pendingCount = 0;
+  }
+}
+
+/*************************************************************************
+Function name	: FlushPoints
+Description		: refines the queued points
+Paramerters		: none
+Return value	: none
+************************************************************************/
+static void FlushPoints()
+{
+  RefineCellBatch(pendingXs, pendingYs, pendingCount);
+  pendingCount = 0;
+}
+
+/*************************************************************************
+Function name	: AddBatch
+Description		: reads the 'count' lines of an ADD_BATCH command, each
+				  holding "x y", and refines their cells in batches
+Paramerters		: count - the number of points
+Return value	: none
+************************************************************************/
+static void AddBatch(long count)
+{
+  char szLine[MAX_LINE_SIZE];
+  char* delimiters = " \t\n";
+  char* x_str, *y_str;
+  while (count > 0 && fgets(szLine, MAX_LINE_SIZE, stdin) != NULL) {
+	count--;
+	x_str = strtok(szLine, delimiters);
+	y_str = (x_str != NULL) ? strtok(NULL, delimiters) : NULL;
+	if (y_str == NULL) continue;
+	QueuePoint(atof(x_str), atof(y_str));
+  }
+  FlushPoints();
+}
+
+/*************************************************************************
+Function name	: PrintLocatedCell
+Description		: prints the answer of a LOCATE command
+Paramerters		: x, y - the point to locate
+Return value	: none
+************************************************************************/
+static void PrintLocatedCell(double x, double y)
+{
+  PartitionCell cell;
+  if (LocateCell(x, y, &cell) == SUCCESS) {
+	printf("Located cell: ([%f, %f], [%f, %f]) depth %d key %d\n",
+		cell.x_left, cell.x_right, cell.y_bot, cell.y_top, cell.depth, cell.key);
+  }
+  else {
+	printf("Located cell: none\n");
+  }
+}
+
+/*************************************************************************
+Function name	: PrintQueriedCell
+Description		: prints a cell found by a QUERY_RECT command
+Paramerters		: cell - the cell, ctx - unused
+Return value	: none
+************************************************************************/
+static void PrintQueriedCell(const PartitionCell* cell, void* ctx)
+{
+  (void)ctx;
+  printf("([%f, %f], [%f, %f]) depth %d key %d\n",
+	cell->x_left, cell->x_right, cell->y_bot, cell->y_top, cell->depth, cell->key);
+}
+
+/*************************************************************************
+Function name	: QueryRectCommand
+Description		: runs a QUERY_RECT command - prints the cells that hold a
+				  point of a rectangle, followed by their amount
+Paramerters		: bounds - x0, x1, y0, y1 of the rectangle
+				  countOnly - TRUE to print the amount only
+Return value	: none
+************************************************************************/
+static void QueryRectCommand(const double* bounds, Bool countOnly)
+{
+  if (!countOnly) printf("Cells in rectangle:\n");
+  size_t count = QueryCells(bounds[0], bounds[1], bounds[2], bounds[3],
+	countOnly ? NULL : PrintQueriedCell, NULL);
+  printf("Cells in rectangle: %lu\n", (unsigned long)count);
+}
+
+/*************************************************************************
+Function name	: NeighborsCommand
+Description		: runs a NEIGHBORS command - prints the cells next to the
+				  cell of a key on one side, followed by their amount
+Paramerters		: key - the key of the cell, side, sideLen - the name of
+				  the side, not null terminated
+Return value	: none
+************************************************************************/
+static void NeighborsCommand(int key, const char* side, size_t sideLen)
+{
+  for (int i = 0; i < NUM_SIDES; i++) {
+	size_t len = strlen(sideNames[i]);
+	if (sideLen < len || strncmp(side, sideNames[i], len)) continue;
+	printf("Neighbor cells:\n");
+	size_t count = NeighborCells(key, (PartitionSide)i, PrintQueriedCell, NULL);
+	printf("Neighbor cells: %lu\n", (unsigned long)count);
+	return;
+  }
+}
+
+/*************************************************************************
+Function name	: PrintAdjacentPair
+Description		: prints a pair found by an ADJACENCY command, as
+				  "key side key"
+Paramerters		: a, b - the cells, b on 'side' of a, ctx - unused
+Return value	: none
+************************************************************************/
+static void PrintAdjacentPair(const PartitionCell* a, const PartitionCell* b, PartitionSide side, void* ctx)
+{
+  (void)ctx;
+  printf("%d %s %d\n", a->key, sideNames[side], b->key);
+}
+
+/*************************************************************************
+Function name	: AdjacencyCommand
+Description		: runs an ADJACENCY command - prints every pair of
+				  adjacent cells, followed by their amount
+Paramerters		: countOnly - TRUE to print the amount only
+Return value	: none
+************************************************************************/
+static void AdjacencyCommand(Bool countOnly)
+{
+  if (!countOnly) printf("Adjacent cells:\n");
+  size_t count = AdjacentCells(countOnly ? NULL : PrintAdjacentPair, NULL);
+  printf("Adjacent cells: %lu\n", (unsigned long)count);
+}
+
+/*************************************************************************
+Function name	: SaveLoadCommand
+Description		: runs a SAVE_PARTITION or LOAD_PARTITION command, and
+				  reports a failure on stderr
+Paramerters		: isSave - TRUE to save, FALSE to load
+				  path - the file, may end with the '\r' of a CRLF line
+Return value	: none
+************************************************************************/
+static void SaveLoadCommand(Bool isSave, char* path)
+{
+  size_t len = strlen(path);
+  if (len > 0 && path[len - 1] == '\r') path[--len] = '\0';
+  if (len == 0) return;
+  if (isSave && SavePartition(path) == FAILURE) {
+	fprintf(stderr, "failed to save the partition to %s\n", path);
+  }
+  else if (!isSave && LoadPartition(path) == FAILURE) {
+	fprintf(stderr, "failed to load a partition from %s\n", path);
+  }
+}
+
+/*************************************************************************
+Function name	: RunSnapshotPrint
+Description		: prints a version to its file, then closes the file and
+				  releases the version
+Paramerters		: arg - the SnapshotPrint
+Return value	: void* - NULL
+************************************************************************/
+static void* RunSnapshotPrint(void* arg)
+{
+  SnapshotPrint* print = (SnapshotPrint*)arg;
+  PartitionVersionPrint(print->version, print->out);
+  fclose(print->out);
+  PartitionVersionRelease(print->version);
+  return NULL;
+}
+
+/*************************************************************************
+Function name	: WaitSnapshotPrint
+Description		: waits for the print of the last PRINT_SNAPSHOT to end
+Paramerters		: none
+Return value	: none
+************************************************************************/
+static void WaitSnapshotPrint()
+{
+#ifdef SNAPSHOT_THREADS
+  if (snapshotRunning) pthread_join(snapshotThread, NULL);
+  snapshotRunning = FALSE;
+#endif
+}
+
+/*************************************************************************
+Function name	: SnapshotCommand
+Description		: runs a PRINT_SNAPSHOT command - takes a version of the
+				  partition and prints it to a file in the background,
+				  so that the next commands run meanwhile
+Paramerters		: path - the file, may end with the '\r' of a CRLF line
+Return value	: none
+************************************************************************/
+static void SnapshotCommand(char* path)
+{
+  size_t len = strlen(path);
+  if (len > 0 && path[len - 1] == '\r') path[--len] = '\0';
+  if (len == 0) return;
+  WaitSnapshotPrint();//one print at a time
+  snapshotPrint.version = SnapshotPartition();
+  if (snapshotPrint.version == NULL) {
+	fprintf(stderr, "failed to take a snapshot of the partition\n");
+	return;
+  }
+  snapshotPrint.out = fopen(path, "w");
+  if (snapshotPrint.out == NULL) {
+	fprintf(stderr, "failed to open %s\n", path);
+	PartitionVersionRelease(snapshotPrint.version);
+	return;
+  }
+#ifdef SNAPSHOT_THREADS
+  if (pthread_create(&snapshotThread, NULL, RunSnapshotPrint, &snapshotPrint) == 0) {
+	snapshotRunning = TRUE;
+	return;
+  }
+#endif
+  RunSnapshotPrint(&snapshotPrint);//no thread - printed at once
+}
+
+/*************************************************************************
+Function name	: PrintStats
+Description		: runs a STATS command - prints the counters of the
+				  partition on stderr, so that stdout is left as is
+Paramerters		: none
+Return value	: none
+************************************************************************/
+static void PrintStats()
+{
+  PartitionStats stats;
+  if (GetPartitionStats(&stats) == FAILURE) {
+	fprintf(stderr, "STATS: not available, build with -DTREE_STATS\n");
+	return;
+  }
+  fprintf(stderr, "STATS\n");
+  fprintf(stderr, "  lookups: %llu, visits per lookup: %.2f\n", stats.lookups,
+	(stats.lookups > 0) ? (double)stats.lookupVisits / (double)stats.lookups : 0.0);
+  fprintf(stderr, "  clones: %llu, deletes: %llu\n", stats.clones, stats.deletes);
+  fprintf(stderr, "  allocations: %llu, bytes: %llu\n", stats.allocations, stats.allocBytes);
+  fprintf(stderr, "  cells: %llu, max depth: %d, average depth: %.2f\n",
+	stats.cells, stats.maxDepth, stats.avgDepth);
+  fprintf(stderr, "  refines: %llu in %.6f s, prints: %llu in %.6f s\n",
+	stats.refines, stats.refineSeconds, stats.prints, stats.printSeconds);
+}
+
+/*************************************************************************
+Function name	: NextToken
+Description		: finds the next token of a line that is not null
+				  terminated, as strtok with " \t\n" would
+Paramerters		: pos - the rest of the line, updated to after the token
+				  end - the end of the line
+				  tokenEnd - updated with the end of the token
+Return value	: const char* - the token, NULL if there is none
+************************************************************************/
+static const char* NextToken(const char** pos, const char* end, const char** tokenEnd)
+{
+  const char* p = *pos;
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\n')) p++;
+  if (p == end) return NULL;
+  const char* token = p;
+  while (p < end && *p != ' ' && *p != '\t' && *p != '\n') p++;
+  *tokenEnd = p;
+  *pos = p;
+  return token;
+}
+
+/*************************************************************************
+Function name	: TokenStartsWith
+Description		: checks if a token starts with a prefix, as strncmp does
+Paramerters		: token, tokenEnd - the token, prefix - the prefix
+Return value	: Bool - TRUE if it does
+************************************************************************/
+static Bool TokenStartsWith(const char* token, const char* tokenEnd, const char* prefix)
+{
+  size_t len = strlen(prefix);
+  return (size_t)(tokenEnd - token) >= len && !memcmp(token, prefix, len);
+}
+
+/*************************************************************************
+Function name	: RunFastInput
+Description		: runs the commands of stdin as the main loop does, but
+				  reads the input in place through a LineReader, parses
+				  numbers with ParseDouble and refines the points of
+				  consecutive ADD commands in batches
+Paramerters		: params - the settings of INIT_PARTITION
+Return value	: Result - FAILURE if the input could not be opened, before
+				  anything was read
+************************************************************************/
+static Result RunFastInput(const PartitionParams* params)
+{
+  pLineReader reader = LineReaderOpen(stdin, MAX_LINE_SIZE - 1);
+  const char* line, *pos, *end, *token, *tokenEnd, *y_token, *y_tokenEnd;
+  size_t len;
+  if (reader == NULL) return FAILURE;
+  while (LineReaderNext(reader, &line, &len)) {
+	end = line + len;
+	//like fgets and feof, a last line with no '\n' is not run:
+	if (len < MAX_LINE_SIZE - 1 && line[len - 1] != '\n') break;
+	pos = line;
+	token = NextToken(&pos, end, &tokenEnd);
+	if (token == NULL) continue;
+	if (TokenStartsWith(token, tokenEnd, "ADD_BATCH")) {
+		char count_str[MAX_LINE_SIZE];
+		token = NextToken(&pos, end, &tokenEnd);
+		if (token == NULL) continue;
+		memcpy(count_str, token, tokenEnd - token);
+		count_str[tokenEnd - token] = '\0';
+		for (long count = atol(count_str); count > 0 && LineReaderNext(reader, &line, &len); count--) {
+			pos = line;
+			end = line + len;
+			token = NextToken(&pos, end, &tokenEnd);
+			y_token = (token != NULL) ? NextToken(&pos, end, &y_tokenEnd) : NULL;
+			if (y_token == NULL) continue;
+			QueuePoint(ParseDouble(token, tokenEnd), ParseDouble(y_token, y_tokenEnd));
+		}
+	}
+	else if (TokenStartsWith(token, tokenEnd, "ADD")) {
+		token = NextToken(&pos, end, &tokenEnd);
+		y_token = (token != NULL) ? NextToken(&pos, end, &y_tokenEnd) : NULL;
+		if (y_token == NULL) continue;
+		QueuePoint(ParseDouble(token, tokenEnd), ParseDouble(y_token, y_tokenEnd));
+	}
+	else if (TokenStartsWith(token, tokenEnd, "LOCATE")) {
+		FlushPoints();
+		token = NextToken(&pos, end, &tokenEnd);
+		y_token = (token != NULL) ? NextToken(&pos, end, &y_tokenEnd) : NULL;
+		PrintLocatedCell((token != NULL) ? ParseDouble(token, tokenEnd) : -1,
+			(y_token != NULL) ? ParseDouble(y_token, y_tokenEnd) : -1);
+	}
+	else if (TokenStartsWith(token, tokenEnd, "COARSEN")) {
+		FlushPoints();
+		token = NextToken(&pos, end, &tokenEnd);
+		y_token = (token != NULL) ? NextToken(&pos, end, &y_tokenEnd) : NULL;
+		const char* depthEnd;
+		const char* depth_token = (y_token != NULL) ? NextToken(&pos, end, &depthEnd) : NULL;
+		if (depth_token == NULL) continue;
+		CoarsenCell(ParseDouble(token, tokenEnd), ParseDouble(y_token, y_tokenEnd),
+			(int)ParseDouble(depth_token, depthEnd));
+	}
+	else if (TokenStartsWith(token, tokenEnd, "NEIGHBORS")) {
+		FlushPoints();
+		token = NextToken(&pos, end, &tokenEnd);
+		y_token = (token != NULL) ? NextToken(&pos, end, &y_tokenEnd) : NULL;
+		if (y_token == NULL) continue;
+		NeighborsCommand((int)ParseDouble(token, tokenEnd), y_token, y_tokenEnd - y_token);
+	}
+	else if (TokenStartsWith(token, tokenEnd, "ADJACENCY")) {
+		FlushPoints();
+		token = NextToken(&pos, end, &tokenEnd);
+		AdjacencyCommand(token != NULL && TokenStartsWith(token, tokenEnd, "COUNT"));
+	}
+	else if (TokenStartsWith(token, tokenEnd, "BALANCE")) {
+		FlushPoints();
+		BalancePartition();
+	}
+	else if (TokenStartsWith(token, tokenEnd, "OPTIMIZE_LAYOUT")) {
+		FlushPoints();
+		OptimizePartitionLayout();
+	}
+	else if (TokenStartsWith(token, tokenEnd, "QUERY_RECT")) {
+		double bounds[4];
+		int i;
+		FlushPoints();
+		for (i = 0; i < 4 && (token = NextToken(&pos, end, &tokenEnd)) != NULL; i++) {
+			bounds[i] = ParseDouble(token, tokenEnd);
+		}
+		if (i < 4) continue;
+		token = NextToken(&pos, end, &tokenEnd);
+		QueryRectCommand(bounds, token != NULL && TokenStartsWith(token, tokenEnd, "COUNT"));
+	}
+	else if (TokenStartsWith(token, tokenEnd, "PRINT_PARTITION_DELTA")) {
+		FlushPoints();
+		printf("Partition changes:\n");
+		PrintPartitionDelta();
+	}
+	else if (TokenStartsWith(token, tokenEnd, "PRINT_PARTITION")) {
+		FlushPoints();
+		printf("Current partition:\n");
+		PrintPartition();
+	}
+	else if (TokenStartsWith(token, tokenEnd, "STATS")) {
+		FlushPoints();
+		fflush(stdout);
+		PrintStats();
+	}
+	else if (TokenStartsWith(token, tokenEnd, "INIT_PARTITION")) {
+		pendingCount = 0;//the queued points would be discarded with the partition
+		InitPartitionEx(params);
+	}
+	else if (TokenStartsWith(token, tokenEnd, "SAVE_PARTITION") ||
+		TokenStartsWith(token, tokenEnd, "LOAD_PARTITION")) {
+		char path[MAX_LINE_SIZE];
+		Bool isSave = (*token == 'S');
+		token = NextToken(&pos, end, &tokenEnd);
+		if (token == NULL) continue;
+		memcpy(path, token, tokenEnd - token);
+		path[tokenEnd - token] = '\0';
+		FlushPoints();//a load that fails keeps the partition, with the points
+		SaveLoadCommand(isSave, path);
+	}
+	else if (TokenStartsWith(token, tokenEnd, "PRINT_SNAPSHOT")) {
+		char path[MAX_LINE_SIZE];
+		token = NextToken(&pos, end, &tokenEnd);
+		if (token == NULL) continue;
+		memcpy(path, token, tokenEnd - token);
+		path[tokenEnd - token] = '\0';
+		FlushPoints();
+		SnapshotCommand(path);
+	}
+  }
+  FlushPoints();
+  LineReaderClose(reader);
+  return SUCCESS;
+}
+
+int main(int argc, char* argv[])
 {
   char szLine[MAX_LINE_SIZE];
   char* delimiters = " \t\n";
   char* command;
   char* x_str, *y_str;
   double x, y;
-  InitPartition();
+  PartitionParams params;
+  Bool fastInput = FALSE;
+  params.backend = PARTITION_BACKEND_TREE;
+  params.numThreads = 1;
+  params.bucketCapacity = 0;
+  params.maxDepth = 0;
+  params.autoLayout = FALSE;
+  params.balanced = FALSE;
+  for (int i = 1; i < argc; i++) {
+	if (!strcmp(argv[i], "--linear")) {// compact backend for very large partitions
+		params.backend = PARTITION_BACKEND_LINEAR;
+	}
+	else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {// workers for ADD_BATCH
+		params.numThreads = atoi(argv[++i]);
+	}
+	else if (!strcmp(argv[i], "--bucket") && i + 1 < argc) {// points per leaf before it is split
+		params.bucketCapacity = atoi(argv[++i]);
+	}
+	else if (!strcmp(argv[i], "--max-depth") && i + 1 < argc) {// no cells below this depth
+		params.maxDepth = atoi(argv[++i]);
+	}
+	else if (!strcmp(argv[i], "--auto-layout")) {// lays the cells out again as ADD_BATCH grows the partition
+		params.autoLayout = TRUE;
+	}
+	else if (!strcmp(argv[i], "--balanced")) {// keeps the partition 2:1 balanced as it is refined
+		params.balanced = TRUE;
+	}
+	else if (!strcmp(argv[i], "--fast-input")) {// in place parsing, for very long inputs
+		fastInput = TRUE;
+	}
+  }
+  InitPartitionEx(&params);
+  if (fastInput && RunFastInput(&params) == SUCCESS) {
+	WaitSnapshotPrint();
+	DeletePartition();
+	return 0;
+  }
   fgets(szLine,MAX_LINE_SIZE,stdin);
   while (!feof(stdin)) {
 	command = strtok(szLine, delimiters);
-	if (!strncmp(command, "ADD", 3)) {
+	if (!strncmp(command, "ADD_BATCH", 9)) {// ADD_BATCH n, followed by n lines of "x y"
+		char* count_str = strtok(NULL, delimiters);
+		if (count_str != NULL) AddBatch(atol(count_str));
+	}
+	else if (!strncmp(command, "ADD", 3)) {
 		x_str = strtok(NULL, delimiters);
 		y_str = strtok(NULL, delimiters);
 		x = atof(x_str);
 		y = atof(y_str);
 		RefineCell(x, y);
 	}
+	else if (!strncmp(command, "LOCATE", 6)) {// LOCATE x y - prints the cell containing x,y
+		x_str = strtok(NULL, delimiters);
+		y_str = strtok(NULL, delimiters);
+		x = (x_str != NULL) ? atof(x_str) : -1;
+		y = (y_str != NULL) ? atof(y_str) : -1;
+		PrintLocatedCell(x, y);
+	}
+	else if (!strncmp(command, "COARSEN", 7)) {// COARSEN x y depth - removes the cells below the cell of x,y at that depth
+		x_str = strtok(NULL, delimiters);
+		y_str = (x_str != NULL) ? strtok(NULL, delimiters) : NULL;
+		char* depth_str = (y_str != NULL) ? strtok(NULL, delimiters) : NULL;
+		if (depth_str != NULL) CoarsenCell(atof(x_str), atof(y_str), atoi(depth_str));
+	}
+	else if (!strncmp(command, "NEIGHBORS", 9)) {// NEIGHBORS key LEFT|RIGHT|BOTTOM|TOP - the cells next to a cell
+		char* key_str = strtok(NULL, delimiters);
+		char* side_str = (key_str != NULL) ? strtok(NULL, delimiters) : NULL;
+		if (side_str != NULL) NeighborsCommand(atoi(key_str), side_str, strlen(side_str));
+	}
+	else if (!strncmp(command, "ADJACENCY", 9)) {// ADJACENCY [COUNT] - every pair of adjacent cells
+		char* token = strtok(NULL, delimiters);
+		AdjacencyCommand(token != NULL && !strncmp(token, "COUNT", 5));
+	}
+	else if (!strncmp(command, "BALANCE", 7)) {// splits cells until neighbors differ by one level at most
+		BalancePartition();
+	}
+	else if (!strncmp(command, "OPTIMIZE_LAYOUT", 15)) {// lays the cells out in memory in pre order
+		OptimizePartitionLayout();
+	}
+	else if (!strncmp(command, "QUERY_RECT", 10)) {// QUERY_RECT x0 x1 y0 y1 [COUNT] - the cells in the rectangle
+		double bounds[4];
+		char* token = NULL;
+		int i;
+		for (i = 0; i < 4 && (token = strtok(NULL, delimiters)) != NULL; i++) {
+			bounds[i] = atof(token);
+		}
+		token = (i == 4) ? strtok(NULL, delimiters) : NULL;
+		if (i == 4) QueryRectCommand(bounds, token != NULL && !strncmp(token, "COUNT", 5));
+	}
+	else if (!strncmp(command, "PRINT_PARTITION_DELTA", 21)) {// the lines changed since the last print
+		printf("Partition changes:\n");
+		PrintPartitionDelta();
+	}
 	else if (!strncmp(command, "PRINT_PARTITION", 15)) {
 		printf("Current partition:\n");
 		PrintPartition();
 	}
+	else if (!strncmp(command, "STATS", 5)) {// counters of the partition, on stderr
+		fflush(stdout);
+		PrintStats();
+	}
 	else if (!strncmp(command, "INIT_PARTITION", 14)) {
-		InitPartition();
+		InitPartitionEx(&params);
+	}
+	else if (!strncmp(command, "SAVE_PARTITION", 14) || !strncmp(command, "LOAD_PARTITION", 14)) {
+		char* path = strtok(NULL, delimiters);
+		if (path != NULL) SaveLoadCommand(command[0] == 'S', path);
+	}
+	else if (!strncmp(command, "PRINT_SNAPSHOT", 14)) {// PRINT_SNAPSHOT path - prints the partition as it is to a file, in the background
+		char* path = strtok(NULL, delimiters);
+		if (path != NULL) SnapshotCommand(path);
 	}
 	fgets(szLine,MAX_LINE_SIZE,stdin);
   }
   
+  WaitSnapshotPrint();
   DeletePartition();
   return 0;
 }
@@ -0,0 +1,209 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L//fileno, write
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "defs.h"
+#include "outbuffer.h"
+
+#ifdef _WIN32
+#include <io.h>
+#define WRITE_FD(fd, data, size) _write((fd), (data), (unsigned int)(size))
+#define FILE_FD(out) _fileno(out)
+#else
+#include <errno.h>
+#include <unistd.h>
+#define WRITE_FD(fd, data, size) write((fd), (data), (size))
+#define FILE_FD(out) fileno(out)
+#endif
+
+#define FIXED_DECIMALS 6
+#define FIXED_SCALE 1000000ULL// 10^FIXED_DECIMALS
+//a double is m * 2^-s, the integer path needs m * FIXED_SCALE < 2^64:
+#define FIXED_MAX_MANTISSA (1ULL << 44)
+#define FIXED_MAX_SHIFT 63
+#define DOUBLE_MANTISSA_BITS 52
+#define DOUBLE_EXP_MASK 0x7FF
+#define DOUBLE_EXP_BIAS 1075// bias + mantissa bits
+//longest printf("%f") of a double: 309 integer digits, sign, point and decimals
+#define FALLBACK_SIZE 330
+//longest printf("%d") of an int, with the null
+#define INT_TEXT_SIZE 12
+
+/* definition of the writer */
+typedef struct _out_buffer {
+  char* data;
+  size_t size;
+  size_t capacity;
+  FILE* out;
+  int fd;// descriptor of out, -1 to go through fwrite
+  Bool failed;
+} OutBuffer, *pOutBuffer;
+
+///////////////////  internal static functions ///////////////////////////
+
+/*************************************************************************
+Function name	: FlushData
+Description		: hands the buffered text to the stream and empties the
+				  buffer
+Paramerters		: buf - the writer
+Return value	: none
+************************************************************************/
+static void FlushData(pOutBuffer buf);
+
+/*************************************************************************
+Function name	: Reserve
+Description		: flushes the buffer if it has less than 'size' free
+				  characters
+Paramerters		: buf - the writer, size - the characters needed
+Return value	: none
+************************************************************************/
+static void Reserve(pOutBuffer buf, size_t size);
+
+/////////////////////////////////////////////////////////////////////////
+
+static void FlushData(pOutBuffer buf) {
+	size_t done = 0;
+	if (buf->fd < 0) {
+		if (fwrite(buf->data, 1, buf->size, buf->out) != buf->size) buf->failed = TRUE;
+		buf->size = 0;
+		return;
+	}
+	while (done < buf->size) {
+		long written = (long)WRITE_FD(buf->fd, buf->data + done, buf->size - done);
+		if (written < 0) {
+#ifndef _WIN32
+			if (errno == EINTR) continue;
+#endif
+			buf->failed = TRUE;
+			break;
+		}
+		done += (size_t)written;
+	}
+	buf->size = 0;
+}
+
+static void Reserve(pOutBuffer buf, size_t size) {
+	if (buf->capacity - buf->size < size) FlushData(buf);
+}
+
+int FormatFixed(double value, char* dst) {
+	unsigned long long bits;
+	memcpy(&bits, &value, sizeof(bits));
+	int biasedExp = (int)((bits >> DOUBLE_MANTISSA_BITS) & DOUBLE_EXP_MASK);
+	if (biasedExp == DOUBLE_EXP_MASK) return -1;//inf or nan
+	//value = +-m * 2^-s, exactly:
+	unsigned long long m = bits & ((1ULL << DOUBLE_MANTISSA_BITS) - 1);
+	int s = DOUBLE_EXP_BIAS - 1;
+	if (biasedExp != 0) {
+		m |= 1ULL << DOUBLE_MANTISSA_BITS;
+		s = DOUBLE_EXP_BIAS - biasedExp;
+	}
+	if (m == 0) s = 0;
+	while (s > 0 && (m & 1) == 0) {
+		m >>= 1;
+		s--;
+	}
+	if (s < 0 || s > FIXED_MAX_SHIFT || m >= FIXED_MAX_MANTISSA) return -1;
+	//value * 10^6, rounded to nearest, ties to even - as printf does:
+	unsigned long long scaled = m * FIXED_SCALE;
+	unsigned long long q = scaled >> s;
+	if (s > 0) {
+		unsigned long long rem = scaled & ((1ULL << s) - 1);
+		unsigned long long half = 1ULL << (s - 1);
+		if (rem > half || (rem == half && (q & 1))) q++;
+	}
+	unsigned long long intPart = q / FIXED_SCALE;
+	unsigned long fracPart = (unsigned long)(q % FIXED_SCALE);
+	char digits[FORMAT_FIXED_SIZE];
+	int len = 0, numDigits = 0;
+	if (bits >> 63) dst[len++] = '-';
+	do {
+		digits[numDigits++] = (char)('0' + intPart % 10);
+		intPart /= 10;
+	} while (intPart > 0);
+	while (numDigits > 0) dst[len++] = digits[--numDigits];
+	dst[len++] = '.';
+	for (int i = FIXED_DECIMALS - 1; i >= 0; i--) {
+		dst[len + i] = (char)('0' + fracPart % 10);
+		fracPart /= 10;
+	}
+	return len + FIXED_DECIMALS;
+}
+
+pOutBuffer OutBufferCreate(size_t capacity) {
+	if (capacity < FALLBACK_SIZE) capacity = OUTBUFFER_DEFAULT_SIZE;
+	pOutBuffer buf = (pOutBuffer)malloc(sizeof(OutBuffer));
+	if (buf == NULL) return NULL;
+	buf->data = (char*)malloc(capacity);
+	if (buf->data == NULL) {
+		free(buf);
+		return NULL;
+	}
+	buf->size = 0;
+	buf->capacity = capacity;
+	buf->out = NULL;
+	buf->fd = -1;
+	buf->failed = FALSE;
+	return buf;
+}
+
+void OutBufferDestroy(pOutBuffer buf) {
+	if (buf == NULL) return;
+	OutBufferEnd(buf);
+	free(buf->data);
+	free(buf);
+}
+
+void OutBufferBegin(pOutBuffer buf, FILE* out) {
+	if (buf == NULL || out == NULL) return;
+	OutBufferEnd(buf);
+	fflush(out);
+	buf->out = out;
+	buf->fd = FILE_FD(out);
+	buf->failed = FALSE;
+}
+
+Result OutBufferEnd(pOutBuffer buf) {
+	if (buf == NULL) return FAILURE;
+	if (buf->out == NULL) return SUCCESS;
+	FlushData(buf);
+	if (buf->fd < 0) fflush(buf->out);
+	buf->out = NULL;
+	return buf->failed ? FAILURE : SUCCESS;
+}
+
+void OutBufferPutChar(pOutBuffer buf, char c) {
+	if (buf == NULL || buf->out == NULL) return;
+	Reserve(buf, 1);
+	buf->data[buf->size++] = c;
+}
+
+void OutBufferPutString(pOutBuffer buf, const char* str) {
+	if (buf == NULL || buf->out == NULL || str == NULL) return;
+	while (*str != '\0') {
+		Reserve(buf, 1);
+		while (*str != '\0' && buf->size < buf->capacity) {
+			buf->data[buf->size++] = *str++;
+		}
+	}
+}
+
+void OutBufferPutDouble(pOutBuffer buf, double value) {
+	if (buf == NULL || buf->out == NULL) return;
+	Reserve(buf, FALLBACK_SIZE);
+	int len = FormatFixed(value, buf->data + buf->size);
+	if (len < 0) {//too many significant bits, or not a number
+		len = snprintf(buf->data + buf->size, FALLBACK_SIZE, "%f", value);
+	}
+	buf->size += (size_t)len;
+}
+
+void OutBufferPutInt(pOutBuffer buf, int value) {
+	if (buf == NULL || buf->out == NULL) return;
+	Reserve(buf, INT_TEXT_SIZE);
+	buf->size += (size_t)snprintf(buf->data + buf->size, INT_TEXT_SIZE, "%d", value);
+}
@@ -0,0 +1,101 @@
+#ifndef OUTBUFFER_H
+#define OUTBUFFER_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include "defs.h"
+
+/*
+** Buffered output writer.
+** text is collected in one large buffer, reused between uses, and handed
+** to the operating system with write(2) whenever it fills up - stdio is
+** bypassed. doubles are formatted by OutBufferPutDouble, byte-identical
+** to printf("%f") and much faster for values with few significant bits,
+** such as the boundaries of partition cells.
+*/
+
+#define OUTBUFFER_DEFAULT_SIZE (1 << 20)
+
+//the writer data structure:
+typedef struct _out_buffer OutBuffer, *pOutBuffer;
+
+/*************************************************************************
+Function name	: OutBufferCreate
+Description		: creates a writer with an empty buffer
+Paramerters		: capacity - the size of the buffer, 0 for the default
+Return value	: pOutBuffer - the new writer, NULL on allocation failure
+************************************************************************/
+pOutBuffer OutBufferCreate(size_t capacity);
+
+/*************************************************************************
+Function name	: OutBufferDestroy
+Description		: flushes the writer and frees it
+Paramerters		: buf - the writer
+Return value	: none
+************************************************************************/
+void OutBufferDestroy(pOutBuffer buf);
+
+/*************************************************************************
+Function name	: OutBufferBegin
+Description		: directs the writer to a stream. anything already
+				  buffered by the stream is flushed first, so the output
+				  stays in order.
+Paramerters		: buf - the writer, out - the stream
+Return value	: none
+************************************************************************/
+void OutBufferBegin(pOutBuffer buf, FILE* out);
+
+/*************************************************************************
+Function name	: OutBufferEnd
+Description		: writes out everything buffered
+Paramerters		: buf - the writer
+Return value	: Result - SUCCESS, FAILURE if a write failed since
+				  OutBufferBegin
+************************************************************************/
+Result OutBufferEnd(pOutBuffer buf);
+
+/*************************************************************************
+Function name	: OutBufferPutChar
+Description		: appends a character
+Paramerters		: buf - the writer, c - the character
+Return value	: none
+************************************************************************/
+void OutBufferPutChar(pOutBuffer buf, char c);
+
+/*************************************************************************
+Function name	: OutBufferPutString
+Description		: appends a null terminated string
+Paramerters		: buf - the writer, str - the string
+Return value	: none
+************************************************************************/
+void OutBufferPutString(pOutBuffer buf, const char* str);
+
+/*************************************************************************
+Function name	: OutBufferPutDouble
+Description		: appends a double formatted as by printf("%f")
+Paramerters		: buf - the writer, value - the double
+Return value	: none
+************************************************************************/
+void OutBufferPutDouble(pOutBuffer buf, double value);
+
+/*************************************************************************
+Function name	: OutBufferPutInt
+Description		: appends an int formatted as by printf("%d")
+Paramerters		: buf - the writer, value - the int
+Return value	: none
+************************************************************************/
+void OutBufferPutInt(pOutBuffer buf, int value);
+
+/*************************************************************************
+Function name	: FormatFixed
+Description		: formats a double as printf("%f") does, if it has few
+				  enough significant bits to be done in integer math
+Paramerters		: value - the double, dst - at least FORMAT_FIXED_SIZE
+				  characters, not null terminated
+Return value	: int - the length written, -1 if the value is not handled
+************************************************************************/
+int FormatFixed(double value, char* dst);
+
+#define FORMAT_FIXED_SIZE 32
+
+#endif
@@ -1,7 +1,20 @@
+#if defined(TREE_STATS) && !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L//clock_gettime
+#endif
+#include <limits.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include "partition.h"
-#include "gentree.h"
+#include "typedtree.h"
+#include "linpartition.h"
+#include "workpool.h"
+#include "locindex.h"
+#include "outbuffer.h"
+#include "snapshot.h"
+#include "pointbuckets.h"
 
 #define NUM_CHILDREN 4
 #define X_LEFT_INIT 0.0
@@ -9,36 +22,169 @@
 #define Y_BOT_INIT 0.0
 #define Y_TOP_INIT 1.0
 #define ROOT_KEY 0
+#define NO_CHILD (-1)
+//bits of a quadrant index, see GetQuadrant:
+#define QUAD_RIGHT 1
+#define QUAD_TOP 2
+//the bit that tells the quadrants on one side of a cell from the others, and its value on that side:
+#define SIDE_AXIS(side) (((side) == PARTITION_LEFT || (side) == PARTITION_RIGHT) ? QUAD_RIGHT : QUAD_TOP)
+#define SIDE_BIT(side) (((side) == PARTITION_RIGHT || (side) == PARTITION_TOP) ? SIDE_AXIS(side) : 0)
+#define OPPOSITE_SIDE(side) ((PartitionSide)((side) ^ 1))
+#define NO_POINT ((size_t)-1)
+#define LOCATE_BLOCK_SIZE 256
+#define PRINT_STACK_INIT_SIZE 64
+#define DIRTY_INIT_CAPACITY 64
+#define DELTA_RESET_LINE "reset\n"
+#define LAYOUT_MIN_CELLS 65536//smaller trees are not laid out again by batches
+#define LAYOUT_GROWTH 2//batches lay the tree out again each time it grows this much
+#define KEY_ELEMS_INIT_CAPACITY 64
+#define BALANCE_INIT_CAPACITY 64
+#define LIVE_KEY INT_MAX//the newest key a walk of the partition itself sees, see PartitionVersion
+
+#if !defined(_WIN32)
+#include <sched.h>
+#define VERSIONS_ADD(p, v) __atomic_add_fetch((p), (v), __ATOMIC_ACQ_REL)
+#define VERSIONS_LOAD(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define VERSIONS_YIELD() sched_yield()
+#else
+#define VERSIONS_ADD(p, v) (*(p) += (v))
+#define VERSIONS_LOAD(p) (*(p))
+#define VERSIONS_YIELD()
+#endif
+
+#ifdef TREE_STATS
+#define STATS_CLOCK_START() double statsStart = StatsSeconds()
+#define STATS_CLOCK_STOP(part, counter, count, seconds) do { \
+	(part)->stats.counter += (count); \
+	(part)->stats.seconds += StatsSeconds() - statsStart; \
+} while (0)
+#else
+#define STATS_CLOCK_START()
+#define STATS_CLOCK_STOP(part, counter, count, seconds)
+#endif
 
 
 typedef double BOUNDARY;
 typedef double COORDINATE;
 
-//global pointer to tree:
-static pTree pPartTree = NULL;
 typedef struct _partition_node {
 	BOUNDARY x_left;
 	BOUNDARY x_right;
 	BOUNDARY y_bot;
 	BOUNDARY y_top;
 	int key;
+	signed char quadSlot[NUM_CHILDREN];//tree slot of the child in each quadrant, NO_CHILD if none
+	int depth;//0 for the root. fits in the padding of the node
+	int leaves;//cells of the subtree that hold points, see SubtreeLeaves
 }partNode, *ppartNode;
 
+#define PART_NODE_KEY(pNode) ((pNode)->key)
+
+/* the tree of cells - nodes inline, 4 children, keys read with no call */
+DEFINE_GENTREE(PartTree, partNode, NUM_CHILDREN, PART_NODE_KEY)
+typedef PartTreeElem* pPartElem;
+
+/* definition of a partition */
+typedef struct _partition {
+	PartTree* tree;//the cells, with the tree backend
+	pLinPartition lin;//the cells, with the linear backend
+	pWorkPool batchPool;//workers that plan the descents of PartitionRefineBatch
+	int batchPoolThreads;//as requested in PartitionParams
+	int lastKey;
+	pLocIndex locIndex;//flat copy of the tree for PartitionLocateBatch
+	Bool locIndexStale;//cells were added since locIndex was built
+	pPartElem* keyElems;//the element of every key, NULL for none, for PartitionNeighbors
+	size_t keyElemsCapacity;
+	Bool keyElemsStale;//cells were removed or moved since keyElems was built
+	pOutBuffer printBuffer;//reused by every PartitionPrint
+	pPartElem* dirty;//elements whose lines changed since the last print, may repeat
+	size_t dirtyCount;
+	size_t dirtyCapacity;
+	int* removedKeys;//keys of the cells removed since the last print
+	size_t removedCount;
+	size_t removedCapacity;
+	Bool allDirty;//every line changed since the last print, dirty and removedKeys are not kept
+	pSnapImage image;//the cells, when loaded and not changed yet
+	pPointBuckets buckets;//points of the leaves, NULL unless PartitionParams.bucketCapacity is set
+	COORDINATE* splitPoints;//x then y of the points of a bucket being split
+	int maxDepth;//cells are not split below it, 0 for no limit
+	int versions;//versions taken and not released yet, changed by any thread
+	Bool autoLayout;//as requested in PartitionParams
+	int layoutCount;//cells at the last relayout, see PartitionRefineBatch
+	Bool balanced;//as requested in PartitionParams
+	pPartElem* balanceWork;//cells added whose neighbors are not checked yet, see BalanceCells
+	size_t balanceCount;
+	size_t balanceCapacity;
+#ifdef TREE_STATS
+	PartitionStats stats;//the timers - the other counters are gathered by PartitionGetStats
+#endif
+}Partition;
+
+/* definition of a version - the cells of the tree up to lastKey. keys
+   only grow until the partition is reset, and a cell is not changed once
+   added but for its children, so the cells with newer keys are skipped
+   and nothing is copied */
+typedef struct _partition_version {
+	pPartition part;
+	pPartElem root;
+	int lastKey;
+}PartitionVersion;
+
+//the partition of the global interface (InitPartition, RefineCell...):
+static pPartition pDefaultPart = NULL;
+
+/* definition of a pending descent of a batch: the points idx[begin, end)
+   all lie in the cell of elem, or - if elem is NULL - in the cell that the
+   batch point 'creator' adds */
+typedef struct _batch_item {
+	pPartElem elem;
+	size_t creator;
+	partNode cell;//boundaries of the cell, and its quadSlot if elem exists
+	size_t begin;
+	size_t end;
+}batchItem;
+
+/* definition of the rectangle of a query, [x0, x1] x [y0, y1] */
+typedef struct _query_rect {
+	COORDINATE x0;
+	COORDINATE x1;
+	COORDINATE y0;
+	COORDINATE y1;
+}queryRect;
+
+/* definition of the cell whose neighbors AdjacentPair reports */
+typedef struct _adjacency_ctx {
+	PartitionCell cell;
+	PartitionSide side;
+	PartitionAdjacencyFunction func;
+	void* ctx;
+}adjacencyCtx;
+
+/* definition of a pending record of QueryRecords */
+typedef struct _query_record_item {
+	int record;
+	int depth;
+}queryRecordItem;
+
+/* definition of a pending element of BuildLocIndex */
+typedef struct _loc_build_item {
+	pPartElem elem;
+	int node;//its node in the location index
+}locBuildItem;
+
+/* definition of the state of a batch refinement */
+typedef struct _batch_plan {
+	pPartition part;
+	const COORDINATE* xs;
+	const COORDINATE* ys;
+	size_t* idx;//points in descent order
+	size_t* tmp;//scratch for regrouping idx
+	unsigned char* quad;//quadrant of each point in the cell being processed
+	pPartElem* elems;//existing parent of the cell a point adds, then the added element
+	size_t* parentPoint;//else the point that adds the parent, NO_POINT if the point adds nothing
+}batchPlan;
+
 ///////////////////// internal static functions //////////////////////
-/*************************************************************************
-Function name	: CreatePartNode
-Description     : creates the Node of the square partition and returns a pointer
-		to it
-Paramerters     :x_left, x_right, y_left, y_right boundaries of the
-		 partition to initialize the node
-Return value	: ppartNode - a pointer to the node
-************************************************************************/
-static ppartNode CreatePartNode(BOUNDARY x_left,
-	BOUNDARY x_right,
-	BOUNDARY y_bot,
-	BOUNDARY y_top,
-	int key);
-	
 /*************************************************************************
 Function name	: getNewSquareBoudaries
 Description     : updates the values of the boundaries according to the 
@@ -55,117 +201,682 @@ static void getNewSquareBoudaries(BOUNDARY* x_left,
 	BOUNDARY* y_top,
 	COORDINATE x,
 	COORDINATE y,
-	ppartNode pNode);
+	const partNode* pNode);
 
 /*************************************************************************
-Function name	: IsContained
-Description     : checks if the coordinates x and y are contained inside 
-		the boundaries of the node pointed by pNode
-Paramerters     :pNode- the partition node to check
-		x, y - the coordinates to check
-Return value	: Bool true if contained else false
+Function name	: GetQuadrant
+Description     : returns the quadrant of the node pointed by pNode that
+		holds the coordinates x y, split by the same rule as
+		getNewSquareBoudaries
+Paramerters     :pNode - the partition node
+		x, y - the coordinates
+Return value	: int - QUAD_RIGHT and QUAD_TOP bits, 0 to NUM_CHILDREN-1
 ************************************************************************/
-static Bool IsContained(ppartNode pNode,
+static int GetQuadrant(const partNode* pNode,
 	COORDINATE x,
 	COORDINATE y);
 
 /*************************************************************************
-Function name	: RecurRefineCell
-Description     : helper to Refine cell - recursively searches the correct 
-		node to insert the new partition node under
-Paramerters     :x, y coordinates of the new partition
-		curNode - the current node to search
+Function name	: RefinesRoot
+Description     : checks if the coordinates are in no child cell of the
+		root - a child holds [left, right) x [bot, top), so a point on the
+		right or top edge of the square (or NaN) always refines the root.
+		with buckets the edge cells hold their edges, and this is FALSE
+Paramerters     :part - the partition, x, y - the coordinates to check
+Return value	: Bool true if x,y can only refine the root
+************************************************************************/
+static Bool RefinesRoot(pPartition part, COORDINATE x, COORDINATE y);
+
+/*************************************************************************
+Function name	: CanSplit
+Description     : checks if a cell may be split - it is above the maximal
+		depth, and its midpoints differ from its edges
+Paramerters     :part - the partition, pNode - the cell
+Return value	: Bool true if the cell may be split
+************************************************************************/
+static Bool CanSplit(pPartition part, const partNode* pNode);
+
+/*************************************************************************
+Function name	: BucketPoint
+Description     : adds a point to the bucket of its leaf, splitting the
+		leaf - and the quadrant the points all went to, if needed -
+		once the bucket is full
+Paramerters     :part - a partition with buckets, pElem - the element
+		found by FindRefinedElem for x,y, x,y - the point
+Return value	: Result - SUCCESS, FAILURE on allocation failure
+************************************************************************/
+static Result BucketPoint(pPartition part, pPartElem pElem, COORDINATE x, COORDINATE y);
+
+/*************************************************************************
+Function name	: SplitBucket
+Description     : moves the points of the bucket of a leaf to new cells in
+		their quadrants
+Paramerters     :part - a partition with buckets, pElem - the leaf
+Return value	: Result - SUCCESS, FAILURE on allocation failure
+************************************************************************/
+static Result SplitBucket(pPartition part, pPartElem pElem);
+
+/*************************************************************************
+Function name	: PushBalance
+Description     : adds a new cell to the cells whose neighbors BalanceCells
+		checks. on allocation failure the cell is not checked, and the
+		partition may be left unbalanced until PartitionBalance
+Paramerters     :part - a balanced partition, pElem - the new element
 Return value	: none
 ************************************************************************/
-static void RecurRefineCell(COORDINATE x, COORDINATE y, ppartNode curNode);
+static void PushBalance(pPartition part, pPartElem pElem);
+
+/*************************************************************************
+Function name	: SplitQuadrant
+Description     : adds the child of a cell in one quadrant, moving the
+		points of its bucket to their quadrants first if it is a leaf
+Paramerters     :part - the partition, pElem - the element,
+		quad - a quadrant of it with no child
+Return value	: Result - SUCCESS, FAILURE on allocation failure
+************************************************************************/
+static Result SplitQuadrant(pPartition part, pPartElem pElem, int quad);
+
+/*************************************************************************
+Function name	: BalanceElem
+Description     : splits the cells next to an element that are more than
+		one level larger, until none is. only larger neighbors are
+		checked: a cell that large holds the whole side of the element
+		across, so one walk per side finds it
+Paramerters     :part - a balanced partition, pElem - the element
+Return value	: Result - SUCCESS, FAILURE on allocation failure
+************************************************************************/
+static Result BalanceElem(pPartition part, pPartElem pElem);
+
+/*************************************************************************
+Function name	: BalanceCells
+Description     : balances the cells pushed by PartitionAddNode, and the
+		cells that splitting their neighbors adds in turn, until none
+		is left. costs O(1) walks per cell on average, whatever the
+		size of the partition
+Paramerters     :part - a balanced partition
+Return value	: Result - SUCCESS, FAILURE on allocation failure
+************************************************************************/
+static Result BalanceCells(pPartition part);
+
+/*************************************************************************
+Function name	: FindRefinedElem
+Description     : descends from the root to the deepest element whose
+		cell contains x,y - the one PartitionRefine splits
+Paramerters     :part - the partition, x, y coordinates to look up
+		depth - updated with the depth of the element, may be NULL
+Return value	: pPartElem - the element, NULL if the partition is empty
+************************************************************************/
+static pPartElem FindRefinedElem(pPartition part, COORDINATE x, COORDINATE y, int* depth);
 
 /*************************************************************************
 Function name	: PartitionAddNode
 Description     : adds under the current partition the new partition for
 		x,y 
-Paramerters     :pparentNode - a pointer to the current partition node
+Paramerters     :part - the partition
+		pparentElem - the element of the current partition node
 		x,y coordinates of the partition.
-Return value	: none
+		key - the key of the new partition node
+Return value	: pPartElem - the new element, NULL if it was not added
 ************************************************************************/
-static void PartitionAddNode(COORDINATE x,
+static pPartElem PartitionAddNode(pPartition part,
+	COORDINATE x,
 	COORDINATE y,
-	ppartNode pparentNode);
+	pPartElem pparentElem,
+	int key);
+
+/*************************************************************************
+Function name	: GenerateKey
+Description     : returns the next unused key of a partition
+Paramerters     :part - the partition
+Return value	: int - the key
+************************************************************************/
+static int GenerateKey(pPartition part);
+
+/*************************************************************************
+Function name	: ReserveKeys
+Description     : reserves 'count' consecutive keys, as if GenerateKey was
+		called 'count' times
+Paramerters     :part - the partition, count - the amount of keys
+Return value	: int - the first reserved key
+************************************************************************/
+static int ReserveKeys(pPartition part, int count);
 
 /*************************************************************************
-Function name	: DelChildArr
-Description     : deletes the array that the function TreeGetChildren allocates
-Paramerters     :ChildpArr - a pointer to the array
+Function name	: InitStorage
+Description     : creates the cells of a partition - the root only - with
+		the selected backend, and the batch pool if the amount of
+		workers changed, and the buckets if they are set. an emptied
+		tree left in part is reused
+Paramerters     :part - a partition with no cells, or an empty tree
+		params - the settings, NULL for the defaults
+Return value	: Result - SUCCESS, FAILURE on allocation failure
+************************************************************************/
+static Result InitStorage(pPartition part, const PartitionParams* params);
+
+/*************************************************************************
+Function name	: RecordToNode
+Description     : copies the cell of an image record to a partition node
+Paramerters     :rec - the record, pNode - the node to fill
 Return value	: none
 ************************************************************************/
-static void DelChildArr(ppartNode* ChildpArr);
-//////////////////////////////////////////////////////////////////////
+static void RecordToNode(const SNAPRECORD* rec, partNode* pNode);
 
+/*************************************************************************
+Function name	: ThawImage
+Description     : replaces the loaded image of a partition by a tree with
+		the same cells, children slots and keys, before a change
+Paramerters     :part - a partition holding an image
+Return value	: Result - SUCCESS, FAILURE on allocation failure (the
+		image is kept)
+************************************************************************/
+static Result ThawImage(pPartition part);
 
-//////////////// functions to be used by the tree ADT ///////////////
-pNode partitionClone(pNode pNode);
-void partitionPrint(pNode pNode);
-void partitionDel(pNode pNode);
-int partitionGetKey(pNode pNode);
-////////////////////////////////////////////////////////////////////
-
-pNode partitionClone(pNode pNode) {
-	if (pNode == NULL) return NULL;
-	ppartNode pnewNode = (ppartNode)malloc(sizeof(partNode));
-	if (pnewNode == NULL) return NULL;
-	pnewNode->x_left = ((ppartNode)pNode)->x_left;
-	pnewNode->x_right = ((ppartNode)pNode)->x_right;
-	pnewNode->y_bot = ((ppartNode)pNode)->y_bot;
-	pnewNode->y_top = ((ppartNode)pNode)->y_top;
-	pnewNode->key = ((ppartNode)pNode)->key;
-	return pnewNode;
-}
-
-void partitionPrint(pNode pNode) {
-	if (pNode == NULL) return;
-	printf("([%f, %f], [%f, %f])", ((ppartNode)pNode)->x_left,
-		((ppartNode)pNode)->x_right,
-		((ppartNode)pNode)->y_bot,
-		((ppartNode)pNode)->y_top);
-	ppartNode* ChildpArr = (ppartNode *)TreeGetChildren(pPartTree, ((ppartNode)pNode)->key);
-	for (int i = 0; i < NUM_CHILDREN; i++) {
-		if (ChildpArr[i] != NULL) {
-			putchar('\\');
-			printf("([%f, %f], [%f, %f])", ChildpArr[i]->x_left,
-				ChildpArr[i]->x_right,
-				ChildpArr[i]->y_bot,
-				ChildpArr[i]->y_top);
-		}
-	}
-	putchar('\n');
-	DelChildArr(ChildpArr);
-}
+/*************************************************************************
+Function name	: ImageLocate
+Description     : finds the record of the smallest cell of a loaded image
+		that contains x,y, as FindRefinedElem does in a tree
+Paramerters     :part - a partition holding an image, x, y - the point
+		rec - updated with the record, depth - updated with its depth
+Return value	: Result - SUCCESS, FAILURE if the image is not valid
+************************************************************************/
+static Result ImageLocate(pPartition part, COORDINATE x, COORDINATE y,
+	SNAPRECORD* rec, int* depth);
 
+/*************************************************************************
+Function name	: PrintRecords
+Description     : prints the cell of every record of a loaded image
+		followed by its children, in pre order, as PrintCells does. the
+		records still to print are kept on an explicit stack.
+Paramerters     :part - a partition holding an image,
+		withKeys - true to start every line with the key of its cell
+		out - the writer to print to
+Return value	: none
+************************************************************************/
+static void PrintRecords(pPartition part, Bool withKeys, pOutBuffer out);
 
-void partitionDel(pNode pNode) {
-	free((ppartNode)pNode);
-}
+/*************************************************************************
+Function name	: SaveTree
+Description     : writes the tree of a partition as an image: the elements
+		are numbered in pre order in a first walk, which also sums the
+		size of every subtree, then written in a second walk with the
+		numbers of their children
+Paramerters     :part - a partition with the tree backend, path - the file
+Return value	: Result - SUCCESS, FAILURE on failure
+************************************************************************/
+static Result SaveTree(pPartition part, const char* path);
 
-int partitionGetKey(pNode pNode) {
-	return ((ppartNode)pNode)->key;
-}
-//////////////////////////////////////////////////////////////////////
+/*************************************************************************
+Function name	: ReleaseStorage
+Description     : frees the cells of a partition, the batch pool is kept
+Paramerters     :part - the partition
+Return value	: none
+************************************************************************/
+static void ReleaseStorage(pPartition part);
 
+/*************************************************************************
+Function name	: BuildLocIndex
+Description     : copies the cells of the tree, with their quadrants, into
+		the location index
+Paramerters     :part - a partition with the tree backend
+Return value	: Result - SUCCESS, FAILURE on allocation failure
+************************************************************************/
+static Result BuildLocIndex(pPartition part);
 
+/*************************************************************************
+Function name	: SetLocatedCell
+Description     : fills a located cell from a partition node
+Paramerters     :cell - the cell to fill, pNode - the node
+		depth - the depth of the node
+Return value	: none
+************************************************************************/
+static void SetLocatedCell(PartitionCell* cell, const partNode* pNode, int depth);
 
-static ppartNode CreatePartNode(BOUNDARY x_left,
-	BOUNDARY x_right,
-	BOUNDARY y_bot,
-	BOUNDARY y_top,
-	int key) {
-	ppartNode pnewNode = (ppartNode)malloc(sizeof(partNode));
-	if (pnewNode == NULL) return NULL;
-	pnewNode->x_left = x_left;
-	pnewNode->x_right = x_right;
-	pnewNode->y_bot = y_bot;
-	pnewNode->y_top = y_top;
-	pnewNode->key = key;
-	return pnewNode;
-}
+/*************************************************************************
+Function name	: PrintCells
+Description     : prints the line of every element, walking the tree in
+		pre order with a tree iterator
+Paramerters     :part - a partition with the tree backend,
+		withKeys - true to start every line with the key of its cell
+		out - the writer to print to
+Return value	: none
+************************************************************************/
+static void PrintCells(pPartition part, Bool withKeys, pOutBuffer out);
+
+/*************************************************************************
+Function name	: PrintElemLine
+Description     : prints the line of an element - its cell followed by
+		the cells of its children, in slot order as TreePrint does
+Paramerters     :pElem - the element, withKeys - true to start the line
+		with the key of the cell, lastKey - children with newer keys
+		are left out, LIVE_KEY for none, out - the writer to print to
+Return value	: none
+************************************************************************/
+static void PrintElemLine(const PartTreeElem* pElem, Bool withKeys, int lastKey, pOutBuffer out);
+
+/*************************************************************************
+Function name	: ChildAsOf
+Description     : returns the child in a slot of an element, if its key
+		is not newer than lastKey. safe while another thread adds cells
+Paramerters     :pElem - the element, slot - the slot,
+		lastKey - the newest key seen, LIVE_KEY for all
+Return value	: pPartElem - the child, NULL if none
+************************************************************************/
+static pPartElem ChildAsOf(const PartTreeElem* pElem, int slot, int lastKey);
+
+/*************************************************************************
+Function name	: NodeAsOf
+Description     : returns the node of an element as a version sees it -
+		quadrants whose child is newer than lastKey are open. the
+		leaves of the view are not set
+Paramerters     :pElem - the element, lastKey - the newest key seen,
+		LIVE_KEY for the node itself, pView - room for the view
+Return value	: const partNode* - the node or the view
+************************************************************************/
+static const partNode* NodeAsOf(const PartTreeElem* pElem, int lastKey, partNode* pView);
+
+/*************************************************************************
+Function name	: RelayoutTree
+Description     : moves the elements of the tree into memory in pre order,
+		keeping the dirty elements. the location index is stale after
+Paramerters     :part - a partition with the tree backend and no versions
+Return value	: Result - SUCCESS, FAILURE on allocation failure
+************************************************************************/
+static Result RelayoutTree(pPartition part);
+
+/*************************************************************************
+Function name	: WaitForVersions
+Description     : waits until every version of a partition is released,
+		before its cells are removed or reused
+Paramerters     :part - the partition
+Return value	: none
+************************************************************************/
+static void WaitForVersions(pPartition part);
+
+/*************************************************************************
+Function name	: MarkDirty
+Description     : records that the line of an element changed. once the
+		record is as long as the tree, or can not grow, every line is
+		marked instead, since printing them all costs no more
+Paramerters     :part - a partition with the tree backend, pElem - the element
+Return value	: none
+************************************************************************/
+static void MarkDirty(pPartition part, pPartElem pElem);
+
+/*************************************************************************
+Function name	: MarkRemoved
+Description     : records the key of a removed cell, for the next delta
+		print. as MarkDirty, marks every line once the record grows
+		as long as the tree
+Paramerters     :part - a partition with the tree backend, key - the key
+Return value	: none
+************************************************************************/
+static void MarkRemoved(pPartition part, int key);
+
+/*************************************************************************
+Function name	: MarkAllDirty
+Description     : marks every line of a partition as changed, dropping the
+		record of the changes
+Paramerters     :part - the partition
+Return value	: none
+************************************************************************/
+static void MarkAllDirty(pPartition part);
+
+/*************************************************************************
+Function name	: DropDirtyBelow
+Description     : removes from the changed elements those below pTop,
+		before they are deleted
+Paramerters     :part - a partition with the tree backend, pTop - the element
+Return value	: none
+************************************************************************/
+static void DropDirtyBelow(pPartition part, pPartElem pTop);
+
+/*************************************************************************
+Function name	: NextElem
+Description     : returns the element after pElem in a pre order walk of
+		the subtree of pTop, found through the parents with no stack
+Paramerters     :pElem - the current element, pTop - the top of the walk,
+		lastKey - elements with newer keys are skipped, LIVE_KEY for none
+Return value	: pPartElem - the next element, NULL at the end of the walk
+************************************************************************/
+static pPartElem NextElem(pPartElem pElem, pPartElem pTop, int lastKey);
+
+/*************************************************************************
+Function name	: RemoveChildren
+Description     : deletes every element below an element, updating the
+		quadrants and leaves of the cells and the record of changes,
+		and dropping the points of the deleted cells
+Paramerters     :part - a partition with the tree backend, pElem - the element
+Return value	: none
+************************************************************************/
+static void RemoveChildren(pPartition part, pPartElem pElem);
+
+/*************************************************************************
+Function name	: CompareInts
+Description     : orders ints, for qsort
+Paramerters     :a, b - pointers to two ints
+Return value	: int - negative, 0 or positive as a is less than, equal
+		to or more than b
+************************************************************************/
+static int CompareInts(const void* a, const void* b);
+
+/*************************************************************************
+Function name	: CompareElemKeys
+Description     : orders elements by key, for qsort
+Paramerters     :a, b - pointers to two pPartElem
+Return value	: int - negative, 0 or positive as the key of a is less than,
+		equal to or more than that of b
+************************************************************************/
+static int CompareElemKeys(const void* a, const void* b);
+
+/*************************************************************************
+Function name	: PrintDirtyCells
+Description     : prints "key: removed" for every removed cell, then the
+		line of every changed element once, in the order of keys -
+		parents before their children
+Paramerters     :part - a partition with the tree backend,
+		out - the writer to print to
+Return value	: none
+************************************************************************/
+static void PrintDirtyCells(pPartition part, pOutBuffer out);
+
+/*************************************************************************
+Function name	: PrintLines
+Description     : the work of PartitionPrint and PartitionPrintDelta -
+		prints the lines of a partition, all of them or the changed
+		ones, and starts recording changes again
+Paramerters     :part - the partition, out - the stream to print to
+		delta - true for a delta print
+Return value	: none
+************************************************************************/
+static void PrintLines(pPartition part, FILE* out, Bool delta);
+
+/*************************************************************************
+Function name	: PrintSquare
+Description     : prints the boundaries of a cell
+Paramerters     :pNode - the cell, out - the writer to print to
+Return value	: none
+************************************************************************/
+static void PrintSquare(const partNode* pNode, pOutBuffer out);
+
+/*************************************************************************
+Function name	: RefinePoint
+Description     : splits the smallest cell containing x,y - the work of
+		PartitionRefine, which times it
+Paramerters     :part - the partition, x, y - the point
+Return value	: Result - SUCCESS if a cell was added
+************************************************************************/
+static Result RefinePoint(pPartition part, COORDINATE x, COORDINATE y);
+
+/*************************************************************************
+Function name	: RefinePoints
+Description     : the work of PartitionRefineBatch, which times it
+Paramerters     :part - the partition, xs, ys - the points
+		n - the number of points
+Return value	: none
+************************************************************************/
+static void RefinePoints(pPartition part, const double* xs, const double* ys, size_t n);
+
+/*************************************************************************
+Function name	: HasOpenQuadrant
+Description     : checks if a cell has a quadrant with no child - a part
+		of its square that points are located in
+Paramerters     :pNode - the cell
+Return value	: Bool true if it has one
+************************************************************************/
+static Bool HasOpenQuadrant(const partNode* pNode);
+
+/*************************************************************************
+Function name	: SubtreeLeaves
+Description     : returns the amount of cells that hold points in the
+		subtree of an element - the cells below it through quadSlot,
+		and itself if it has an open quadrant or is the root holding the
+		top and right edges. the children must be counted
+Paramerters     :pElem - the element, rootHoldsEdges - TRUE unless the
+		partition has buckets, whose edge cells hold the edges
+Return value	: int - the amount of cells
+************************************************************************/
+static int SubtreeLeaves(const PartTreeElem* pElem, Bool rootHoldsEdges);
+
+/*************************************************************************
+Function name	: GetQuadrantSquare
+Description     : computes the square of a quadrant of a cell - the
+		square of the child that refines it
+Paramerters     :pNode - the cell, quad - the quadrant
+		pQuad - updated with the boundaries of the quadrant
+Return value	: none
+************************************************************************/
+static void GetQuadrantSquare(const partNode* pNode, int quad, partNode* pQuad);
+
+/*************************************************************************
+Function name	: RectOverlaps
+Description     : checks if a square, holding [left, right) x [bot, top),
+		has a point of the rectangle of a query
+Paramerters     :rect - the rectangle, pNode - the square
+Return value	: Bool true if it does
+************************************************************************/
+static Bool RectOverlaps(const queryRect* rect, const partNode* pNode);
+
+/*************************************************************************
+Function name	: RectContains
+Description     : checks if the rectangle of a query holds a whole square
+Paramerters     :rect - the rectangle, pNode - the square
+Return value	: Bool true if it does
+************************************************************************/
+static Bool RectContains(const queryRect* rect, const partNode* pNode);
+
+/*************************************************************************
+Function name	: RectReachesEdge
+Description     : checks if the rectangle of a query has a point on the
+		top or right edge of the unit square - a point of the root
+Paramerters     :rect - the rectangle
+Return value	: Bool true if it does
+************************************************************************/
+static Bool RectReachesEdge(const queryRect* rect);
+
+/*************************************************************************
+Function name	: MoveOffEdges
+Description     : with buckets, the edge cells hold the top and right edges
+		of the square, as the points just below them. moves a rectangle
+		starting on those edges to these points, so that it reports them
+Paramerters     :rect - the rectangle, rootHoldsEdges - FALSE with buckets
+Return value	: none
+************************************************************************/
+static void MoveOffEdges(queryRect* rect, Bool rootHoldsEdges);
+
+/*************************************************************************
+Function name	: HoldsRectPoint
+Description     : checks if a cell holds a point of the rectangle of a
+		query - in one of its open quadrants, or on the edges for the root
+Paramerters     :pNode - the cell, holdsEdges - true for the root, unless
+		the partition has buckets, rect - the rectangle
+Return value	: Bool true if it does
+************************************************************************/
+static Bool HoldsRectPoint(const partNode* pNode, Bool holdsEdges, const queryRect* rect);
+
+/*************************************************************************
+Function name	: QueryTree
+Description     : reports the cells of the tree that hold a point of the
+		rectangle, in pre order. the walk follows the parent of every
+		element back up, so it needs no stack. subtrees out of the
+		rectangle are skipped, and when counting the live tree,
+		subtrees inside it are counted from their leaves, without
+		being walked.
+Paramerters     :pRoot - the root of the tree, lastKey - cells with newer
+		keys are skipped, LIVE_KEY for none
+		rect - the rectangle, rootHoldsEdges - TRUE unless the partition
+		has buckets, func - called with each cell, NULL to count only,
+		ctx - passed to func
+Return value	: size_t - the amount of cells
+************************************************************************/
+static size_t QueryTree(pPartElem pRoot, int lastKey, const queryRect* rect, Bool rootHoldsEdges,
+	PartitionCellFunction func, void* ctx);
+
+/*************************************************************************
+Function name	: SetKeyElem
+Description     : records the element of a key, growing the key index
+Paramerters     :part - the partition, key - the key, pElem - its element
+Return value	: Result - SUCCESS, FAILURE on a negative key, an index
+		too large to allocate or allocation failure
+************************************************************************/
+static Result SetKeyElem(pPartition part, int key, pPartElem pElem);
+
+/*************************************************************************
+Function name	: FindKeyElem
+Description     : returns the element of a key, indexing every key first
+		if cells were removed or moved since the last time
+Paramerters     :part - a partition with the tree backend, key - the key
+Return value	: pPartElem - the element, NULL if none or on allocation failure
+************************************************************************/
+static pPartElem FindKeyElem(pPartition part, int key);
+
+/*************************************************************************
+Function name	: HoldsSidePoint
+Description     : checks if a cell holds a point along one side of its
+		square - in an open quadrant on that side - within a span of the
+		other coordinate
+Paramerters     :pNode - the cell, side - the side,
+		lo, hi - the span [lo, hi) along the side
+Return value	: Bool true if it does
+************************************************************************/
+static Bool HoldsSidePoint(const partNode* pNode, PartitionSide side, BOUNDARY lo, BOUNDARY hi);
+
+/*************************************************************************
+Function name	: QuadrantInSpan
+Description     : checks if a quadrant of a cell reaches into a span of
+		the coordinate along a side
+Paramerters     :pNode - the cell, quad - the quadrant, side - the side,
+		lo, hi - the span [lo, hi)
+Return value	: Bool true if it does
+************************************************************************/
+static Bool QuadrantInSpan(const partNode* pNode, int quad, PartitionSide side, BOUNDARY lo, BOUNDARY hi);
+
+/*************************************************************************
+Function name	: ReportCell
+Description     : calls a cell function with a cell, if there is one
+Paramerters     :pNode - the cell, func - the function, NULL for none,
+		ctx - passed to func
+Return value	: none
+************************************************************************/
+static void ReportCell(const partNode* pNode, PartitionCellFunction func, void* ctx);
+
+/*************************************************************************
+Function name	: EdgeCells
+Description     : reports the cells of a subtree that hold points along
+		one side of the square of its top, within a span, in pre order.
+		only the quadrants on that side are walked, with no stack
+Paramerters     :pTop - the top of the subtree, side - the side,
+		lo, hi - the span [lo, hi) along the side,
+		func - called with each cell, NULL to count only, ctx - passed to func
+Return value	: size_t - the amount of cells
+************************************************************************/
+static size_t EdgeCells(pPartElem pTop, PartitionSide side, BOUNDARY lo, BOUNDARY hi,
+	PartitionCellFunction func, void* ctx);
+
+/*************************************************************************
+Function name	: CellAcross
+Description     : finds the smallest cell, down to a depth, that holds the
+		points just across one side of the square of an element. the
+		walk goes up through the parents to the first cell that has a
+		quadrant across the side, then down the mirror of that path.
+		both walks take O(1) steps on average
+Paramerters     :pElem - the element, side - the side, depth - the depth
+		to stop at, quad - updated with the quadrant of the cell found
+		that holds the points, if not NULL
+Return value	: pPartElem - the cell, NULL on the edge of the square
+************************************************************************/
+static pPartElem CellAcross(pPartElem pElem, PartitionSide side, int depth, int* quad);
+
+/*************************************************************************
+Function name	: OutsideCells
+Description     : reports the cells across one side of the square of an
+		element, within a span. the cell across, as deep as the element,
+		is either the one neighbor, its open quadrant holding the span, or
+		a cell of the same size, whose edge cells are the neighbors
+Paramerters     :pElem - the element, side - the side,
+		lo, hi - the span [lo, hi) along the side,
+		func - called with each cell, NULL to count only, ctx - passed to func
+Return value	: size_t - the amount of cells, 0 on the edge of the square
+************************************************************************/
+static size_t OutsideCells(pPartElem pElem, PartitionSide side, BOUNDARY lo, BOUNDARY hi,
+	PartitionCellFunction func, void* ctx);
+
+/*************************************************************************
+Function name	: ElemNeighbors
+Description     : reports the neighbors of an element on one side: the
+		cells across the open quadrants on that side, then the edge cells
+		of every child next to an open quadrant on the other side
+Paramerters     :pElem - the element, side - the side,
+		func - called with each cell, NULL to count only, ctx - passed to func
+Return value	: size_t - the amount of cells
+************************************************************************/
+static size_t ElemNeighbors(pPartElem pElem, PartitionSide side,
+	PartitionCellFunction func, void* ctx);
+
+/*************************************************************************
+Function name	: AdjacentPair
+Description     : reports a neighbor found by PartitionAdjacency as a pair
+Paramerters     :cell - the neighbor, ctx - the adjacencyCtx
+Return value	: none
+************************************************************************/
+static void AdjacentPair(const PartitionCell* cell, void* ctx);
+
+/*************************************************************************
+Function name	: QueryRecords
+Description     : reports the cells of a loaded image that hold a point of
+		the rectangle, as QueryTree does. records keep no leaves, so
+		counting walks the records as well
+Paramerters     :part - a partition holding an image
+		rect - the rectangle, rootHoldsEdges - TRUE unless the partition
+		has buckets, func - called with each cell, NULL to count only,
+		ctx - passed to func
+Return value	: size_t - the amount of cells
+************************************************************************/
+static size_t QueryRecords(pPartition part, const queryRect* rect, Bool rootHoldsEdges,
+	PartitionCellFunction func, void* ctx);
+
+#ifdef TREE_STATS
+/*************************************************************************
+Function name	: StatsSeconds
+Description     : returns a monotonic time, for the timers of the stats
+Paramerters     :none
+Return value	: double - the time in seconds
+************************************************************************/
+static double StatsSeconds();
+
+/*************************************************************************
+Function name	: CountDepths
+Description     : walks the cells of a partition and sets the amount of
+		cells and their max and average depth in the stats
+Paramerters     :part - the partition, stats - the stats to update
+Return value	: none
+************************************************************************/
+static void CountDepths(pPartition part, PartitionStats* stats);
+#endif
+
+/*************************************************************************
+Function name	: BatchDescend
+Description     : processes one pending descent of a batch: the points of
+		a cell are regrouped by quadrant, keeping their order. in every
+		quadrant with no child, the first point adds the child and the
+		following ones descend into it; in every other quadrant the
+		points descend into the existing child. the descents into the
+		children are pushed to the pool. descents of different cells
+		touch disjoint points, so workers run them concurrently.
+Paramerters     :pool - the batch pool, worker - the calling worker,
+		item - the batchItem to process, ctx - the batchPlan
+Return value	: Result - SUCCESS, FAILURE on allocation failure
+************************************************************************/
+static Result BatchDescend(pWorkPool pool, int worker, void* item, void* ctx);
+
+/*************************************************************************
+Function name	: BatchPlanDescents
+Description     : finds for every point of a batch the cell it adds and
+		the parent of that cell, without changing the tree
+Paramerters     :plan - the batch state, n - the number of points
+Return value	: Result - SUCCESS, FAILURE on allocation failure
+************************************************************************/
+static Result BatchPlanDescents(batchPlan* plan, size_t n);
+//////////////////////////////////////////////////////////////////////
 
 
 
@@ -175,7 +886,7 @@ static void getNewSquareBoudaries(BOUNDARY* x_left,
 	BOUNDARY* y_top,
 	COORDINATE x,
 	COORDINATE y,
-	ppartNode pNode) {
+	const partNode* pNode) {
 
 	BOUNDARY x_width = (pNode->x_right - pNode->x_left) ;
 	BOUNDARY y_width = (pNode->y_top - pNode->y_bot);
@@ -200,100 +911,1681 @@ static void getNewSquareBoudaries(BOUNDARY* x_left,
 	}
 }
 
-static int GenerateKey() {
-	static int key = ROOT_KEY;
-	key++;
-	return key; 
+static int GenerateKey(pPartition part) {
+	part->lastKey++;
+	return part->lastKey; 
 }
 
-static Bool IsContained(ppartNode pNode,
+static int ReserveKeys(pPartition part, int count) {
+	int firstKey = part->lastKey + 1;
+	part->lastKey += count;
+	return firstKey;
+}
+
+static int GetQuadrant(const partNode* pNode,
 	COORDINATE x,
 	COORDINATE y) {
-	return (x >= pNode->x_left) &&
-		(x < pNode->x_right) &&
-		(y >= pNode->y_bot) &&
-		(y < pNode->y_top);
+	BOUNDARY x_mid = pNode->x_left + (pNode->x_right - pNode->x_left) / 2;
+	BOUNDARY y_mid = pNode->y_bot + (pNode->y_top - pNode->y_bot) / 2;
+	int quad = 0;
+	if (!(x < x_mid)) quad |= QUAD_RIGHT;
+	if (!(y < y_mid)) quad |= QUAD_TOP;
+	return quad;
 }
 
-static void DelChildArr(ppartNode* ChildpArr) {
+static pPartElem PartitionAddNode(pPartition part,
+	COORDINATE x,
+	COORDINATE y,
+	pPartElem pparentElem,
+	int key) {
+	ppartNode pparentNode = &pparentElem->obj;
+	partNode childNode;
+	getNewSquareBoudaries(&childNode.x_left, &childNode.x_right,
+		&childNode.y_bot, &childNode.y_top, x, y, pparentNode);
+	childNode.key = key;
 	for (int i = 0; i < NUM_CHILDREN; i++) {
-		if (ChildpArr[i] != NULL) {
-			partitionDel(ChildpArr[i]);
+		childNode.quadSlot[i] = NO_CHILD;
+	}
+	childNode.depth = pparentNode->depth + 1;
+	childNode.leaves = 1;
+	//insert new node, the tree keeps a copy of it:
+	int slot = 0;
+	pPartElem pchildElem = PartTreeAddLeaf(part->tree, pparentElem, &childNode, &slot);
+	if (pchildElem == NULL) return NULL;
+	part->locIndexStale = TRUE;
+	if (!part->keyElemsStale && SetKeyElem(part, key, pchildElem) == FAILURE) {
+		part->keyElemsStale = TRUE;
+	}
+	MarkDirty(part, pparentElem);
+	MarkDirty(part, pchildElem);
+	if (part->balanced) PushBalance(part, pchildElem);
+	int quad = GetQuadrant(pparentNode, x, y);
+	if (pparentNode->quadSlot[quad] == NO_CHILD) {//the first child of a quadrant is the one searched
+		TYPEDTREE_PUBLISH(pparentNode->quadSlot[quad], (signed char)slot);//seen by versions
+		//the new cell holds points, and the parent still does unless its last quadrant was refined:
+		if ((pparentElem->parent == NULL && part->buckets == NULL) || HasOpenQuadrant(pparentNode)) {
+			for (pPartElem pElem = pparentElem; pElem != NULL; pElem = pElem->parent) {
+				pElem->obj.leaves++;
+			}
 		}
 	}
-	free(ChildpArr);
+	return pchildElem;
 }
 
-static void PartitionAddNode(COORDINATE x,
-	COORDINATE y,
-	ppartNode pparentNode) {
-	BOUNDARY x_left;
-	BOUNDARY x_right;
-	BOUNDARY y_bot;
-	BOUNDARY y_top;
-	getNewSquareBoudaries(&x_left, &x_right, &y_bot, &y_top, x, y, pparentNode);
-	ppartNode pChildNode = CreatePartNode(x_left, x_right, y_bot, y_top, GenerateKey());
-	if (pChildNode == NULL) return;
-	//insert new node:
-	TreeAddLeaf(pPartTree, partitionGetKey(pparentNode), pChildNode);
-	partitionDel(pChildNode);//the Tree now has a clone of it, so we can delete it
-}
-
-static void RecurRefineCell(COORDINATE x, COORDINATE y, ppartNode curNode){
-	int currKey = partitionGetKey(curNode);
-	Bool isLeaf = FALSE;
-	TreeNodeIsLeaf(pPartTree, currKey, &isLeaf);
-	/*go over children to look for a match to current key.
-		  if found, recurse into this child, else create
-		  new node and insert it in the appropriate place */
-	ppartNode* ChildpArr = (ppartNode*)TreeGetChildren(pPartTree, currKey);
-	if (!isLeaf) {
-		if (ChildpArr == NULL) return;
-		for (int i = 0; i < NUM_CHILDREN; i++) {
-			if (ChildpArr[i] != NULL) {
-				if (IsContained(ChildpArr[i], x, y)) {
-					RecurRefineCell(x, y, ChildpArr[i]);
-					DelChildArr(ChildpArr);
-					return;
-				}
-			}
+static Bool RefinesRoot(pPartition part, COORDINATE x, COORDINATE y) {
+	if (part->buckets != NULL) return FALSE;
+	return !(x < X_RIGHT_INIT && y < Y_TOP_INIT);
+}
+
+static pPartElem FindRefinedElem(pPartition part, COORDINATE x, COORDINATE y, int* depth) {
+	int level = 0;
+	pPartElem pElem = PartTreeRoot(part->tree);
+	if (pElem != NULL && !RefinesRoot(part, x, y)) {
+		const partNode* pNode = &pElem->obj;
+		int slot;
+		while ((slot = pNode->quadSlot[GetQuadrant(pNode, x, y)]) != NO_CHILD) {
+			pElem = pElem->children[slot];
+			pNode = &pElem->obj;
+			level++;
 		}
-		
 	}
-	DelChildArr(ChildpArr);
-	PartitionAddNode(x, y, curNode);
+	if (depth != NULL) *depth = level;
+	return pElem;
 }
 
-/* Refinement function */
-void RefineCell(COORDINATE x, COORDINATE y) {
-	if (x < 0 || x>1 || y < 0 || y>1) return;//boundary check
-	ppartNode prootNode = TreeGetRoot(pPartTree);
-	RecurRefineCell(x,y, prootNode);
-	partitionDel(prootNode);
+Result PartitionRefine(pPartition part, COORDINATE x, COORDINATE y) {
+	if (part == NULL) return FAILURE;
+	STATS_CLOCK_START();
+	Result res = RefinePoint(part, x, y);
+	STATS_CLOCK_STOP(part, refines, 1, refineSeconds);
+	return res;
 }
 
-/* Initialization function */
-void InitPartition() {
-	if (pPartTree != NULL) {//if not first initialization
-		DeletePartition(pPartTree);
+static Result RefinePoint(pPartition part, COORDINATE x, COORDINATE y) {
+	if (x < 0 || x>1 || y < 0 || y>1) return FAILURE;//boundary check
+	if (part->image != NULL && ThawImage(part) == FAILURE) return FAILURE;
+	if (part->lin != NULL) {
+		return LinPartitionRefine(part->lin, x, y);
+	}
+	int depth;
+	pPartElem pElem = FindRefinedElem(part, x, y, &depth);
+	if (pElem == NULL) return FAILURE;
+	Result res;
+	if (part->buckets != NULL) {
+		res = BucketPoint(part, pElem, x, y);
+	}
+	else if (part->maxDepth > 0 && depth >= part->maxDepth) {
+		return FAILURE;//as small as allowed
 	}
-	pPartTree = TreeCreate(partitionGetKey,
-		partitionClone,
-		partitionPrint,
-		partitionDel,
-		NUM_CHILDREN);
-	ppartNode pnewNode = CreatePartNode(X_LEFT_INIT, X_RIGHT_INIT, Y_BOT_INIT, Y_TOP_INIT, ROOT_KEY);
-	if (pnewNode == NULL) return;
-	TreeAddLeaf(pPartTree, -1, pnewNode);//the value -1 is arbitrary and ignored on first addition
-	partitionDel(pnewNode);
+	else {
+		res = (PartitionAddNode(part, x, y, pElem, GenerateKey(part)) != NULL) ? SUCCESS : FAILURE;
+	}
+	//the cells added split their larger neighbors, before the next point:
+	if (part->balanced && BalanceCells(part) == FAILURE) return FAILURE;
+	return res;
 }
 
-/* Printing function */
-void PrintPartition() {
-	TreePrint(pPartTree);
+static Bool CanSplit(pPartition part, const partNode* pNode) {
+	if (part->maxDepth > 0 && pNode->depth >= part->maxDepth) return FALSE;
+	BOUNDARY x_mid = pNode->x_left + (pNode->x_right - pNode->x_left) / 2;
+	BOUNDARY y_mid = pNode->y_bot + (pNode->y_top - pNode->y_bot) / 2;
+	//past about 52 levels the midpoint rounds to an edge:
+	return pNode->x_left < x_mid && x_mid < pNode->x_right &&
+		pNode->y_bot < y_mid && y_mid < pNode->y_top;
+}
+
+static Result BucketPoint(pPartition part, pPartElem pElem, COORDINATE x, COORDINATE y) {
+	int capacity = PointBucketsCapacity(part->buckets);
+	while (TRUE) {
+		if (pElem->childrenCount > 0) {//a split cell - the point opens its quadrant
+			pElem = PartitionAddNode(part, x, y, pElem, GenerateKey(part));
+			if (pElem == NULL) return FAILURE;
+		}
+		if (PointBucketsSize(part->buckets, pElem->obj.key) < capacity || !CanSplit(part, &pElem->obj)) {
+			return PointBucketsAdd(part->buckets, pElem->obj.key, x, y);
+		}
+		if (SplitBucket(part, pElem) == FAILURE) return FAILURE;
+		//go on in the cell of x,y, which may be full again:
+		int slot = pElem->obj.quadSlot[GetQuadrant(&pElem->obj, x, y)];
+		if (slot != NO_CHILD) pElem = pElem->children[slot];
+	}
+}
+
+static Result SplitBucket(pPartition part, pPartElem pElem) {
+	int capacity = PointBucketsCapacity(part->buckets);
+	COORDINATE* xs = part->splitPoints;
+	COORDINATE* ys = part->splitPoints + capacity;
+	int count = PointBucketsTake(part->buckets, pElem->obj.key, xs, ys);
+	for (int i = 0; i < count; i++) {
+		int slot = pElem->obj.quadSlot[GetQuadrant(&pElem->obj, xs[i], ys[i])];
+		pPartElem pChild = (slot != NO_CHILD) ? pElem->children[slot] :
+			PartitionAddNode(part, xs[i], ys[i], pElem, GenerateKey(part));
+		if (pChild == NULL) return FAILURE;
+		if (PointBucketsAdd(part->buckets, pChild->obj.key, xs[i], ys[i]) == FAILURE) return FAILURE;
+	}
+	return SUCCESS;
+}
+
+static void PushBalance(pPartition part, pPartElem pElem) {
+	if (part->balanceCount == part->balanceCapacity) {
+		size_t capacity = (part->balanceCapacity == 0) ? BALANCE_INIT_CAPACITY : 2 * part->balanceCapacity;
+		pPartElem* work = (pPartElem*)realloc(part->balanceWork, capacity * sizeof(pPartElem));
+		if (work == NULL) return;
+		part->balanceWork = work;
+		part->balanceCapacity = capacity;
+	}
+	part->balanceWork[part->balanceCount++] = pElem;
+}
+
+static Result SplitQuadrant(pPartition part, pPartElem pElem, int quad) {
+	if (part->buckets != NULL && pElem->childrenCount == 0 && SplitBucket(part, pElem) == FAILURE) {
+		return FAILURE;
+	}
+	if (pElem->obj.quadSlot[quad] != NO_CHILD) return SUCCESS;//a point of the bucket added it
+	partNode quadNode;
+	GetQuadrantSquare(&pElem->obj, quad, &quadNode);
+	COORDINATE x = quadNode.x_left + (quadNode.x_right - quadNode.x_left) / 2;
+	COORDINATE y = quadNode.y_bot + (quadNode.y_top - quadNode.y_bot) / 2;
+	return (PartitionAddNode(part, x, y, pElem, GenerateKey(part)) != NULL) ? SUCCESS : FAILURE;
+}
+
+static Result BalanceElem(pPartition part, pPartElem pElem) {
+	int depth = pElem->obj.depth - 1;//the largest neighbor allowed
+	for (int side = PARTITION_LEFT; side <= PARTITION_TOP; side++) {
+		int quad;
+		pPartElem pCell;
+		while ((pCell = CellAcross(pElem, (PartitionSide)side, depth, &quad)) != NULL &&
+			pCell->obj.depth < depth) {
+			if (SplitQuadrant(part, pCell, quad) == FAILURE) return FAILURE;
+		}
+	}
+	return SUCCESS;
+}
+
+static Result BalanceCells(pPartition part) {
+	while (part->balanceCount > 0) {
+		pPartElem pElem = part->balanceWork[--part->balanceCount];
+		if (BalanceElem(part, pElem) == FAILURE) {
+			part->balanceCount = 0;
+			return FAILURE;
+		}
+	}
+	return SUCCESS;
+}
+
+Result PartitionBalance(pPartition part) {
+	if (part == NULL) return FAILURE;//input check
+	if (part->lin != NULL) return FAILURE;//keeps no parents
+	if (part->image != NULL && ThawImage(part) == FAILURE) return FAILURE;
+	Bool balanced = part->balanced;
+	part->balanced = TRUE;//the cells added are checked in turn
+	Result res = SUCCESS;
+	pPartElem pRoot = PartTreeRoot(part->tree);
+	for (pPartElem pElem = pRoot; pElem != NULL && res == SUCCESS; pElem = NextElem(pElem, pRoot, LIVE_KEY)) {
+		res = BalanceElem(part, pElem);
+		if (res == SUCCESS) res = BalanceCells(part);
+	}
+	part->balanceCount = 0;
+	part->balanced = balanced;
+	return res;
+}
+
+static Result BatchDescend(pWorkPool pool, int worker, void* pitem, void* ctx) {
+	batchPlan* plan = (batchPlan*)ctx;
+	const batchItem* item = (const batchItem*)pitem;
+	const partNode* pcell = &item->cell;
+	int childCount = (item->elem != NULL) ? item->elem->childrenCount : 0;
+	size_t adder[NUM_CHILDREN];//point adding the child of each quadrant, if it is new
+	size_t groupSize[NUM_CHILDREN] = { 0 };
+	for (int q = 0; q < NUM_CHILDREN; q++) {
+		adder[q] = NO_POINT;
+	}
+	/*go over the points in order. a point adding a cell records its parent,
+	  every other point joins the group of its quadrant */
+	for (size_t i = item->begin; i < item->end; i++) {
+		size_t p = plan->idx[i];
+		int q = GetQuadrant(pcell, plan->xs[p], plan->ys[p]);
+		plan->quad[p] = (unsigned char)q;
+		Bool hasChild = (pcell->quadSlot[q] != NO_CHILD || adder[q] != NO_POINT);
+		if (hasChild && !RefinesRoot(plan->part, plan->xs[p], plan->ys[p])) {
+			groupSize[q]++;
+			continue;
+		}
+		plan->quad[p] = NUM_CHILDREN;//not in a group
+		if (childCount == NUM_CHILDREN) continue;//only the root can be full, see RefinesRoot
+		childCount++;
+		plan->elems[p] = item->elem;
+		plan->parentPoint[p] = item->creator;
+		if (!hasChild) adder[q] = p;
+	}
+	//regroup the points by quadrant, keeping their order:
+	size_t groupStart[NUM_CHILDREN];
+	size_t pos = item->begin;
+	for (int q = 0; q < NUM_CHILDREN; q++) {
+		groupStart[q] = pos;
+		pos += groupSize[q];
+	}
+	size_t fill[NUM_CHILDREN];
+	for (int q = 0; q < NUM_CHILDREN; q++) {
+		fill[q] = groupStart[q];
+	}
+	for (size_t i = item->begin; i < item->end; i++) {
+		size_t p = plan->idx[i];
+		if (plan->quad[p] < NUM_CHILDREN) plan->tmp[fill[plan->quad[p]]++] = p;
+	}
+	for (size_t i = item->begin; i < pos; i++) {
+		plan->idx[i] = plan->tmp[i];
+	}
+	for (int q = 0; q < NUM_CHILDREN; q++) {
+		if (groupSize[q] == 0) continue;
+		batchItem child;
+		child.begin = groupStart[q];
+		child.end = groupStart[q] + groupSize[q];
+		if (pcell->quadSlot[q] != NO_CHILD) {
+			child.elem = item->elem->children[pcell->quadSlot[q]];
+			child.creator = NO_POINT;
+			child.cell = child.elem->obj;
+		}
+		else {
+			child.elem = NULL;
+			child.creator = adder[q];
+			getNewSquareBoudaries(&child.cell.x_left, &child.cell.x_right,
+				&child.cell.y_bot, &child.cell.y_top,
+				plan->xs[adder[q]], plan->ys[adder[q]], pcell);
+			for (int i = 0; i < NUM_CHILDREN; i++) {
+				child.cell.quadSlot[i] = NO_CHILD;
+			}
+		}
+		if (WorkPoolPush(pool, worker, &child) == FAILURE) return FAILURE;
+	}
+	return SUCCESS;
+}
+
+static Result BatchPlanDescents(batchPlan* plan, size_t n) {
+	batchItem root;
+	root.elem = PartTreeRoot(plan->part->tree);
+	if (root.elem == NULL) return FAILURE;
+	root.creator = NO_POINT;
+	root.cell = root.elem->obj;
+	root.begin = 0;
+	root.end = n;
+	return WorkPoolRun(plan->part->batchPool, &root, BatchDescend, plan);
+}
+
+void PartitionRefineBatch(pPartition part, const double* xs, const double* ys, size_t n) {
+	if (part == NULL || xs == NULL || ys == NULL) return;
+	STATS_CLOCK_START();
+	RefinePoints(part, xs, ys, n);
+	//a tree grown by batches is laid out again, unless that has to wait for versions:
+	if (part->autoLayout && part->tree != NULL && PartTreeCount(part->tree) >= LAYOUT_MIN_CELLS &&
+		PartTreeCount(part->tree) / LAYOUT_GROWTH >= part->layoutCount &&
+		VERSIONS_LOAD(&part->versions) == 0) {
+		RelayoutTree(part);
+	}
+	STATS_CLOCK_STOP(part, refines, n, refineSeconds);
+}
+
+static void RefinePoints(pPartition part, const double* xs, const double* ys, size_t n) {
+	if (part->image != NULL && ThawImage(part) == FAILURE) return;
+	if (part->lin != NULL || part->tree == NULL || part->batchPool == NULL ||
+		part->buckets != NULL || part->maxDepth > 0 || part->balanced) {
+		for (size_t i = 0; i < n; i++) {
+			RefinePoint(part, xs[i], ys[i]);
+		}
+		return;
+	}
+	batchPlan plan;
+	plan.part = part;
+	plan.xs = xs;
+	plan.ys = ys;
+	plan.idx = (size_t*)malloc(n * sizeof(size_t));
+	plan.tmp = (size_t*)malloc(n * sizeof(size_t));
+	plan.quad = (unsigned char*)malloc(n);
+	plan.elems = (pPartElem*)malloc(n * sizeof(pPartElem));
+	plan.parentPoint = (size_t*)malloc(n * sizeof(size_t));
+	Bool planned = FALSE;
+	if (plan.idx != NULL && plan.tmp != NULL && plan.quad != NULL &&
+		plan.elems != NULL && plan.parentPoint != NULL) {
+		//points outside the square are ignored, and use up no key:
+		size_t inRange = 0;
+		for (size_t i = 0; i < n; i++) {
+			plan.elems[i] = NULL;
+			plan.parentPoint[i] = NO_POINT;
+			if (xs[i] < 0 || xs[i]>1 || ys[i] < 0 || ys[i]>1) continue;
+			plan.idx[inRange++] = i;
+		}
+		planned = (BatchPlanDescents(&plan, inRange) == SUCCESS);
+		if (planned) {
+			/*add the cells in the original order of the points: a parent is
+			  always added before its children, and siblings and keys come out
+			  as with one RefineCell call per point, whatever the number of
+			  workers that planned the descents */
+			int key = ReserveKeys(part, (int)inRange);
+			for (size_t i = 0, rank = 0; i < n; i++) {
+				if (xs[i] < 0 || xs[i]>1 || ys[i] < 0 || ys[i]>1) continue;
+				pPartElem pparentElem = plan.elems[i];
+				if (plan.parentPoint[i] != NO_POINT) pparentElem = plan.elems[plan.parentPoint[i]];
+				plan.elems[i] = NULL;
+				if (pparentElem != NULL) {
+					plan.elems[i] = PartitionAddNode(part, xs[i], ys[i], pparentElem, key + (int)rank);
+				}
+				rank++;
+			}
+		}
+	}
+	free(plan.idx);
+	free(plan.tmp);
+	free(plan.quad);
+	free(plan.elems);
+	free(plan.parentPoint);
+	if (!planned) {//out of memory - fall back to one point at a time
+		for (size_t i = 0; i < n; i++) {
+			RefinePoint(part, xs[i], ys[i]);
+		}
+	}
+}
+
+static Result InitStorage(pPartition part, const PartitionParams* params) {
+	part->lastKey = ROOT_KEY;
+	part->autoLayout = (params != NULL && params->autoLayout);
+	part->layoutCount = 1;
+	part->locIndexStale = TRUE;
+	part->keyElemsStale = TRUE;
+	MarkAllDirty(part);
+#ifdef TREE_STATS
+	memset(&part->stats, 0, sizeof(PartitionStats));
+#endif
+	//the batch pool and its threads are kept across initializations:
+	int numThreads = (params != NULL && params->numThreads > 1) ? params->numThreads : 1;
+	if (part->batchPool == NULL || part->batchPoolThreads != numThreads) {
+		WorkPoolDestroy(part->batchPool);
+		part->batchPool = WorkPoolCreate(numThreads, sizeof(batchItem));
+		part->batchPoolThreads = numThreads;
+	}
+	Bool linear = (params != NULL && params->backend == PARTITION_BACKEND_LINEAR);
+	int bucketCapacity = (params != NULL && params->bucketCapacity > 0 && !linear) ? params->bucketCapacity : 0;
+	part->maxDepth = (params != NULL && params->maxDepth > 0 && !linear) ? params->maxDepth : 0;
+	part->balanced = (params != NULL && params->balanced && !linear);
+	part->balanceCount = 0;
+	if (part->buckets != NULL && PointBucketsCapacity(part->buckets) != bucketCapacity) {
+		PointBucketsDestroy(part->buckets);
+		part->buckets = NULL;
+		free(part->splitPoints);
+		part->splitPoints = NULL;
+	}
+	PointBucketsClear(part->buckets);
+	if (bucketCapacity > 0 && part->buckets == NULL) {
+		part->buckets = PointBucketsCreate(bucketCapacity);
+		part->splitPoints = (COORDINATE*)malloc(2 * (size_t)bucketCapacity * sizeof(COORDINATE));
+		if (part->buckets == NULL || part->splitPoints == NULL) return FAILURE;
+	}
+	if (linear) {
+		part->lin = LinPartitionCreate();
+		return (part->lin != NULL) ? SUCCESS : FAILURE;
+	}
+	if (part->tree == NULL) part->tree = PartTreeCreate();
+	if (part->tree == NULL) return FAILURE;
+	partNode rootNode = { X_LEFT_INIT, X_RIGHT_INIT, Y_BOT_INIT, Y_TOP_INIT, ROOT_KEY,
+		{ NO_CHILD, NO_CHILD, NO_CHILD, NO_CHILD }, 0, 1 };
+	return (PartTreeAddRoot(part->tree, &rootNode) != NULL) ? SUCCESS : FAILURE;
+}
+
+static void ReleaseStorage(pPartition part) {
+	PartTreeDestroy(part->tree);
+	part->tree = NULL;
+	LinPartitionDestroy(part->lin);
+	part->lin = NULL;
+	SnapImageClose(part->image);
+	part->image = NULL;
+}
+
+pPartition PartitionCreate(const PartitionParams* params) {
+	pPartition part = (pPartition)malloc(sizeof(Partition));
+	if (part == NULL) return NULL;
+	part->tree = NULL;
+	part->lin = NULL;
+	part->batchPool = NULL;
+	part->batchPoolThreads = 0;
+	part->locIndex = NULL;
+	part->printBuffer = NULL;
+	part->image = NULL;
+	part->keyElems = NULL;
+	part->keyElemsCapacity = 0;
+	part->balanceWork = NULL;
+	part->balanceCapacity = 0;
+	part->dirty = NULL;
+	part->dirtyCapacity = 0;
+	part->removedKeys = NULL;
+	part->removedCapacity = 0;
+	part->buckets = NULL;
+	part->splitPoints = NULL;
+	part->versions = 0;
+	if (InitStorage(part, params) == FAILURE) {
+		PartitionDestroy(part);
+		return NULL;
+	}
+	return part;
+}
+
+Result PartitionReset(pPartition part, const PartitionParams* params) {
+	if (part == NULL) return FAILURE;//input check
+	WaitForVersions(part);
+	PartTree* tree = part->tree;
+	part->tree = NULL;
+	ReleaseStorage(part);
+	if (params != NULL && params->backend == PARTITION_BACKEND_LINEAR) {
+		PartTreeDestroy(tree);
+	}
+	else {//the slabs of the old cells hold the new ones
+		PartTreeClear(tree);
+		part->tree = tree;
+	}
+	return InitStorage(part, params);
+}
+
+void PartitionDestroy(pPartition part) {
+	if (part == NULL) return;
+	WaitForVersions(part);
+	ReleaseStorage(part);
+	WorkPoolDestroy(part->batchPool);
+	LocIndexDestroy(part->locIndex);
+	free(part->keyElems);
+	free(part->balanceWork);
+	OutBufferDestroy(part->printBuffer);
+	free(part->dirty);
+	free(part->removedKeys);
+	PointBucketsDestroy(part->buckets);
+	free(part->splitPoints);
+	free(part);
+}
+
+static void SetLocatedCell(PartitionCell* cell, const partNode* pNode, int depth) {
+	cell->x_left = pNode->x_left;
+	cell->x_right = pNode->x_right;
+	cell->y_bot = pNode->y_bot;
+	cell->y_top = pNode->y_top;
+	cell->depth = depth;
+	cell->key = pNode->key;
+}
+
+Result PartitionLocate(pPartition part, COORDINATE x, COORDINATE y, PartitionCell* cell) {
+	if (part == NULL || cell == NULL) return FAILURE;
+	cell->key = PARTITION_NO_KEY;
+	if (x < 0 || x>1 || y < 0 || y>1) return FAILURE;//boundary check
+	if (part->lin != NULL) {
+		return LinPartitionLocate(part->lin, x, y, cell);
+	}
+	if (part->image != NULL) {
+		SNAPRECORD rec;
+		int depth;
+		partNode node;
+		if (ImageLocate(part, x, y, &rec, &depth) == FAILURE) return FAILURE;
+		RecordToNode(&rec, &node);
+		SetLocatedCell(cell, &node, depth);
+		return SUCCESS;
+	}
+	int depth;
+	pPartElem pElem = FindRefinedElem(part, x, y, &depth);
+	if (pElem == NULL) return FAILURE;
+	SetLocatedCell(cell, &pElem->obj, depth);
+	return SUCCESS;
+}
+
+static Result BuildLocIndex(pPartition part) {
+	/*pre order, only the children found through quadSlot - a duplicate
+	  child of the root is never located */
+	if (part->locIndex == NULL) part->locIndex = LocIndexCreate();
+	if (part->locIndex == NULL) return FAILURE;
+	LocIndexClear(part->locIndex);
+	pPartElem pRoot = PartTreeRoot(part->tree);
+	if (pRoot == NULL) return FAILURE;
+	size_t capacity = 64, top = 0;
+	locBuildItem* stack = (locBuildItem*)malloc(capacity * sizeof(locBuildItem));
+	if (stack == NULL) return FAILURE;
+	const partNode* pNode = &pRoot->obj;
+	stack[top].elem = pRoot;
+	stack[top].node = LocIndexAddNode(part->locIndex, LOC_NO_NODE, 0,
+		pNode->x_left + (pNode->x_right - pNode->x_left) / 2,
+		pNode->y_bot + (pNode->y_top - pNode->y_bot) / 2, pNode);
+	if (stack[top].node != LOC_NO_NODE) top++;
+	Result res = (top > 0) ? SUCCESS : FAILURE;
+	while (top > 0 && res == SUCCESS) {
+		locBuildItem item = stack[--top];
+		pNode = &item.elem->obj;
+		for (int q = NUM_CHILDREN - 1; q >= 0; q--) {//quadrant 0 is added first
+			if (pNode->quadSlot[q] == NO_CHILD) continue;
+			if (top == capacity) {
+				locBuildItem* newStack = (locBuildItem*)realloc(stack, 2 * capacity * sizeof(locBuildItem));
+				if (newStack == NULL) {
+					res = FAILURE;
+					break;
+				}
+				stack = newStack;
+				capacity *= 2;
+			}
+			pPartElem pChildElem = item.elem->children[pNode->quadSlot[q]];
+			const partNode* pChild = &pChildElem->obj;
+			stack[top].elem = pChildElem;
+			stack[top].node = LocIndexAddNode(part->locIndex, item.node, q,
+				pChild->x_left + (pChild->x_right - pChild->x_left) / 2,
+				pChild->y_bot + (pChild->y_top - pChild->y_bot) / 2, pChild);
+			if (stack[top].node == LOC_NO_NODE) {
+				res = FAILURE;
+				break;
+			}
+			top++;
+		}
+	}
+	free(stack);
+	part->locIndexStale = (res == FAILURE);
+	return res;
+}
+
+size_t PartitionLocateBatch(pPartition part, const double* xs, const double* ys,
+	size_t n, PartitionCell* cells) {
+	if (part == NULL || xs == NULL || ys == NULL || cells == NULL) return 0;
+	size_t found = 0;
+	if (part->lin != NULL || part->tree == NULL ||
+		(part->locIndexStale && BuildLocIndex(part) == FAILURE)) {
+		for (size_t i = 0; i < n; i++) {
+			if (PartitionLocate(part, xs[i], ys[i], &cells[i]) == SUCCESS) found++;
+		}
+		return found;
+	}
+	//locate a block of points at a time, reusing the node ids in cells:
+	int nodes[LOCATE_BLOCK_SIZE];
+	for (size_t begin = 0; begin < n; begin += LOCATE_BLOCK_SIZE) {
+		size_t count = (n - begin < LOCATE_BLOCK_SIZE) ? n - begin : LOCATE_BLOCK_SIZE;
+		LocIndexFind(part->locIndex, xs + begin, ys + begin, count, nodes);
+		for (size_t j = 0; j < count; j++) {
+			COORDINATE x = xs[begin + j], y = ys[begin + j];
+			PartitionCell* cell = &cells[begin + j];
+			if (x < 0 || x>1 || y < 0 || y>1) {
+				cell->key = PARTITION_NO_KEY;
+				continue;
+			}
+			int node = RefinesRoot(part, x, y) ? 0 : nodes[j];
+			SetLocatedCell(cell, (const partNode*)LocIndexData(part->locIndex, node),
+				LocIndexDepth(part->locIndex, node));
+			found++;
+		}
+	}
+	return found;
+}
+
+static void PrintSquare(const partNode* pNode, pOutBuffer out) {
+	OutBufferPutString(out, "([");
+	OutBufferPutDouble(out, pNode->x_left);
+	OutBufferPutString(out, ", ");
+	OutBufferPutDouble(out, pNode->x_right);
+	OutBufferPutString(out, "], [");
+	OutBufferPutDouble(out, pNode->y_bot);
+	OutBufferPutString(out, ", ");
+	OutBufferPutDouble(out, pNode->y_top);
+	OutBufferPutString(out, "])");
+}
+
+static void PrintElemLine(const PartTreeElem* pElem, Bool withKeys, int lastKey, pOutBuffer out) {
+	if (withKeys) {
+		OutBufferPutInt(out, pElem->obj.key);
+		OutBufferPutString(out, ": ");
+	}
+	PrintSquare(&pElem->obj, out);
+	//children in slot order, as TreePrint does:
+	for (int i = 0; i < NUM_CHILDREN; i++) {
+		pPartElem pChild = ChildAsOf(pElem, i, lastKey);
+		if (pChild == NULL) continue;
+		OutBufferPutChar(out, '\\');
+		PrintSquare(&pChild->obj, out);
+	}
+	OutBufferPutChar(out, '\n');
+}
+
+static void PrintCells(pPartition part, Bool withKeys, pOutBuffer out) {
+	PartTreeIter iter;
+	pPartElem pElem;
+	PartTreeIterBegin(part->tree, &iter);
+	while ((pElem = PartTreeIterNext(&iter)) != NULL) {
+		PrintElemLine(pElem, withKeys, LIVE_KEY, out);
+	}
+	PartTreeIterEnd(&iter);
+}
+
+static pPartElem ChildAsOf(const PartTreeElem* pElem, int slot, int lastKey) {
+	pPartElem pChild = TYPEDTREE_OBSERVE(pElem->children[slot]);
+	return (pChild != NULL && pChild->obj.key <= lastKey) ? pChild : NULL;
+}
+
+static const partNode* NodeAsOf(const PartTreeElem* pElem, int lastKey, partNode* pView) {
+	if (lastKey == LIVE_KEY) return &pElem->obj;
+	//only the fields that never change once the cell is added are copied:
+	pView->x_left = pElem->obj.x_left;
+	pView->x_right = pElem->obj.x_right;
+	pView->y_bot = pElem->obj.y_bot;
+	pView->y_top = pElem->obj.y_top;
+	pView->key = pElem->obj.key;
+	pView->depth = pElem->obj.depth;
+	pView->leaves = 0;
+	for (int q = 0; q < NUM_CHILDREN; q++) {
+		signed char slot = TYPEDTREE_OBSERVE(pElem->obj.quadSlot[q]);
+		pView->quadSlot[q] = (slot != NO_CHILD && ChildAsOf(pElem, slot, lastKey) != NULL) ? slot : NO_CHILD;
+	}
+	return pView;
+}
+
+static Result RelayoutTree(pPartition part) {
+	if (PartTreeCompact(part->tree, part->dirty, part->allDirty ? 0 : part->dirtyCount) == FAILURE) {
+		return FAILURE;
+	}
+	part->layoutCount = PartTreeCount(part->tree);
+	part->locIndexStale = TRUE;//its data are the old elements
+	part->keyElemsStale = TRUE;
+	return SUCCESS;
+}
+
+Result PartitionOptimizeLayout(pPartition part) {
+	if (part == NULL) return FAILURE;//input check
+	if (part->tree == NULL) return SUCCESS;//the linear backend and images are laid out already
+	WaitForVersions(part);//they may be walking the old elements
+	return RelayoutTree(part);
+}
+
+static void WaitForVersions(pPartition part) {
+	while (VERSIONS_LOAD(&part->versions) > 0) {
+		VERSIONS_YIELD();
+	}
+}
+
+static void MarkAllDirty(pPartition part) {
+	part->allDirty = TRUE;
+	part->dirtyCount = 0;
+	part->removedCount = 0;
+}
+
+static void MarkDirty(pPartition part, pPartElem pElem) {
+	if (part->allDirty) return;
+	if (part->dirtyCount >= (size_t)PartTreeCount(part->tree)) {
+		MarkAllDirty(part);
+		return;
+	}
+	if (part->dirtyCount == part->dirtyCapacity) {
+		size_t capacity = (part->dirtyCapacity == 0) ? DIRTY_INIT_CAPACITY : 2 * part->dirtyCapacity;
+		pPartElem* dirty = (pPartElem*)realloc(part->dirty, capacity * sizeof(pPartElem));
+		if (dirty == NULL) {
+			MarkAllDirty(part);
+			return;
+		}
+		part->dirty = dirty;
+		part->dirtyCapacity = capacity;
+	}
+	part->dirty[part->dirtyCount++] = pElem;
+}
+
+static void MarkRemoved(pPartition part, int key) {
+	if (part->allDirty) return;
+	if (part->removedCount >= (size_t)PartTreeCount(part->tree)) {
+		MarkAllDirty(part);
+		return;
+	}
+	if (part->removedCount == part->removedCapacity) {
+		size_t capacity = (part->removedCapacity == 0) ? DIRTY_INIT_CAPACITY : 2 * part->removedCapacity;
+		int* removedKeys = (int*)realloc(part->removedKeys, capacity * sizeof(int));
+		if (removedKeys == NULL) {
+			MarkAllDirty(part);
+			return;
+		}
+		part->removedKeys = removedKeys;
+		part->removedCapacity = capacity;
+	}
+	part->removedKeys[part->removedCount++] = key;
+}
+
+static void DropDirtyBelow(pPartition part, pPartElem pTop) {
+	size_t kept = 0;
+	for (size_t i = 0; i < part->dirtyCount; i++) {
+		pPartElem pElem = part->dirty[i];
+		while (pElem->obj.depth > pTop->obj.depth) pElem = pElem->parent;
+		if (pElem == pTop && part->dirty[i] != pTop) continue;
+		part->dirty[kept++] = part->dirty[i];
+	}
+	part->dirtyCount = kept;
+}
+
+static pPartElem NextElem(pPartElem pElem, pPartElem pTop, int lastKey) {
+	pPartElem pNext;
+	for (int i = 0; i < NUM_CHILDREN; i++) {
+		if ((pNext = ChildAsOf(pElem, i, lastKey)) != NULL) return pNext;
+	}
+	//no children - the next sibling of the closest element that has one:
+	while (pElem != pTop) {
+		pPartElem pParent = pElem->parent;
+		int i = 0;
+		while (TYPEDTREE_OBSERVE(pParent->children[i]) != pElem) i++;
+		for (i++; i < NUM_CHILDREN; i++) {
+			if ((pNext = ChildAsOf(pParent, i, lastKey)) != NULL) return pNext;
+		}
+		pElem = pParent;
+	}
+	return NULL;
+}
+
+static void RemoveChildren(pPartition part, pPartElem pElem) {
+	ppartNode pNode = &pElem->obj;
+	int leavesDelta = 1 - pNode->leaves;//the cell alone holds the points of the subtree
+	DropDirtyBelow(part, pElem);
+	if (!part->allDirty || part->buckets != NULL) {
+		for (pPartElem pBelow = NextElem(pElem, pElem, LIVE_KEY); pBelow != NULL;
+			pBelow = NextElem(pBelow, pElem, LIVE_KEY)) {
+			MarkRemoved(part, pBelow->obj.key);
+			PointBucketsRelease(part->buckets, pBelow->obj.key);
+		}
+	}
+	for (int i = 0; i < NUM_CHILDREN; i++) {
+		if (pElem->children[i] != NULL) PartTreeDelSubtree(part->tree, pElem->children[i]);
+	}
+	for (int q = 0; q < NUM_CHILDREN; q++) {
+		pNode->quadSlot[q] = NO_CHILD;
+	}
+	pNode->leaves = 1;
+	for (pPartElem pAbove = pElem->parent; pAbove != NULL; pAbove = pAbove->parent) {
+		pAbove->obj.leaves += leavesDelta;
+	}
+	part->locIndexStale = TRUE;
+	part->keyElemsStale = TRUE;
+	MarkDirty(part, pElem);
+}
+
+Result PartitionCoarsen(pPartition part, COORDINATE x, COORDINATE y, int depth) {
+	if (part == NULL || depth < 0) return FAILURE;//input check
+	if (x < 0 || x>1 || y < 0 || y>1) return FAILURE;//boundary check
+	if (part->lin != NULL) return FAILURE;//its cells are not removed
+	if (part->image != NULL && ThawImage(part) == FAILURE) return FAILURE;
+	int level;
+	pPartElem pElem = FindRefinedElem(part, x, y, &level);
+	if (pElem == NULL || level < depth) return FAILURE;
+	for (; level > depth; level--) {
+		pElem = pElem->parent;
+	}
+	if (pElem->childrenCount > 0) {
+		WaitForVersions(part);//they may be walking the cells removed
+		RemoveChildren(part, pElem);
+	}
+	return SUCCESS;
+}
+
+static int CompareInts(const void* a, const void* b) {
+	int intA = *(const int*)a;
+	int intB = *(const int*)b;
+	return (intA > intB) - (intA < intB);
+}
+
+static int CompareElemKeys(const void* a, const void* b) {
+	int keyA = (*(const pPartElem*)a)->obj.key;
+	int keyB = (*(const pPartElem*)b)->obj.key;
+	return (keyA > keyB) - (keyA < keyB);
+}
+
+static void PrintDirtyCells(pPartition part, pOutBuffer out) {
+	if (part->removedCount > 0) {
+		qsort(part->removedKeys, part->removedCount, sizeof(int), CompareInts);
+	}
+	for (size_t i = 0; i < part->removedCount; i++) {
+		OutBufferPutInt(out, part->removedKeys[i]);
+		OutBufferPutString(out, ": removed\n");
+	}
+	if (part->dirtyCount == 0) return;
+	//keys are unique, so the repeats of an element end up next to each other:
+	qsort(part->dirty, part->dirtyCount, sizeof(pPartElem), CompareElemKeys);
+	for (size_t i = 0; i < part->dirtyCount; i++) {
+		if (i > 0 && part->dirty[i] == part->dirty[i - 1]) continue;
+		PrintElemLine(part->dirty[i], TRUE, LIVE_KEY, out);
+	}
+}
+
+static void PrintLines(pPartition part, FILE* out, Bool delta) {
+	if (part->printBuffer == NULL) part->printBuffer = OutBufferCreate(OUTBUFFER_DEFAULT_SIZE);
+	if (part->printBuffer == NULL) return;
+	STATS_CLOCK_START();
+	OutBufferBegin(part->printBuffer, out);
+	if (part->lin != NULL) part->allDirty = TRUE;//keeps no changes
+	if (delta && part->allDirty) OutBufferPutString(part->printBuffer, DELTA_RESET_LINE);
+	if (part->image != NULL) {//unchanged since loaded
+		if (!delta || part->allDirty) PrintRecords(part, delta, part->printBuffer);
+	}
+	else if (delta && !part->allDirty) {
+		PrintDirtyCells(part, part->printBuffer);
+	}
+	else if (part->lin != NULL) {
+		LinPartitionPrint(part->lin, delta, part->printBuffer);
+	}
+	else {
+		PrintCells(part, delta, part->printBuffer);
+	}
+	OutBufferEnd(part->printBuffer);
+	part->dirtyCount = 0;
+	part->removedCount = 0;
+	part->allDirty = FALSE;
+	STATS_CLOCK_STOP(part, prints, 1, printSeconds);
+}
+
+void PartitionPrint(pPartition part, FILE* out) {
+	if (part == NULL || out == NULL) return;
+	PrintLines(part, out, FALSE);
+}
+
+void PartitionPrintDelta(pPartition part, FILE* out) {
+	if (part == NULL || out == NULL) return;
+	PrintLines(part, out, TRUE);
+}
+
+static Bool HasOpenQuadrant(const partNode* pNode) {
+	for (int q = 0; q < NUM_CHILDREN; q++) {
+		if (pNode->quadSlot[q] == NO_CHILD) return TRUE;
+	}
+	return FALSE;
+}
+
+static int SubtreeLeaves(const PartTreeElem* pElem, Bool rootHoldsEdges) {
+	const partNode* pNode = &pElem->obj;
+	int leaves = ((pElem->parent == NULL && rootHoldsEdges) || HasOpenQuadrant(pNode)) ? 1 : 0;
+	for (int q = 0; q < NUM_CHILDREN; q++) {
+		if (pNode->quadSlot[q] != NO_CHILD) leaves += pElem->children[(int)pNode->quadSlot[q]]->obj.leaves;
+	}
+	return leaves;
+}
+
+static void GetQuadrantSquare(const partNode* pNode, int quad, partNode* pQuad) {
+	BOUNDARY x_mid = pNode->x_left + (pNode->x_right - pNode->x_left) / 2;
+	BOUNDARY y_mid = pNode->y_bot + (pNode->y_top - pNode->y_bot) / 2;
+	pQuad->x_left = (quad & QUAD_RIGHT) ? x_mid : pNode->x_left;
+	pQuad->x_right = (quad & QUAD_RIGHT) ? pNode->x_right : x_mid;
+	pQuad->y_bot = (quad & QUAD_TOP) ? y_mid : pNode->y_bot;
+	pQuad->y_top = (quad & QUAD_TOP) ? pNode->y_top : y_mid;
+}
+
+static Bool RectOverlaps(const queryRect* rect, const partNode* pNode) {
+	return pNode->x_left <= rect->x1 && rect->x0 < pNode->x_right &&
+		pNode->y_bot <= rect->y1 && rect->y0 < pNode->y_top;
+}
+
+static Bool RectContains(const queryRect* rect, const partNode* pNode) {
+	return rect->x0 <= pNode->x_left && pNode->x_right <= rect->x1 &&
+		rect->y0 <= pNode->y_bot && pNode->y_top <= rect->y1;
+}
+
+static Bool RectReachesEdge(const queryRect* rect) {
+	return rect->x0 <= X_RIGHT_INIT && rect->x1 >= X_LEFT_INIT &&
+		rect->y0 <= Y_TOP_INIT && rect->y1 >= Y_BOT_INIT &&
+		(rect->x1 >= X_RIGHT_INIT || rect->y1 >= Y_TOP_INIT);
+}
+
+static void MoveOffEdges(queryRect* rect, Bool rootHoldsEdges) {
+	if (rootHoldsEdges) return;
+	if (rect->x0 == X_RIGHT_INIT) rect->x0 = nextafter(X_RIGHT_INIT, X_LEFT_INIT);
+	if (rect->y0 == Y_TOP_INIT) rect->y0 = nextafter(Y_TOP_INIT, Y_BOT_INIT);
+}
+
+static Bool HoldsRectPoint(const partNode* pNode, Bool holdsEdges, const queryRect* rect) {
+	if (holdsEdges && RectReachesEdge(rect)) return TRUE;
+	for (int q = 0; q < NUM_CHILDREN; q++) {
+		partNode quad;
+		if (pNode->quadSlot[q] != NO_CHILD) continue;
+		GetQuadrantSquare(pNode, q, &quad);
+		if (RectOverlaps(rect, &quad)) return TRUE;
+	}
+	return FALSE;
+}
+
+static size_t QueryTree(pPartElem pRoot, int lastKey, const queryRect* rect, Bool rootHoldsEdges,
+	PartitionCellFunction func, void* ctx) {
+	pPartElem pElem = pRoot;
+	partNode view;//the node of pElem, for a version
+	size_t found = 0;
+	int q = 0;//the next quadrant of pElem to walk into, 0 when pElem is first reached
+	if (pRoot == NULL) return 0;
+	if (!RectOverlaps(rect, &pRoot->obj) && !(rootHoldsEdges && RectReachesEdge(rect))) return 0;
+	const partNode* pNode = NodeAsOf(pElem, lastKey, &view);
+	while (TRUE) {
+		if (q == 0) {
+			if (func == NULL && lastKey == LIVE_KEY && RectContains(rect, pNode)) {//every cell below holds a point
+				found += (size_t)pNode->leaves;
+				q = NUM_CHILDREN;
+			}
+			else if (HoldsRectPoint(pNode, pElem == pRoot && rootHoldsEdges, rect)) {
+				found++;
+				if (func != NULL) {
+					PartitionCell cell;
+					SetLocatedCell(&cell, pNode, pNode->depth);
+					func(&cell, ctx);
+				}
+			}
+		}
+		for (; q < NUM_CHILDREN; q++) {
+			partNode quad;
+			if (pNode->quadSlot[q] == NO_CHILD) continue;
+			GetQuadrantSquare(pNode, q, &quad);
+			if (RectOverlaps(rect, &quad)) break;
+		}
+		if (q < NUM_CHILDREN) {
+			pElem = TYPEDTREE_OBSERVE(pElem->children[(int)pNode->quadSlot[q]]);
+			pNode = NodeAsOf(pElem, lastKey, &view);
+			q = 0;
+		}
+		else if (pElem == pRoot) {
+			break;
+		}
+		else {//back to the parent, at the quadrant after this cell
+			pPartElem pParent = pElem->parent;
+			pNode = NodeAsOf(pParent, lastKey, &view);
+			q = 0;
+			while (pNode->quadSlot[q] == NO_CHILD ||
+				TYPEDTREE_OBSERVE(pParent->children[(int)pNode->quadSlot[q]]) != pElem) {
+				q++;
+			}
+			q++;
+			pElem = pParent;
+		}
+	}
+	return found;
+}
+
+static size_t QueryRecords(pPartition part, const queryRect* rect, Bool rootHoldsEdges,
+	PartitionCellFunction func, void* ctx) {
+	SNAPRECORD rec;
+	partNode node, quad;
+	size_t capacity = PRINT_STACK_INIT_SIZE;
+	size_t top = 0, found = 0;
+	if (SnapImageRead(part->image, 0, &rec) == FAILURE) return 0;
+	RecordToNode(&rec, &node);
+	if (!RectOverlaps(rect, &node) && !(rootHoldsEdges && RectReachesEdge(rect))) return 0;
+	queryRecordItem* stack = (queryRecordItem*)malloc(capacity * sizeof(queryRecordItem));
+	if (stack == NULL) return 0;
+	stack[top].record = 0;
+	stack[top++].depth = 0;
+	while (top > 0) {
+		queryRecordItem item = stack[--top];
+		if (SnapImageRead(part->image, item.record, &rec) == FAILURE) continue;
+		RecordToNode(&rec, &node);
+		if (HoldsRectPoint(&node, item.record == 0 && rootHoldsEdges, rect)) {
+			found++;
+			if (func != NULL) {
+				PartitionCell cell;
+				SetLocatedCell(&cell, &node, item.depth);
+				func(&cell, ctx);
+			}
+		}
+		if (top + NUM_CHILDREN > capacity) {
+			queryRecordItem* newStack = (queryRecordItem*)realloc(stack, 2 * capacity * sizeof(queryRecordItem));
+			if (newStack == NULL) break;
+			stack = newStack;
+			capacity *= 2;
+		}
+		//pushed last to first, so that the first quadrant is walked first:
+		for (int q = NUM_CHILDREN - 1; q >= 0; q--) {
+			if (node.quadSlot[q] == NO_CHILD) continue;
+			GetQuadrantSquare(&node, q, &quad);
+			if (!RectOverlaps(rect, &quad)) continue;
+			stack[top].record = rec.child[(int)node.quadSlot[q]];
+			stack[top++].depth = item.depth + 1;
+		}
+	}
+	free(stack);
+	return found;
+}
+
+size_t PartitionQueryRect(pPartition part, COORDINATE x0, COORDINATE x1, COORDINATE y0, COORDINATE y1,
+	PartitionCellFunction func, void* ctx) {
+	if (part == NULL) return 0;//input check
+	if (part->lin != NULL) {
+		return LinPartitionQueryRect(part->lin, x0, x1, y0, y1, func, ctx);
+	}
+	if (!(x0 <= x1 && y0 <= y1)) return 0;//an empty rectangle holds no point
+	queryRect rect = { x0, x1, y0, y1 };
+	Bool rootHoldsEdges = (part->buckets == NULL);
+	MoveOffEdges(&rect, rootHoldsEdges);
+	if (part->image != NULL) {
+		return QueryRecords(part, &rect, rootHoldsEdges, func, ctx);
+	}
+	return QueryTree(PartTreeRoot(part->tree), LIVE_KEY, &rect, rootHoldsEdges, func, ctx);
+}
+
+static Result SetKeyElem(pPartition part, int key, pPartElem pElem) {
+	if (key < 0) return FAILURE;//input check
+	if ((size_t)key >= part->keyElemsCapacity) {
+		const size_t maxCapacity = ((size_t)-1) / 2 / sizeof(pPartElem);//so that doubling and sizing can't overflow
+		size_t capacity = (part->keyElemsCapacity == 0) ? KEY_ELEMS_INIT_CAPACITY : 2 * part->keyElemsCapacity;
+		while (capacity <= (size_t)key && capacity <= maxCapacity) capacity *= 2;
+		if (capacity <= (size_t)key) return FAILURE;
+		pPartElem* keyElems = (pPartElem*)realloc(part->keyElems, capacity * sizeof(pPartElem));
+		if (keyElems == NULL) return FAILURE;
+		memset(keyElems + part->keyElemsCapacity, 0, (capacity - part->keyElemsCapacity) * sizeof(pPartElem));
+		part->keyElems = keyElems;
+		part->keyElemsCapacity = capacity;
+	}
+	part->keyElems[key] = pElem;
+	return SUCCESS;
+}
+
+static pPartElem FindKeyElem(pPartition part, int key) {
+	if (part->keyElemsStale) {
+		if (part->keyElems != NULL) memset(part->keyElems, 0, part->keyElemsCapacity * sizeof(pPartElem));
+		pPartElem pRoot = PartTreeRoot(part->tree);
+		for (pPartElem pElem = pRoot; pElem != NULL; pElem = NextElem(pElem, pRoot, LIVE_KEY)) {
+			if (SetKeyElem(part, pElem->obj.key, pElem) == FAILURE) return NULL;
+		}
+		part->keyElemsStale = FALSE;
+	}
+	if (key < 0 || (size_t)key >= part->keyElemsCapacity) return NULL;
+	return part->keyElems[key];
+}
+
+static Bool QuadrantInSpan(const partNode* pNode, int quad, PartitionSide side, BOUNDARY lo, BOUNDARY hi) {
+	partNode quadNode;
+	GetQuadrantSquare(pNode, quad, &quadNode);
+	if (SIDE_AXIS(side) == QUAD_TOP) {//a side along x
+		return quadNode.x_left < hi && lo < quadNode.x_right;
+	}
+	return quadNode.y_bot < hi && lo < quadNode.y_top;
+}
+
+static Bool HoldsSidePoint(const partNode* pNode, PartitionSide side, BOUNDARY lo, BOUNDARY hi) {
+	for (int q = 0; q < NUM_CHILDREN; q++) {
+		if ((q & SIDE_AXIS(side)) != SIDE_BIT(side) || pNode->quadSlot[q] != NO_CHILD) continue;
+		if (QuadrantInSpan(pNode, q, side, lo, hi)) return TRUE;
+	}
+	return FALSE;
+}
+
+static void ReportCell(const partNode* pNode, PartitionCellFunction func, void* ctx) {
+	if (func == NULL) return;
+	PartitionCell cell;
+	SetLocatedCell(&cell, pNode, pNode->depth);
+	func(&cell, ctx);
+}
+
+static size_t EdgeCells(pPartElem pTop, PartitionSide side, BOUNDARY lo, BOUNDARY hi,
+	PartitionCellFunction func, void* ctx) {
+	pPartElem pElem = pTop;
+	size_t found = 0;
+	int q = 0;//the next quadrant of pElem to walk into, 0 when pElem is first reached
+	while (TRUE) {
+		const partNode* pNode = &pElem->obj;
+		if (q == 0 && HoldsSidePoint(pNode, side, lo, hi)) {
+			found++;
+			ReportCell(pNode, func, ctx);
+		}
+		for (; q < NUM_CHILDREN; q++) {
+			if ((q & SIDE_AXIS(side)) != SIDE_BIT(side) || pNode->quadSlot[q] == NO_CHILD) continue;
+			if (QuadrantInSpan(pNode, q, side, lo, hi)) break;
+		}
+		if (q < NUM_CHILDREN) {
+			pElem = pElem->children[(int)pNode->quadSlot[q]];
+			q = 0;
+		}
+		else if (pElem == pTop) {
+			break;
+		}
+		else {//back to the parent, at the quadrant after this cell
+			pPartElem pParent = pElem->parent;
+			q = 0;
+			while (pParent->obj.quadSlot[q] == NO_CHILD ||
+				pParent->children[(int)pParent->obj.quadSlot[q]] != pElem) {
+				q++;
+			}
+			q++;
+			pElem = pParent;
+		}
+	}
+	return found;
+}
+
+static pPartElem CellAcross(pPartElem pElem, PartitionSide side, int depth, int* quad) {
+	int axis = SIDE_AXIS(side);
+	int other = axis ^ (QUAD_RIGHT | QUAD_TOP);
+	pPartElem pCell = pElem;
+	int q;
+	//up to the first cell that pElem is not on that side of:
+	do {
+		pPartElem pParent = pCell->parent;
+		if (pParent == NULL) return NULL;//the side is on the edge of the square
+		q = GetQuadrant(&pParent->obj, pCell->obj.x_left, pCell->obj.y_bot);
+		pCell = pParent;
+	} while ((q & axis) == SIDE_BIT(side));
+	//down its quadrant across the side, then along the side, keeping the other bit of pElem:
+	q = (q & other) | SIDE_BIT(side);
+	while (pCell->obj.depth < depth && pCell->obj.quadSlot[q] != NO_CHILD) {
+		pCell = pCell->children[(int)pCell->obj.quadSlot[q]];
+		q = (GetQuadrant(&pCell->obj, pElem->obj.x_left, pElem->obj.y_bot) & other) |
+			(SIDE_BIT(side) ^ axis);
+	}
+	if (quad != NULL) *quad = q;
+	return pCell;
+}
+
+static size_t OutsideCells(pPartElem pElem, PartitionSide side, BOUNDARY lo, BOUNDARY hi,
+	PartitionCellFunction func, void* ctx) {
+	pPartElem pCell = CellAcross(pElem, side, pElem->obj.depth, NULL);
+	if (pCell == NULL) return 0;//the side is on the edge of the square
+	if (pCell->obj.depth == pElem->obj.depth) {
+		return EdgeCells(pCell, OPPOSITE_SIDE(side), lo, hi, func, ctx);
+	}
+	ReportCell(&pCell->obj, func, ctx);//its open quadrant holds the whole span
+	return 1;
+}
+
+static size_t ElemNeighbors(pPartElem pElem, PartitionSide side,
+	PartitionCellFunction func, void* ctx) {
+	const partNode* pNode = &pElem->obj;
+	int axis = SIDE_AXIS(side);
+	int other = axis ^ (QUAD_RIGHT | QUAD_TOP);
+	Bool alongX = (axis == QUAD_TOP);
+	BOUNDARY mid = alongX ? pNode->x_left + (pNode->x_right - pNode->x_left) / 2 :
+		pNode->y_bot + (pNode->y_top - pNode->y_bot) / 2;
+	BOUNDARY lo = alongX ? pNode->x_left : pNode->y_bot;
+	BOUNDARY hi = alongX ? pNode->x_right : pNode->y_top;
+	size_t found = 0;
+	//the span of the open quadrants on the side, across which are cells outside:
+	Bool lowOpen = (pNode->quadSlot[SIDE_BIT(side)] == NO_CHILD);
+	Bool highOpen = (pNode->quadSlot[SIDE_BIT(side) | other] == NO_CHILD);
+	if (lowOpen || highOpen) {
+		found += OutsideCells(pElem, side, lowOpen ? lo : mid, highOpen ? hi : mid, func, ctx);
+	}
+	//the children next to the open quadrants on the other side:
+	for (int k = 0; k < 2; k++) {
+		int q = (SIDE_BIT(side) ^ axis) | (k * other);
+		int slot = pNode->quadSlot[q ^ axis];
+		if (pNode->quadSlot[q] != NO_CHILD || slot == NO_CHILD) continue;
+		found += EdgeCells(pElem->children[slot], OPPOSITE_SIDE(side), lo, hi, func, ctx);
+	}
+	return found;
+}
+
+static void AdjacentPair(const PartitionCell* cell, void* ctx) {
+	adjacencyCtx* pair = (adjacencyCtx*)ctx;
+	pair->func(&pair->cell, cell, pair->side, pair->ctx);
+}
+
+size_t PartitionNeighbors(pPartition part, int key, PartitionSide side,
+	PartitionCellFunction func, void* ctx) {
+	if (part == NULL || side < PARTITION_LEFT || side > PARTITION_TOP) return 0;//input check
+	if (part->lin != NULL) return 0;//keeps no parents
+	if (part->image != NULL && ThawImage(part) == FAILURE) return 0;
+	pPartElem pElem = FindKeyElem(part, key);
+	if (pElem == NULL) return 0;
+	return ElemNeighbors(pElem, side, func, ctx);
+}
+
+size_t PartitionAdjacency(pPartition part, PartitionAdjacencyFunction func, void* ctx) {
+	if (part == NULL) return 0;//input check
+	if (part->lin != NULL) return 0;//keeps no parents
+	if (part->image != NULL && ThawImage(part) == FAILURE) return 0;
+	//every pair is found from the cell on its left or bottom:
+	static const PartitionSide sides[] = { PARTITION_RIGHT, PARTITION_TOP };
+	adjacencyCtx pair;
+	pair.func = func;
+	pair.ctx = ctx;
+	size_t found = 0;
+	pPartElem pRoot = PartTreeRoot(part->tree);
+	for (pPartElem pElem = pRoot; pElem != NULL; pElem = NextElem(pElem, pRoot, LIVE_KEY)) {
+		SetLocatedCell(&pair.cell, &pElem->obj, pElem->obj.depth);
+		for (int i = 0; i < 2; i++) {
+			pair.side = sides[i];
+			found += ElemNeighbors(pElem, pair.side, (func != NULL) ? AdjacentPair : NULL, &pair);
+		}
+	}
+	return found;
+}
+
+pPartitionVersion PartitionSnapshot(pPartition part) {
+	if (part == NULL || part->lin != NULL) return NULL;//input check
+	if (part->image != NULL && ThawImage(part) == FAILURE) return NULL;
+	pPartElem pRoot = PartTreeRoot(part->tree);
+	if (pRoot == NULL) return NULL;
+	pPartitionVersion version = (pPartitionVersion)malloc(sizeof(PartitionVersion));
+	if (version == NULL) return NULL;
+	version->part = part;
+	version->root = pRoot;
+	version->lastKey = part->lastKey;
+	VERSIONS_ADD(&part->versions, 1);
+	return version;
+}
+
+void PartitionVersionRelease(pPartitionVersion version) {
+	if (version == NULL) return;
+	VERSIONS_ADD(&version->part->versions, -1);
+	free(version);
+}
+
+void PartitionVersionPrint(pPartitionVersion version, FILE* out) {
+	if (version == NULL || out == NULL) return;//input check
+	//a buffer of its own, the partition may be printing meanwhile:
+	pOutBuffer buffer = OutBufferCreate(OUTBUFFER_DEFAULT_SIZE);
+	if (buffer == NULL) return;
+	OutBufferBegin(buffer, out);
+	for (pPartElem pElem = version->root; pElem != NULL;
+		pElem = NextElem(pElem, version->root, version->lastKey)) {
+		PrintElemLine(pElem, FALSE, version->lastKey, buffer);
+	}
+	OutBufferEnd(buffer);
+	OutBufferDestroy(buffer);
+}
+
+Result PartitionVersionLocate(pPartitionVersion version, COORDINATE x, COORDINATE y, PartitionCell* cell) {
+	if (version == NULL || cell == NULL) return FAILURE;
+	cell->key = PARTITION_NO_KEY;
+	if (x < 0 || x>1 || y < 0 || y>1) return FAILURE;//boundary check
+	partNode view;
+	pPartElem pElem = version->root;
+	const partNode* pNode = NodeAsOf(pElem, version->lastKey, &view);
+	int depth = 0;
+	if (!RefinesRoot(version->part, x, y)) {
+		int slot;
+		while ((slot = pNode->quadSlot[GetQuadrant(pNode, x, y)]) != NO_CHILD) {
+			pElem = TYPEDTREE_OBSERVE(pElem->children[slot]);
+			pNode = NodeAsOf(pElem, version->lastKey, &view);
+			depth++;
+		}
+	}
+	SetLocatedCell(cell, pNode, depth);
+	return SUCCESS;
+}
+
+size_t PartitionVersionQueryRect(pPartitionVersion version, COORDINATE x0, COORDINATE x1,
+	COORDINATE y0, COORDINATE y1, PartitionCellFunction func, void* ctx) {
+	if (version == NULL) return 0;//input check
+	if (!(x0 <= x1 && y0 <= y1)) return 0;//an empty rectangle holds no point
+	queryRect rect = { x0, x1, y0, y1 };
+	Bool rootHoldsEdges = (version->part->buckets == NULL);
+	MoveOffEdges(&rect, rootHoldsEdges);
+	return QueryTree(version->root, version->lastKey, &rect, rootHoldsEdges, func, ctx);
+}
+
+Result PartitionGetStats(pPartition part, PartitionStats* stats) {
+	if (part == NULL || stats == NULL) return FAILURE;//input check
+#ifdef TREE_STATS
+	TreeStats treeStats;
+	*stats = part->stats;
+	if (part->tree == NULL || PartTreeGetStats(part->tree, &treeStats) == FAILURE) {
+		memset(&treeStats, 0, sizeof(TreeStats));
+	}
+	stats->lookups = treeStats.lookups;
+	stats->lookupVisits = treeStats.lookupVisits;
+	stats->clones = treeStats.clones;
+	stats->deletes = treeStats.deletes;
+	stats->allocations = treeStats.allocations;
+	stats->allocBytes = treeStats.allocBytes;
+	CountDepths(part, stats);
+	return SUCCESS;
+#else
+	return FAILURE;
+#endif
+}
+
+#ifdef TREE_STATS
+static double StatsSeconds() {
+#ifdef _WIN32
+	return (double)clock() / CLOCKS_PER_SEC;
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+#endif
+}
+
+static void CountDepths(pPartition part, PartitionStats* stats) {
+	unsigned long long depthSum = 0;
+	stats->cells = 0;
+	stats->maxDepth = 0;
+	stats->avgDepth = 0;
+	if (part->lin != NULL) {//its cells keep no depth
+		stats->cells = (unsigned long long)LinPartitionCellsCount(part->lin);
+		return;
+	}
+	if (part->image != NULL) {
+		//a parent comes before its children, as in ThawImage:
+		int count = SnapImageCount(part->image);
+		int* depths = (int*)calloc((size_t)count, sizeof(int));
+		SNAPRECORD rec;
+		if (depths == NULL) return;
+		for (int i = 0; i < count; i++) {
+			if (SnapImageRead(part->image, i, &rec) == FAILURE) continue;
+			for (int j = 0; j < NUM_CHILDREN; j++) {
+				if (rec.child[j] != SNAP_NO_CHILD) depths[rec.child[j]] = depths[i] + 1;
+			}
+			stats->cells++;
+			depthSum += depths[i];
+			if (depths[i] > stats->maxDepth) stats->maxDepth = depths[i];
+		}
+		free(depths);
+	}
+	else {
+		PartTreeIter iter;
+		pPartElem pElem;
+		PartTreeIterBegin(part->tree, &iter);
+		while ((pElem = PartTreeIterNext(&iter)) != NULL) {
+			int depth = pElem->obj.depth;
+			stats->cells++;
+			depthSum += depth;
+			if (depth > stats->maxDepth) stats->maxDepth = depth;
+		}
+		PartTreeIterEnd(&iter);
+	}
+	if (stats->cells > 0) stats->avgDepth = (double)depthSum / (double)stats->cells;
+}
+#endif
+
+static void RecordToNode(const SNAPRECORD* rec, partNode* pNode) {
+	pNode->x_left = rec->x_left;
+	pNode->x_right = rec->x_right;
+	pNode->y_bot = rec->y_bot;
+	pNode->y_top = rec->y_top;
+	pNode->key = rec->key;
+	for (int q = 0; q < NUM_CHILDREN; q++) {
+		pNode->quadSlot[q] = rec->quadSlot[q];
+	}
+	pNode->depth = 0;//the depth and leaves are not saved, ThawImage sets them
+	pNode->leaves = 1;
+}
+
+static Result ImageLocate(pPartition part, COORDINATE x, COORDINATE y,
+	SNAPRECORD* rec, int* depth) {
+	if (SnapImageRead(part->image, 0, rec) == FAILURE) return FAILURE;
+	*depth = 0;
+	if (RefinesRoot(part, x, y)) return SUCCESS;
+	while (TRUE) {
+		partNode node;
+		RecordToNode(rec, &node);
+		int slot = node.quadSlot[GetQuadrant(&node, x, y)];
+		if (slot == NO_CHILD) return SUCCESS;
+		if (SnapImageRead(part->image, rec->child[slot], rec) == FAILURE) return FAILURE;
+		(*depth)++;
+	}
+}
+
+static void PrintRecords(pPartition part, Bool withKeys, pOutBuffer out) {
+	SNAPRECORD rec, childRec;
+	partNode node;
+	size_t capacity = PRINT_STACK_INIT_SIZE;
+	size_t top = 0;
+	int* stack = (int*)malloc(capacity * sizeof(int));
+	if (stack == NULL) return;
+	stack[top++] = 0;
+	while (top > 0) {
+		if (SnapImageRead(part->image, stack[--top], &rec) == FAILURE) continue;
+		RecordToNode(&rec, &node);
+		if (withKeys) {
+			OutBufferPutInt(out, rec.key);
+			OutBufferPutString(out, ": ");
+		}
+		PrintSquare(&node, out);
+		//children in slot order, as PrintCells does:
+		for (int i = 0; i < NUM_CHILDREN; i++) {
+			if (rec.child[i] == SNAP_NO_CHILD) continue;
+			if (SnapImageRead(part->image, rec.child[i], &childRec) == FAILURE) continue;
+			RecordToNode(&childRec, &node);
+			OutBufferPutChar(out, '\\');
+			PrintSquare(&node, out);
+		}
+		OutBufferPutChar(out, '\n');
+		if (top + NUM_CHILDREN > capacity) {
+			int* newStack = (int*)realloc(stack, 2 * capacity * sizeof(int));
+			if (newStack == NULL) break;
+			stack = newStack;
+			capacity *= 2;
+		}
+		//pushed last to first, so that the first child is printed first:
+		for (int i = NUM_CHILDREN - 1; i >= 0; i--) {
+			if (rec.child[i] != SNAP_NO_CHILD) stack[top++] = rec.child[i];
+		}
+	}
+	free(stack);
+}
+
+static Result ThawImage(pPartition part) {
+	int count = SnapImageCount(part->image);
+	PartTree* tree = PartTreeCreate();
+	pPartElem* elems = (pPartElem*)calloc((size_t)count, sizeof(pPartElem));
+	Result res = (tree != NULL && elems != NULL) ? SUCCESS : FAILURE;
+	SNAPRECORD rec, childRec;
+	partNode node;
+	if (res == SUCCESS && SnapImageRead(part->image, 0, &rec) == SUCCESS) {
+		RecordToNode(&rec, &node);
+		elems[0] = PartTreeAddRoot(tree, &node);
+	}
+	//a parent comes before its children, so it is always added first:
+	for (int i = 0; i < count && res == SUCCESS; i++) {
+		if (elems[i] == NULL || SnapImageRead(part->image, i, &rec) == FAILURE) continue;
+		signed char newSlot[NUM_CHILDREN];//the slot of each saved slot in the tree
+		for (int j = 0; j < NUM_CHILDREN; j++) {
+			int slot = NO_CHILD;
+			newSlot[j] = NO_CHILD;
+			if (rec.child[j] == SNAP_NO_CHILD) continue;
+			if (SnapImageRead(part->image, rec.child[j], &childRec) == FAILURE) continue;
+			RecordToNode(&childRec, &node);
+			node.depth = elems[i]->obj.depth + 1;
+			elems[rec.child[j]] = PartTreeAddLeaf(tree, elems[i], &node, &slot);
+			if (elems[rec.child[j]] == NULL) {
+				res = FAILURE;
+				break;
+			}
+			newSlot[j] = (signed char)slot;
+		}
+		ppartNode pNode = &elems[i]->obj;
+		for (int q = 0; q < NUM_CHILDREN; q++) {
+			pNode->quadSlot[q] = (rec.quadSlot[q] == NO_CHILD) ? NO_CHILD : newSlot[(int)rec.quadSlot[q]];
+		}
+	}
+	//children come after their parent, so they are counted first:
+	for (int i = count - 1; i >= 0 && res == SUCCESS; i--) {
+		if (elems[i] != NULL) elems[i]->obj.leaves = SubtreeLeaves(elems[i], part->buckets == NULL);
+	}
+	free(elems);
+	if (res == FAILURE || PartTreeRoot(tree) == NULL) {
+		PartTreeDestroy(tree);
+		return FAILURE;
+	}
+	SnapImageClose(part->image);
+	part->image = NULL;
+	part->tree = tree;
+	part->locIndexStale = TRUE;
+	part->keyElemsStale = TRUE;
+	return SUCCESS;
+}
+
+static Result SaveTree(pPartition part, const char* path) {
+	int count = PartTreeCount(part->tree);
+	pPartElem pRoot = PartTreeRoot(part->tree);
+	if (pRoot == NULL || count < 1) return FAILURE;
+	int* subtreeSize = (int*)malloc((size_t)count * sizeof(int));
+	int* parent = (int*)malloc((size_t)count * sizeof(int));
+	pPartElem* stack = (pPartElem*)malloc((size_t)count * sizeof(pPartElem));
+	int* stackIndex = (int*)malloc((size_t)count * sizeof(int));
+	pSnapWriter writer = NULL;
+	Result res = FAILURE;
+	if (subtreeSize != NULL && parent != NULL && stack != NULL && stackIndex != NULL) {
+		//first walk - number the elements in pre order and size the subtrees:
+		int top = 0, next = 0;
+		stack[top] = pRoot;
+		stackIndex[top++] = -1;//the parent
+		while (top > 0) {
+			pPartElem pElem = stack[--top];
+			int index = next++;
+			parent[index] = stackIndex[top];
+			subtreeSize[index] = 1;
+			for (int i = NUM_CHILDREN - 1; i >= 0; i--) {//slot 0 is walked first
+				pPartElem pChild = pElem->children[i];
+				if (pChild == NULL) continue;
+				stack[top] = pChild;
+				stackIndex[top++] = index;
+			}
+		}
+		for (int i = count - 1; i > 0; i--) {
+			subtreeSize[parent[i]] += subtreeSize[i];
+		}
+		//second walk - the same order, a child follows the subtrees of its older siblings:
+		writer = SnapWriterOpen(path, count, part->lastKey);
+		if (writer != NULL) {
+			top = 0;
+			stack[top] = pRoot;
+			stackIndex[top++] = 0;
+			while (top > 0) {
+				pPartElem pElem = stack[--top];
+				int index = stackIndex[top];
+				const partNode* pNode = &pElem->obj;
+				SNAPRECORD rec;
+				rec.x_left = pNode->x_left;
+				rec.x_right = pNode->x_right;
+				rec.y_bot = pNode->y_bot;
+				rec.y_top = pNode->y_top;
+				rec.key = pNode->key;
+				int childIndex = index + 1;
+				for (int i = 0; i < NUM_CHILDREN; i++) {
+					rec.quadSlot[i] = pNode->quadSlot[i];
+					rec.child[i] = SNAP_NO_CHILD;
+					if (pElem->children[i] == NULL) continue;
+					rec.child[i] = childIndex;
+					childIndex += subtreeSize[childIndex];
+				}
+				SnapWriterPut(writer, &rec);
+				for (int i = NUM_CHILDREN - 1; i >= 0; i--) {
+					if (rec.child[i] == SNAP_NO_CHILD) continue;
+					stack[top] = pElem->children[i];
+					stackIndex[top++] = rec.child[i];
+				}
+			}
+			res = SnapWriterClose(writer);
+		}
+	}
+	free(subtreeSize);
+	free(parent);
+	free(stack);
+	free(stackIndex);
+	return res;
+}
+
+Result PartitionSave(pPartition part, const char* path) {
+	if (part == NULL || path == NULL) return FAILURE;//input check
+	if (part->tree != NULL) return SaveTree(part, path);
+	if (part->image == NULL) return FAILURE;//the linear backend is not saved
+	//an unchanged image is copied record by record:
+	int count = SnapImageCount(part->image);
+	pSnapWriter writer = SnapWriterOpen(path, count, part->lastKey);
+	if (writer == NULL) return FAILURE;
+	for (int i = 0; i < count; i++) {
+		SNAPRECORD rec;
+		if (SnapImageRead(part->image, i, &rec) == FAILURE) break;
+		SnapWriterPut(writer, &rec);
+	}
+	return SnapWriterClose(writer);
+}
+
+Result PartitionLoad(pPartition part, const char* path) {
+	if (part == NULL || path == NULL) return FAILURE;//input check
+	pSnapImage image = SnapImageOpen(path);
+	if (image == NULL) return FAILURE;
+	WaitForVersions(part);
+	ReleaseStorage(part);
+	PointBucketsClear(part->buckets);//the cells of an image hold no points
+	part->image = image;
+	part->lastKey = SnapImageLastKey(image);
+	part->locIndexStale = TRUE;
+	part->keyElemsStale = TRUE;
+	MarkAllDirty(part);
+	return SUCCESS;
+}
+
+/* Initialization function */
+void InitPartition() {
+	InitPartitionEx(NULL);
+}
+
+/* Initialization function with settings */
+void InitPartitionEx(const PartitionParams* params) {
+	if (pDefaultPart == NULL) {//first initialization
+		pDefaultPart = PartitionCreate(params);
+		return;
+	}
+	PartitionReset(pDefaultPart, params);
+}
+
+/* Refinement function */
+void RefineCell(COORDINATE x, COORDINATE y) {
+	PartitionRefine(pDefaultPart, x, y);
+}
+
+/* Batch refinement function */
+void RefineCellBatch(const double* xs, const double* ys, size_t n) {
+	PartitionRefineBatch(pDefaultPart, xs, ys, n);
+}
+
+/* Coarsening function */
+Result CoarsenCell(COORDINATE x, COORDINATE y, int depth) {
+	return PartitionCoarsen(pDefaultPart, x, y, depth);
+}
+
+/* Point location function */
+Result LocateCell(COORDINATE x, COORDINATE y, PartitionCell* cell) {
+	return PartitionLocate(pDefaultPart, x, y, cell);
+}
+
+/* Rectangle query function */
+size_t QueryCells(COORDINATE x0, COORDINATE x1, COORDINATE y0, COORDINATE y1,
+	PartitionCellFunction func, void* ctx) {
+	return PartitionQueryRect(pDefaultPart, x0, x1, y0, y1, func, ctx);
+}
+
+/* Saving function */
+Result SavePartition(const char* path) {
+	return PartitionSave(pDefaultPart, path);
+}
+
+/* Loading function */
+Result LoadPartition(const char* path) {
+	return PartitionLoad(pDefaultPart, path);
+}
+
+/* Printing function */
+void PrintPartition() {
+	PartitionPrint(pDefaultPart, stdout);
+}
+
+/* Delta printing function */
+void PrintPartitionDelta() {
+	PartitionPrintDelta(pDefaultPart, stdout);
+}
+
+/* Neighbor function */
+size_t NeighborCells(int key, PartitionSide side, PartitionCellFunction func, void* ctx) {
+	return PartitionNeighbors(pDefaultPart, key, side, func, ctx);
+}
+
+/* Adjacency function */
+size_t AdjacentCells(PartitionAdjacencyFunction func, void* ctx) {
+	return PartitionAdjacency(pDefaultPart, func, ctx);
+}
+
+/* Balance function */
+Result BalancePartition() {
+	return PartitionBalance(pDefaultPart);
+}
+
+/* Layout function */
+Result OptimizePartitionLayout() {
+	return PartitionOptimizeLayout(pDefaultPart);
+}
+
+/* Snapshot function */
+pPartitionVersion SnapshotPartition() {
+	return PartitionSnapshot(pDefaultPart);
+}
+
+/* Statistics function */
+Result GetPartitionStats(PartitionStats* stats) {
+	return PartitionGetStats(pDefaultPart, stats);
 }
 
 /* Destory function */
 void DeletePartition() {
-	TreeDestroy(pPartTree);
+	PartitionDestroy(pDefaultPart);
+	pDefaultPart = NULL;
 }
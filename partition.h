@@ -1,13 +1,283 @@
 /* Partition Package Interface */
+#ifndef _PARTITION_H_
+#define _PARTITION_H_
+
+#include <stddef.h>
+#include <stdio.h>
+#include "defs.h"
+
+/* Storage backends of a partition */
+typedef enum {
+	PARTITION_BACKEND_TREE,	/* generic tree of cells (default) */
+	PARTITION_BACKEND_LINEAR	/* compact (level, morton code) cells, see linpartition.h */
+} PartitionBackend;
+
+/* Partition settings */
+typedef struct _partition_params {
+	PartitionBackend backend;
+	int numThreads;	/* workers of RefineCellBatch, 1 (or less) for none */
+	int bucketCapacity;	/* 0 (or less) for the default: every point splits its
+				   cell once. n > 0 for buckets: a leaf keeps up to n points,
+				   and one more point splits it into the quadrants of its
+				   points. a point on the top or right edge of the square
+				   then goes to the top or right cells, not the root. tree
+				   backend only */
+	int maxDepth;	/* cells are never split below this depth, 0 (or less)
+				   for no limit. tree backend only */
+	Bool autoLayout;	/* TRUE to lay the cells out again after each batch
+				   that doubled the partition, see PartitionOptimizeLayout */
+	Bool balanced;	/* TRUE to keep the partition 2:1 balanced: every
+				   refinement splits the cells next to the cells it adds
+				   that are more than one level larger, see
+				   PartitionBalance. tree backend only */
+} PartitionParams;
+
+/* A located cell - the smallest cell containing a point, the one that
+   refining the point would split */
+typedef struct _partition_cell {
+	double x_left;
+	double x_right;
+	double y_bot;
+	double y_top;
+	int depth;	/* 0 for the unit square */
+	int key;	/* PARTITION_NO_KEY if the point is outside the square */
+} PartitionCell;
+
+#define PARTITION_NO_KEY (-1)
+
+/* Reporting function of PartitionQueryRect - called once per cell, the
+   cell is valid during the call only */
+typedef void (*PartitionCellFunction)(const PartitionCell* cell, void* ctx);
+
+/* Sides of a cell */
+typedef enum {
+	PARTITION_LEFT,
+	PARTITION_RIGHT,
+	PARTITION_BOTTOM,
+	PARTITION_TOP
+} PartitionSide;
+
+/* Reporting function of PartitionAdjacency - called once per pair of
+   adjacent cells, b on 'side' of a. the cells are valid during the call only */
+typedef void (*PartitionAdjacencyFunction)(const PartitionCell* a, const PartitionCell* b,
+	PartitionSide side, void* ctx);
+
+/* Statistics of a partition, kept only when built with TREE_STATS. the
+   timers count from the creation or last initialization, the tree
+   counters (see TreeStats in gentree.h) from the creation of the current
+   tree, and the cells and depths describe the partition as it is */
+typedef struct _partition_stats {
+	unsigned long long lookups;	/* key lookups of the tree */
+	unsigned long long lookupVisits;	/* slots or elements visited by them */
+	unsigned long long clones;	/* cells copied into the tree */
+	unsigned long long deletes;	/* cells released by the tree */
+	unsigned long long allocations;	/* calls to malloc by the tree */
+	unsigned long long allocBytes;
+	unsigned long long refines;	/* points refined, one by one or in batches */
+	double refineSeconds;
+	unsigned long long prints;
+	double printSeconds;
+	unsigned long long cells;
+	int maxDepth;	/* 0 with the linear backend, which keeps no depth */
+	double avgDepth;
+} PartitionStats;
+
+/* A partition - independent of every other partition, so partitions
+   may be used by different threads at the same time */
+typedef struct _partition Partition, *pPartition;
+
+/* Creation function - a partition holding only the unit square,
+   params is NULL for the defaults. returns NULL on allocation failure */
+pPartition PartitionCreate(const PartitionParams* params);
+
+/* Reset function - a partition holding only the unit square again, with
+   new settings (NULL for the defaults). the memory of the cells is kept
+   for the new ones, and keys start again after the root key. FAILURE on
+   allocation failure */
+Result PartitionReset(pPartition part, const PartitionParams* params);
+
+/* Refinement function - SUCCESS if a cell was added */
+Result PartitionRefine(pPartition part, double x, double y);
+
+/* Batch refinement function - refines the cells of n points, with the
+   same result as calling PartitionRefine on each point in order */
+void PartitionRefineBatch(pPartition part, const double* xs, const double* ys, size_t n);
+
+/* Coarsening function - removes every cell below the cell of depth
+   'depth' that contains x,y, which is left with no children. FAILURE if
+   x,y is not in the square, or its cell is not that deep. the memory of
+   the removed cells is reused, or returned, and the points kept in their
+   buckets are dropped. a balanced partition may be left unbalanced,
+   until PartitionBalance. the linear backend can not be coarsened */
+Result PartitionCoarsen(pPartition part, double x, double y, int depth);
+
+/* Balance function - splits cells until every two cells next to each
+   other, as PartitionNeighbors reports them, differ by at most one level.
+   the cells a split adds are checked in turn, from a work list, so a
+   balanced partition refined by one point is balanced again in time
+   proportional to the cells added. an unbalanced partition, such as a
+   loaded or coarsened one, is walked once. FAILURE on allocation failure,
+   or with the linear backend */
+Result PartitionBalance(pPartition part);
+
+/* Layout function - moves the cells of the tree backend into memory in
+   pre order, so that descents and walks read memory in order again once
+   many refinements or coarsenings have scattered it. with autoLayout set,
+   PartitionRefineBatch does it as well each time the partition doubled
+   since the last layout, unless versions are taken. waits for the
+   versions taken before, as PartitionCoarsen. the linear backend and
+   loaded images are laid out already. FAILURE on allocation failure,
+   leaving the cells in place */
+Result PartitionOptimizeLayout(pPartition part);
+
+/* Point location function - SUCCESS if x,y is in the square */
+Result PartitionLocate(pPartition part, double x, double y, PartitionCell* cell);
+
+/* Batch point location function - locates n points at once, returns the
+   amount of points in the square. builds an index of the partition on
+   the first call after a change, so a partition must not be located
+   from two threads at the same time */
+size_t PartitionLocateBatch(pPartition part, const double* xs, const double* ys,
+	size_t n, PartitionCell* cells);
+
+/* Rectangle query function - reports the cells that hold a point of
+   [x0, x1] x [y0, y1], those that PartitionLocate returns for some point
+   of the rectangle, in pre order, and returns their amount. subtrees out
+   of the rectangle are skipped. with func NULL the cells are only counted,
+   from the amount of cells kept in every subtree of the tree backend */
+size_t PartitionQueryRect(pPartition part, double x0, double x1, double y0, double y1,
+	PartitionCellFunction func, void* ctx);
+
+/* Neighbor function - reports the cells next to the cell of a key on one
+   side: those that PartitionLocate returns for the points just across the
+   part of the side that the cell holds, larger or smaller than the cell.
+   a cell holds the quadrants it has no child in, so the cells of a child
+   next to such a quadrant are its neighbors as well. returns their amount,
+   with func NULL the cells are only counted. found from the parents in
+   O(1) on average, beside the cells reported - the first call after a
+   coarsening, layout or loading indexes the keys first. 0 for an unknown
+   key, a side on the edge of the square, or the linear backend */
+size_t PartitionNeighbors(pPartition part, int key, PartitionSide side,
+	PartitionCellFunction func, void* ctx);
+
+/* Adjacency function - reports every pair of adjacent cells, in one walk
+   linear in the amount of cells: as (a, b, side) with b on the right or
+   top side of a. a cell and a child of it may touch on two sides, and are
+   reported once for each. returns the amount of pairs, with func NULL
+   they are only counted. 0 with the linear backend */
+size_t PartitionAdjacency(pPartition part, PartitionAdjacencyFunction func, void* ctx);
+
+/* Saving function - writes the partition to a binary image file, see
+   snapshot.h. the linear backend can not be saved */
+Result PartitionSave(pPartition part, const char* path);
+
+/* Loading function - replaces the partition by the one saved in a file.
+   the file is mapped and used in place, so locating and printing start
+   at once; the first refinement copies it into a tree */
+Result PartitionLoad(pPartition part, const char* path);
+
+/* Printing function */
+void PartitionPrint(pPartition part, FILE* out);
+
+/* Delta printing function - prints only the lines that changed since the
+   last print, full or delta: "key: removed" for every removed cell, then
+   the line of every added cell and of the cell it was added to or
+   coarsened, each starting with "key: " as a stable id. the first delta
+   print after a creation, initialization or loading, and every delta
+   print with the linear backend, prints a "reset" line followed by every
+   line, which replace all the lines printed before */
+void PartitionPrintDelta(pPartition part, FILE* out);
+
+/* A version of a partition - its cells as they were when taken, which
+   never change. the partition goes on refining while other threads print,
+   locate or query its versions: the cells are shared, and those added
+   later are not seen. coarsening, resetting, loading or destroying the
+   partition waits until every version taken before it is released */
+typedef struct _partition_version PartitionVersion, *pPartitionVersion;
+
+/* Snapshot function - takes a version in O(1), from the thread that
+   changes the partition (a loaded image is first copied into a tree).
+   returns NULL with the linear backend, which keeps no versions, or on
+   allocation failure */
+pPartitionVersion PartitionSnapshot(pPartition part);
+
+/* Version release function - may be called from any thread */
+void PartitionVersionRelease(pPartitionVersion version);
+
+/* Version printing function - prints as PartitionPrint */
+void PartitionVersionPrint(pPartitionVersion version, FILE* out);
+
+/* Version point location function - as PartitionLocate */
+Result PartitionVersionLocate(pPartitionVersion version, double x, double y, PartitionCell* cell);
+
+/* Version rectangle query function - as PartitionQueryRect. the amount
+   of cells kept in a subtree may be newer than the version, so counting
+   walks the cells as well */
+size_t PartitionVersionQueryRect(pPartitionVersion version, double x0, double x1,
+	double y0, double y1, PartitionCellFunction func, void* ctx);
+
+/* Statistics function - FAILURE if built without TREE_STATS */
+Result PartitionGetStats(pPartition part, PartitionStats* stats);
+
+/* Destory function */
+void PartitionDestroy(pPartition part);
+
+/* The functions below work on one global partition */
 
 /* Initialization function */
 void InitPartition();
 
+/* Initialization function with settings, NULL for the defaults */
+void InitPartitionEx(const PartitionParams* params);
+
 /* Refinement function */
 void RefineCell(double x, double y);
 
+/* Batch refinement function - refines the cells of n points, with the
+   same result as calling RefineCell on each point in order */
+void RefineCellBatch(const double* xs, const double* ys, size_t n);
+
+/* Coarsening function */
+Result CoarsenCell(double x, double y, int depth);
+
+/* Balance function */
+Result BalancePartition();
+
+/* Layout function */
+Result OptimizePartitionLayout();
+
+/* Point location function */
+Result LocateCell(double x, double y, PartitionCell* cell);
+
+/* Rectangle query function, func NULL to count the cells */
+size_t QueryCells(double x0, double x1, double y0, double y1,
+	PartitionCellFunction func, void* ctx);
+
+/* Neighbor function, func NULL to count the cells */
+size_t NeighborCells(int key, PartitionSide side, PartitionCellFunction func, void* ctx);
+
+/* Adjacency function, func NULL to count the pairs */
+size_t AdjacentCells(PartitionAdjacencyFunction func, void* ctx);
+
+/* Saving function */
+Result SavePartition(const char* path);
+
+/* Loading function */
+Result LoadPartition(const char* path);
+
 /* Printing function */
 void PrintPartition();
 
+/* Delta printing function */
+void PrintPartitionDelta();
+
+/* Snapshot function, release the version with PartitionVersionRelease */
+pPartitionVersion SnapshotPartition();
+
+/* Statistics function */
+Result GetPartitionStats(PartitionStats* stats);
+
 /* Destory function */
 void DeletePartition();
+
+#endif
@@ -0,0 +1,157 @@
+#include <limits.h>
+#include <stdlib.h>
+
+#include "defs.h"
+#include "pointbuckets.h"
+
+#define NO_BUCKET (-1)
+#define BUCKETS_INIT_CAPACITY 64
+
+/* definition of the buckets - the points of bucket b are
+   coords[2 * capacity * b, 2 * capacity * (b + 1)), as x,y pairs */
+typedef struct _point_buckets {
+  int capacity;
+  int* bucketOfKey;// NO_BUCKET for a key with no bucket
+  size_t keyRoom;
+  double* coords;
+  int* sizes;// points added to each bucket, the next free bucket if released
+  int bucketCount;// buckets made, in use or released
+  int bucketRoom;
+  int freeBucket;// first released bucket, NO_BUCKET if none
+} PointBuckets, *pPointBuckets;
+
+///////////////////  internal static functions ///////////////////////////
+
+/*************************************************************************
+Function name	: GrowKeys
+Description		: makes room for the bucket of 'key', at least doubling
+Paramerters		: buckets - the buckets, key - the key
+Return value	: Result - SUCCESS, FAILURE on allocation failure
+************************************************************************/
+static Result GrowKeys(pPointBuckets buckets, int key);
+
+/*************************************************************************
+Function name	: NewBucket
+Description		: returns an empty bucket, a released one if any
+Paramerters		: buckets - the buckets
+Return value	: int - the bucket, NO_BUCKET on allocation failure
+************************************************************************/
+static int NewBucket(pPointBuckets buckets);
+
+/////////////////////////////////////////////////////////////////////////
+
+static Result GrowKeys(pPointBuckets buckets, int key) {
+	size_t room = (buckets->keyRoom == 0) ? BUCKETS_INIT_CAPACITY : 2 * buckets->keyRoom;
+	while (room <= (size_t)key) room *= 2;
+	int* bucketOfKey = (int*)realloc(buckets->bucketOfKey, room * sizeof(int));
+	if (bucketOfKey == NULL) return FAILURE;
+	for (size_t k = buckets->keyRoom; k < room; k++) {
+		bucketOfKey[k] = NO_BUCKET;
+	}
+	buckets->bucketOfKey = bucketOfKey;
+	buckets->keyRoom = room;
+	return SUCCESS;
+}
+
+static int NewBucket(pPointBuckets buckets) {
+	int bucket = buckets->freeBucket;
+	if (bucket != NO_BUCKET) {
+		buckets->freeBucket = buckets->sizes[bucket];
+		buckets->sizes[bucket] = 0;
+		return bucket;
+	}
+	if (buckets->bucketCount == buckets->bucketRoom) {
+		int room = (buckets->bucketRoom == 0) ? BUCKETS_INIT_CAPACITY : 2 * buckets->bucketRoom;
+		int* sizes = (int*)realloc(buckets->sizes, room * sizeof(int));
+		if (sizes == NULL) return NO_BUCKET;
+		buckets->sizes = sizes;
+		double* coords = (double*)realloc(buckets->coords,
+			(size_t)room * 2 * buckets->capacity * sizeof(double));
+		if (coords == NULL) return NO_BUCKET;
+		buckets->coords = coords;
+		buckets->bucketRoom = room;
+	}
+	bucket = buckets->bucketCount++;
+	buckets->sizes[bucket] = 0;
+	return bucket;
+}
+
+pPointBuckets PointBucketsCreate(int capacity) {
+	if (capacity < 1) return NULL;//input check
+	pPointBuckets buckets = (pPointBuckets)calloc(1, sizeof(PointBuckets));
+	if (buckets == NULL) return NULL;
+	buckets->capacity = capacity;
+	buckets->freeBucket = NO_BUCKET;
+	return buckets;
+}
+
+void PointBucketsDestroy(pPointBuckets buckets) {
+	if (buckets == NULL) return;
+	free(buckets->bucketOfKey);
+	free(buckets->coords);
+	free(buckets->sizes);
+	free(buckets);
+}
+
+void PointBucketsClear(pPointBuckets buckets) {
+	if (buckets == NULL) return;
+	for (size_t k = 0; k < buckets->keyRoom; k++) {
+		buckets->bucketOfKey[k] = NO_BUCKET;
+	}
+	buckets->bucketCount = 0;
+	buckets->freeBucket = NO_BUCKET;
+}
+
+int PointBucketsCapacity(pPointBuckets buckets) {
+	return (buckets != NULL) ? buckets->capacity : 0;
+}
+
+int PointBucketsSize(pPointBuckets buckets, int key) {
+	if (buckets == NULL || key < 0 || (size_t)key >= buckets->keyRoom) return 0;
+	int bucket = buckets->bucketOfKey[key];
+	return (bucket != NO_BUCKET) ? buckets->sizes[bucket] : 0;
+}
+
+Result PointBucketsAdd(pPointBuckets buckets, int key, double x, double y) {
+	if (buckets == NULL || key < 0) return FAILURE;//input check
+	if ((size_t)key >= buckets->keyRoom && GrowKeys(buckets, key) == FAILURE) return FAILURE;
+	int bucket = buckets->bucketOfKey[key];
+	if (bucket == NO_BUCKET) {
+		bucket = NewBucket(buckets);
+		if (bucket == NO_BUCKET) return FAILURE;
+		buckets->bucketOfKey[key] = bucket;
+	}
+	int size = buckets->sizes[bucket];
+	if (size < buckets->capacity) {
+		double* point = buckets->coords + 2 * ((size_t)bucket * buckets->capacity + size);
+		point[0] = x;
+		point[1] = y;
+	}
+	if (size < INT_MAX) buckets->sizes[bucket] = size + 1;
+	return SUCCESS;
+}
+
+int PointBucketsTake(pPointBuckets buckets, int key, double* xs, double* ys) {
+	if (buckets == NULL || xs == NULL || ys == NULL) return 0;//input check
+	if (key < 0 || (size_t)key >= buckets->keyRoom) return 0;
+	int bucket = buckets->bucketOfKey[key];
+	if (bucket == NO_BUCKET) return 0;
+	int count = buckets->sizes[bucket];
+	if (count > buckets->capacity) count = buckets->capacity;
+	const double* point = buckets->coords + 2 * (size_t)bucket * buckets->capacity;
+	for (int i = 0; i < count; i++) {
+		xs[i] = point[2 * i];
+		ys[i] = point[2 * i + 1];
+	}
+	PointBucketsRelease(buckets, key);
+	return count;
+}
+
+void PointBucketsRelease(pPointBuckets buckets, int key) {
+	if (buckets == NULL || key < 0 || (size_t)key >= buckets->keyRoom) return;
+	int bucket = buckets->bucketOfKey[key];
+	if (bucket == NO_BUCKET) return;
+	buckets->bucketOfKey[key] = NO_BUCKET;
+	buckets->sizes[bucket] = buckets->freeBucket;
+	buckets->freeBucket = bucket;
+}
@@ -0,0 +1,87 @@
+#ifndef POINTBUCKETS_H
+#define POINTBUCKETS_H
+
+#include <stddef.h>
+#include "defs.h"
+
+/*
+** Point buckets of the leaf cells of a partition.
+** every key may own one bucket of up to 'capacity' points. a bucket counts
+** every point added to it, but keeps only the first 'capacity' of them -
+** a cell that can not be split any more needs no more. released buckets
+** are reused by the next keys, so the memory of the points follows the
+** amount of leaves, plus one int per key.
+*/
+
+//the buckets data structure:
+typedef struct _point_buckets PointBuckets, *pPointBuckets;
+
+/*************************************************************************
+Function name	: PointBucketsCreate
+Description		: creates an empty set of buckets
+Paramerters		: capacity - the points kept per bucket, at least 1
+Return value	: pPointBuckets - the new buckets, NULL on allocation failure
+************************************************************************/
+pPointBuckets PointBucketsCreate(int capacity);
+
+/*************************************************************************
+Function name	: PointBucketsDestroy
+Description		: frees all memory allocations of the buckets
+Paramerters		: buckets - the buckets
+Return value	: none
+************************************************************************/
+void PointBucketsDestroy(pPointBuckets buckets);
+
+/*************************************************************************
+Function name	: PointBucketsClear
+Description		: releases every bucket, keeping the memory for new ones
+Paramerters		: buckets - the buckets
+Return value	: none
+************************************************************************/
+void PointBucketsClear(pPointBuckets buckets);
+
+/*************************************************************************
+Function name	: PointBucketsCapacity
+Description		: returns the points kept per bucket
+Paramerters		: buckets - the buckets
+Return value	: int - the capacity
+************************************************************************/
+int PointBucketsCapacity(pPointBuckets buckets);
+
+/*************************************************************************
+Function name	: PointBucketsSize
+Description		: returns the amount of points added to the bucket of a key
+Paramerters		: buckets - the buckets, key - the key
+Return value	: int - the points added, 0 if the key has no bucket
+************************************************************************/
+int PointBucketsSize(pPointBuckets buckets, int key);
+
+/*************************************************************************
+Function name	: PointBucketsAdd
+Description		: adds a point to the bucket of a key, creating it if
+				  needed. the point is counted, and kept if the bucket
+				  holds less than 'capacity' points
+Paramerters		: buckets - the buckets, key - a key, 0 or more, x,y - the point
+Return value	: Result - SUCCESS, FAILURE on allocation failure
+************************************************************************/
+Result PointBucketsAdd(pPointBuckets buckets, int key, double x, double y);
+
+/*************************************************************************
+Function name	: PointBucketsTake
+Description		: copies the kept points of the bucket of a key, then
+				  releases the bucket
+Paramerters		: buckets - the buckets, key - the key,
+				  xs,ys - room for 'capacity' points each
+Return value	: int - the amount of points copied
+************************************************************************/
+int PointBucketsTake(pPointBuckets buckets, int key, double* xs, double* ys);
+
+/*************************************************************************
+Function name	: PointBucketsRelease
+Description		: drops the points of the bucket of a key, if it has one
+Paramerters		: buckets - the buckets, key - the key
+Return value	: none
+************************************************************************/
+void PointBucketsRelease(pPointBuckets buckets, int key);
+
+#endif
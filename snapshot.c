@@ -0,0 +1,389 @@
+#if !defined(_WIN32) && !defined(SNAP_NO_MMAP)
+#define _POSIX_C_SOURCE 200809L//fileno, mmap
+#define SNAP_MMAP
+#endif
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "defs.h"
+#include "snapshot.h"
+
+#ifdef SNAP_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif
+
+#define SNAP_MAGIC "QTPARTIM"
+#define SNAP_MAGIC_SIZE 8
+#define SNAP_HEADER_SIZE 64
+#define SNAP_RECORD_SIZE 64
+#define SNAP_WRITE_BUFFER (1 << 20)
+#define SNAP_TMP_SUFFIX ".tmp"
+//header fields:
+#define HDR_VERSION 8
+#define HDR_HEADER_SIZE 12
+#define HDR_RECORD_SIZE 16
+#define HDR_CHILDREN 20
+#define HDR_COUNT 24
+#define HDR_LAST_KEY 32
+//record fields:
+#define REC_X_LEFT 0
+#define REC_X_RIGHT 8
+#define REC_Y_BOT 16
+#define REC_Y_TOP 24
+#define REC_KEY 32
+#define REC_CHILD 36
+#define REC_QUAD_SLOT 52
+
+/* definition of an open image */
+typedef struct _snap_image {
+  const unsigned char* records;
+  int count;
+  int lastKey;
+  void* data;// the whole file
+  size_t size;
+  Bool mapped;// data is mapped, else it was read into memory
+} SnapImage, *pSnapImage;
+
+/* definition of an image being written */
+typedef struct _snap_writer {
+  FILE* file;
+  char* path;
+  char* tmpPath;// the file written, renamed to path when closed
+  int count;// promised to SnapWriterOpen
+  int written;
+  Bool failed;
+} SnapWriter, *pSnapWriter;
+
+///////////////////  internal static functions ///////////////////////////
+
+/*************************************************************************
+Function name	: GetU32
+Description		: decodes a little endian 32 bit number
+Paramerters		: p - its bytes
+Return value	: unsigned long - the number
+************************************************************************/
+static unsigned long GetU32(const unsigned char* p);
+
+/*************************************************************************
+Function name	: GetU64
+Description		: decodes a little endian 64 bit number
+Paramerters		: p - its bytes
+Return value	: unsigned long long - the number
+************************************************************************/
+static unsigned long long GetU64(const unsigned char* p);
+
+/*************************************************************************
+Function name	: GetI32
+Description		: decodes a little endian 32 bit two's complement number
+Paramerters		: p - its bytes
+Return value	: int - the number
+************************************************************************/
+static int GetI32(const unsigned char* p);
+
+/*************************************************************************
+Function name	: PutU32
+Description		: encodes a 32 bit number, little endian
+Paramerters		: p - updated with its bytes, value - the number
+Return value	: none
+************************************************************************/
+static void PutU32(unsigned char* p, unsigned long value);
+
+/*************************************************************************
+Function name	: PutU64
+Description		: encodes a 64 bit number, little endian
+Paramerters		: p - updated with its bytes, value - the number
+Return value	: none
+************************************************************************/
+static void PutU64(unsigned char* p, unsigned long long value);
+
+/*************************************************************************
+Function name	: GetDouble
+Description		: decodes a little endian IEEE double
+Paramerters		: p - its bytes
+Return value	: double - the number
+************************************************************************/
+static double GetDouble(const unsigned char* p);
+
+/*************************************************************************
+Function name	: PutDouble
+Description		: encodes an IEEE double, little endian
+Paramerters		: p - updated with its bytes, value - the number
+Return value	: none
+************************************************************************/
+static void PutDouble(unsigned char* p, double value);
+
+/*************************************************************************
+Function name	: LoadFile
+Description		: maps a file, or else reads it into memory
+Paramerters		: path - the file, image - updated with data, size
+				  and mapped
+Return value	: Result - SUCCESS, FAILURE if the file could not be read
+************************************************************************/
+static Result LoadFile(const char* path, pSnapImage image);
+
+/*************************************************************************
+Function name	: CheckKeys
+Description		: checks that the keys of the records are distinct and in
+				  [0, lastKey], so that the keys given after loading are
+				  new ones
+Paramerters		: image - an image with records, count and lastKey set
+Return value	: Result - SUCCESS, FAILURE if they are not, or on
+				  allocation failure
+************************************************************************/
+static Result CheckKeys(pSnapImage image);
+
+/////////////////////////////////////////////////////////////////////////
+
+static unsigned long GetU32(const unsigned char* p) {
+	return (unsigned long)p[0] | ((unsigned long)p[1] << 8) |
+		((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+static int GetI32(const unsigned char* p) {
+	unsigned long value = GetU32(p);
+	if (value & 0x80000000UL) return (int)((long)(value - 0x80000000UL) - 0x7FFFFFFFL - 1);
+	return (int)value;
+}
+
+static unsigned long long GetU64(const unsigned char* p) {
+	return (unsigned long long)GetU32(p) | ((unsigned long long)GetU32(p + 4) << 32);
+}
+
+static void PutU32(unsigned char* p, unsigned long value) {
+	for (int i = 0; i < 4; i++) {
+		p[i] = (unsigned char)(value >> (8 * i));
+	}
+}
+
+static void PutU64(unsigned char* p, unsigned long long value) {
+	PutU32(p, (unsigned long)(value & 0xFFFFFFFFUL));
+	PutU32(p + 4, (unsigned long)(value >> 32));
+}
+
+static double GetDouble(const unsigned char* p) {
+	unsigned long long bits = GetU64(p);
+	double value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+static void PutDouble(unsigned char* p, double value) {
+	unsigned long long bits;
+	memcpy(&bits, &value, sizeof(bits));
+	PutU64(p, bits);
+}
+
+static Result LoadFile(const char* path, pSnapImage image) {
+	FILE* file = fopen(path, "rb");
+	if (file == NULL) return FAILURE;
+#ifdef SNAP_MMAP
+	struct stat st;
+	if (fstat(fileno(file), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+		void* map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+		if (map != MAP_FAILED) {
+			fclose(file);//the mapping stays valid
+			image->data = map;
+			image->size = (size_t)st.st_size;
+			image->mapped = TRUE;
+			return SUCCESS;
+		}
+	}
+#endif
+	//no mapping - read the file into one block:
+	size_t capacity = SNAP_HEADER_SIZE, size = 0;
+	unsigned char* data = (unsigned char*)malloc(capacity);
+	while (data != NULL) {
+		size += fread(data + size, 1, capacity - size, file);
+		if (size < capacity) break;
+		unsigned char* bigger = (unsigned char*)realloc(data, 2 * capacity);
+		if (bigger == NULL) {
+			free(data);
+			data = NULL;
+			break;
+		}
+		data = bigger;
+		capacity *= 2;
+	}
+	Bool failed = (data == NULL || ferror(file));
+	fclose(file);
+	if (failed) {
+		free(data);
+		return FAILURE;
+	}
+	image->data = data;
+	image->size = size;
+	image->mapped = FALSE;
+	return SUCCESS;
+}
+
+static Result CheckKeys(pSnapImage image) {
+	if (image->lastKey < 0) return FAILURE;
+	//one bit per key up to lastKey, set once its record is seen:
+	unsigned char* seen = (unsigned char*)calloc((size_t)image->lastKey / 8 + 1, 1);
+	if (seen == NULL) return FAILURE;
+	Result res = SUCCESS;
+	for (int i = 0; i < image->count && res == SUCCESS; i++) {
+		int key = GetI32(image->records + (size_t)i * SNAP_RECORD_SIZE + REC_KEY);
+		if (key < 0 || key > image->lastKey || (seen[key / 8] & (1 << (key % 8)))) {
+			res = FAILURE;
+			continue;
+		}
+		seen[key / 8] |= (unsigned char)(1 << (key % 8));
+	}
+	free(seen);
+	return res;
+}
+
+pSnapImage SnapImageOpen(const char* path) {
+	if (path == NULL) return NULL;//input check
+	pSnapImage image = (pSnapImage)malloc(sizeof(SnapImage));
+	if (image == NULL) return NULL;
+	if (LoadFile(path, image) == FAILURE) {
+		free(image);
+		return NULL;
+	}
+	const unsigned char* header = (const unsigned char*)image->data;
+	unsigned long long count = 0;
+	Bool valid = (image->size >= SNAP_HEADER_SIZE &&
+		memcmp(header, SNAP_MAGIC, SNAP_MAGIC_SIZE) == 0 &&
+		GetU32(header + HDR_VERSION) == SNAP_VERSION &&
+		GetU32(header + HDR_HEADER_SIZE) == SNAP_HEADER_SIZE &&
+		GetU32(header + HDR_RECORD_SIZE) == SNAP_RECORD_SIZE &&
+		GetU32(header + HDR_CHILDREN) == SNAP_CHILDREN);
+	if (valid) {
+		count = GetU64(header + HDR_COUNT);
+		valid = (count >= 1 && count <= INT_MAX &&
+			count <= (image->size - SNAP_HEADER_SIZE) / SNAP_RECORD_SIZE);
+	}
+	if (valid) {
+		image->records = header + SNAP_HEADER_SIZE;
+		image->count = (int)count;
+		image->lastKey = GetI32(header + HDR_LAST_KEY);
+		valid = (CheckKeys(image) == SUCCESS);
+	}
+	if (!valid) {
+		SnapImageClose(image);
+		return NULL;
+	}
+	return image;
+}
+
+void SnapImageClose(pSnapImage image) {
+	if (image == NULL) return;
+#ifdef SNAP_MMAP
+	if (image->mapped) {
+		munmap(image->data, image->size);
+		free(image);
+		return;
+	}
+#endif
+	free(image->data);
+	free(image);
+}
+
+int SnapImageCount(pSnapImage image) {
+	if (image == NULL) return 0;
+	return image->count;
+}
+
+int SnapImageLastKey(pSnapImage image) {
+	if (image == NULL) return 0;
+	return image->lastKey;
+}
+
+Result SnapImageRead(pSnapImage image, int index, PSNAPRECORD rec) {
+	if (image == NULL || rec == NULL || index < 0 || index >= image->count) return FAILURE;//input check
+	const unsigned char* p = image->records + (size_t)index * SNAP_RECORD_SIZE;
+	rec->x_left = GetDouble(p + REC_X_LEFT);
+	rec->x_right = GetDouble(p + REC_X_RIGHT);
+	rec->y_bot = GetDouble(p + REC_Y_BOT);
+	rec->y_top = GetDouble(p + REC_Y_TOP);
+	rec->key = GetI32(p + REC_KEY);
+	for (int i = 0; i < SNAP_CHILDREN; i++) {
+		rec->child[i] = GetI32(p + REC_CHILD + 4 * i);
+		if (rec->child[i] != SNAP_NO_CHILD && (rec->child[i] <= index || rec->child[i] >= image->count)) {
+			return FAILURE;
+		}
+	}
+	for (int q = 0; q < SNAP_CHILDREN; q++) {
+		rec->quadSlot[q] = (signed char)p[REC_QUAD_SLOT + q];
+		if (rec->quadSlot[q] == SNAP_NO_CHILD) continue;
+		if (rec->quadSlot[q] < 0 || rec->quadSlot[q] >= SNAP_CHILDREN ||
+			rec->child[(int)rec->quadSlot[q]] == SNAP_NO_CHILD) {
+			return FAILURE;
+		}
+	}
+	return SUCCESS;
+}
+
+pSnapWriter SnapWriterOpen(const char* path, int count, int lastKey) {
+	if (path == NULL || count < 1) return NULL;//input check
+	pSnapWriter writer = (pSnapWriter)malloc(sizeof(SnapWriter));
+	if (writer == NULL) return NULL;
+	size_t len = strlen(path);
+	writer->path = (char*)malloc(len + 1);
+	writer->tmpPath = (char*)malloc(len + sizeof(SNAP_TMP_SUFFIX));
+	writer->file = NULL;
+	if (writer->path != NULL && writer->tmpPath != NULL) {
+		memcpy(writer->path, path, len + 1);
+		memcpy(writer->tmpPath, path, len);
+		memcpy(writer->tmpPath + len, SNAP_TMP_SUFFIX, sizeof(SNAP_TMP_SUFFIX));
+		writer->file = fopen(writer->tmpPath, "wb");
+	}
+	if (writer->file == NULL) {
+		free(writer->path);
+		free(writer->tmpPath);
+		free(writer);
+		return NULL;
+	}
+	setvbuf(writer->file, NULL, _IOFBF, SNAP_WRITE_BUFFER);
+	writer->count = count;
+	writer->written = 0;
+	unsigned char header[SNAP_HEADER_SIZE] = { 0 };
+	memcpy(header, SNAP_MAGIC, SNAP_MAGIC_SIZE);
+	PutU32(header + HDR_VERSION, SNAP_VERSION);
+	PutU32(header + HDR_HEADER_SIZE, SNAP_HEADER_SIZE);
+	PutU32(header + HDR_RECORD_SIZE, SNAP_RECORD_SIZE);
+	PutU32(header + HDR_CHILDREN, SNAP_CHILDREN);
+	PutU64(header + HDR_COUNT, (unsigned long long)count);
+	PutU32(header + HDR_LAST_KEY, (unsigned long)lastKey);
+	writer->failed = (fwrite(header, 1, SNAP_HEADER_SIZE, writer->file) != SNAP_HEADER_SIZE);
+	return writer;
+}
+
+void SnapWriterPut(pSnapWriter writer, const SNAPRECORD* rec) {
+	if (writer == NULL || rec == NULL) return;
+	unsigned char record[SNAP_RECORD_SIZE] = { 0 };
+	PutDouble(record + REC_X_LEFT, rec->x_left);
+	PutDouble(record + REC_X_RIGHT, rec->x_right);
+	PutDouble(record + REC_Y_BOT, rec->y_bot);
+	PutDouble(record + REC_Y_TOP, rec->y_top);
+	PutU32(record + REC_KEY, (unsigned long)rec->key);
+	for (int i = 0; i < SNAP_CHILDREN; i++) {
+		PutU32(record + REC_CHILD + 4 * i, (unsigned long)rec->child[i]);
+		record[REC_QUAD_SLOT + i] = (unsigned char)rec->quadSlot[i];
+	}
+	if (fwrite(record, 1, SNAP_RECORD_SIZE, writer->file) != SNAP_RECORD_SIZE) writer->failed = TRUE;
+	writer->written++;
+}
+
+Result SnapWriterClose(pSnapWriter writer) {
+	if (writer == NULL) return FAILURE;
+	Bool failed = writer->failed || writer->written != writer->count;
+	if (fclose(writer->file) != 0) failed = TRUE;
+#ifdef _WIN32
+	if (!failed) remove(writer->path);//rename does not replace a file
+#endif
+	//the old file is replaced at once, an image mapped from it stays valid:
+	if (!failed && rename(writer->tmpPath, writer->path) != 0) failed = TRUE;
+	if (failed) remove(writer->tmpPath);
+	free(writer->path);
+	free(writer->tmpPath);
+	free(writer);
+	return failed ? FAILURE : SUCCESS;
+}
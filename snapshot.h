@@ -0,0 +1,120 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "defs.h"
+
+/*
+** Binary partition images.
+** an image is a 64 byte header followed by one 64 byte record per cell, in
+** pre order - the root is record 0 and every child comes after its parent.
+** all fields are little endian, whatever the host:
+**
+**  header: 0 magic "QTPARTIM", 8 version, 12 header size, 16 record size,
+**          20 children per cell, 24 record count (64 bit), 32 last key,
+**          36..63 zero
+**  record: 0 x_left, 8 x_right, 16 y_bot, 24 y_top (IEEE doubles),
+**          32 key, 36 record index of the child in each of the 4 tree
+**          slots (-1 if none), 52 tree slot of the child in each of the 4
+**          quadrants (one signed byte each, -1 if none), 56..63 zero
+**
+** an image is opened by mapping the file, where mmap exists, and records
+** are decoded on access - opening only reads the keys, to check them.
+*/
+
+#define SNAP_VERSION 1
+#define SNAP_CHILDREN 4
+#define SNAP_NO_CHILD (-1)
+
+/* definition of a decoded record */
+typedef struct _snap_record {
+  double x_left;
+  double x_right;
+  double y_bot;
+  double y_top;
+  int key;
+  int child[SNAP_CHILDREN];// record of the child in each tree slot
+  signed char quadSlot[SNAP_CHILDREN];// tree slot of the child in each quadrant
+} SNAPRECORD, *PSNAPRECORD;
+
+//an open image:
+typedef struct _snap_image SnapImage, *pSnapImage;
+//an image being written:
+typedef struct _snap_writer SnapWriter, *pSnapWriter;
+
+/*************************************************************************
+Function name	: SnapImageOpen
+Description		: opens an image file and checks its header, and that
+				  the keys of its records are distinct and no larger
+				  than its last key
+Paramerters		: path - the file
+Return value	: pSnapImage - the image, NULL if the file could not be
+				  read or is not a valid image
+************************************************************************/
+pSnapImage SnapImageOpen(const char* path);
+
+/*************************************************************************
+Function name	: SnapImageClose
+Description		: unmaps the image and frees it
+Paramerters		: image - the image
+Return value	: none
+************************************************************************/
+void SnapImageClose(pSnapImage image);
+
+/*************************************************************************
+Function name	: SnapImageCount
+Description		: returns the amount of records of an image
+Paramerters		: image - the image
+Return value	: int - the amount of records, at least 1
+************************************************************************/
+int SnapImageCount(pSnapImage image);
+
+/*************************************************************************
+Function name	: SnapImageLastKey
+Description		: returns the last key used by the saved partition
+Paramerters		: image - the image
+Return value	: int - the key
+************************************************************************/
+int SnapImageLastKey(pSnapImage image);
+
+/*************************************************************************
+Function name	: SnapImageRead
+Description		: decodes a record. a record whose children are not all
+				  after it, or whose quadrants name an empty slot, is
+				  rejected - so walking an image always ends.
+Paramerters		: image - the image, index - the record,
+				  rec - updated with the record
+Return value	: Result - SUCCESS, FAILURE if the record is not valid
+************************************************************************/
+Result SnapImageRead(pSnapImage image, int index, PSNAPRECORD rec);
+
+/*************************************************************************
+Function name	: SnapWriterOpen
+Description		: creates an image file and writes its header. the
+				  records go to path.tmp, which replaces path when the
+				  writer is closed - so an image open on path stays valid,
+				  and a failed write leaves path as it was
+Paramerters		: path - the file, count - the amount of records that
+				  will be written, lastKey - the last key used
+Return value	: pSnapWriter - the writer, NULL on failure
+************************************************************************/
+pSnapWriter SnapWriterOpen(const char* path, int count, int lastKey);
+
+/*************************************************************************
+Function name	: SnapWriterPut
+Description		: writes the next record
+Paramerters		: writer - the writer, rec - the record
+Return value	: none
+************************************************************************/
+void SnapWriterPut(pSnapWriter writer, const SNAPRECORD* rec);
+
+/*************************************************************************
+Function name	: SnapWriterClose
+Description		: closes the file, renames it to the path of the image,
+				  and frees the writer
+Paramerters		: writer - the writer
+Return value	: Result - SUCCESS if every record promised to
+				  SnapWriterOpen was written, FAILURE otherwise
+************************************************************************/
+Result SnapWriterClose(pSnapWriter writer);
+
+#endif
@@ -0,0 +1,173 @@
+/*
+** Bucket mode edge test.
+** with buckets the top and right edges of the square belong to the edge
+** cells, not to the root. checks that rectangle queries touching those
+** edges report the cells that PartitionLocate returns there, and that
+** counting them (from the leaves of the subtrees) agrees with walking
+** them - on the tree, on a loaded image, and on the tree thawed from it.
+** prints "ok" and returns 0, or prints the failures and returns 1.
+**
+** build (from the repository root):
+**   gcc -std=c99 -O2 -pthread -I. tests/bucketedge.c partition.c gentree.c \
+**       linpartition.c workpool.c locindex.c outbuffer.c snapshot.c \
+**       pointbuckets.c -o bucketedge -lm
+** run:
+**   ./bucketedge [image path]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "partition.h"
+
+#define NUM_POINTS 20000
+#define BUCKET_CAPACITY 4
+#define EDGE_SAMPLES 1024
+#define MAX_REPORTED 4096
+#define DEFAULT_IMAGE_PATH "bucketedge.img"
+
+/* the cells reported by a query */
+typedef struct _reported {
+	int keys[MAX_REPORTED];
+	int count;
+} Reported;
+
+//the cells of the last query:
+static Reported reported;
+
+/*************************************************************************
+Function name	: AddReported
+Description		: records a cell reported by PartitionQueryRect
+Paramerters		: cell - the cell, ctx - the Reported
+Return value	: none
+************************************************************************/
+static void AddReported(const PartitionCell* cell, void* ctx);
+
+/*************************************************************************
+Function name	: HasKey
+Description		: checks if a key was reported
+Paramerters		: key - the key
+Return value	: int - 1 if it was, 0 otherwise
+************************************************************************/
+static int HasKey(int key);
+
+/*************************************************************************
+Function name	: CheckRect
+Description		: queries a rectangle on the top or right edge, or both,
+				  and checks the cells against PartitionLocate along it
+Paramerters		: part - the partition, what - printed on failure,
+				  x0, x1, y0, y1 - the rectangle, with x0 == x1 == 1 or
+				  y0 == y1 == 1
+Return value	: int - the amount of failures
+************************************************************************/
+static int CheckRect(pPartition part, const char* what, double x0, double x1, double y0, double y1);
+
+/*************************************************************************
+Function name	: CheckPartition
+Description		: checks the corner, the edges and the whole square
+Paramerters		: part - the partition, what - printed on failure
+Return value	: int - the amount of failures
+************************************************************************/
+static int CheckPartition(pPartition part, const char* what);
+
+/////////////////////////////////////////////////////////////////////////
+
+static void AddReported(const PartitionCell* cell, void* ctx) {
+	Reported* reported = (Reported*)ctx;
+	if (reported->count < MAX_REPORTED) reported->keys[reported->count] = cell->key;
+	reported->count++;
+}
+
+static int HasKey(int key) {
+	for (int i = 0; i < reported.count && i < MAX_REPORTED; i++) {
+		if (reported.keys[i] == key) return 1;
+	}
+	return 0;
+}
+
+static int CheckRect(pPartition part, const char* what, double x0, double x1, double y0, double y1) {
+	int failures = 0;
+	reported.count = 0;
+	size_t found = PartitionQueryRect(part, x0, x1, y0, y1, AddReported, &reported);
+	size_t counted = PartitionQueryRect(part, x0, x1, y0, y1, NULL, NULL);
+	if (found != (size_t)reported.count || counted != found) {
+		printf("%s [%g, %g] x [%g, %g]: %lu cells reported, %lu counted\n", what,
+			x0, x1, y0, y1, (unsigned long)found, (unsigned long)counted);
+		failures++;
+	}
+	//every point of the rectangle is in a reported cell:
+	int located = 0;
+	for (int i = 0; i <= EDGE_SAMPLES; i++) {
+		double t = (double)i / EDGE_SAMPLES;
+		double x = (x0 == x1) ? x0 : x0 + (x1 - x0) * t;
+		double y = (y0 == y1) ? y0 : y0 + (y1 - y0) * t;
+		PartitionCell cell;
+		if (PartitionLocate(part, x, y, &cell) == FAILURE) continue;
+		if (!HasKey(cell.key)) {
+			printf("%s: cell %d of %g,%g not reported\n", what, cell.key, x, y);
+			failures++;
+		}
+		located++;
+	}
+	//the root holds no point of the edges:
+	for (int i = 0; i < reported.count && i < MAX_REPORTED; i++) {
+		if (reported.keys[i] == 0) {
+			printf("%s [%g, %g] x [%g, %g]: the root is reported\n", what, x0, x1, y0, y1);
+			failures++;
+		}
+	}
+	if (located == 0) {
+		printf("%s: no point of [%g, %g] x [%g, %g] located\n", what, x0, x1, y0, y1);
+		failures++;
+	}
+	return failures;
+}
+
+static int CheckPartition(pPartition part, const char* what) {
+	int failures = 0;
+	failures += CheckRect(part, what, 1.0, 1.0, 1.0, 1.0);
+	failures += CheckRect(part, what, 0.0, 1.0, 1.0, 1.0);
+	failures += CheckRect(part, what, 1.0, 1.0, 0.0, 1.0);
+	failures += CheckRect(part, what, 0.5, 1.0, 1.0, 1.0);
+	reported.count = 0;
+	size_t found = PartitionQueryRect(part, 0.0, 1.0, 0.0, 1.0, AddReported, &reported);
+	size_t counted = PartitionQueryRect(part, 0.0, 1.0, 0.0, 1.0, NULL, NULL);
+	if (found != counted) {
+		printf("%s: the square has %lu cells reported, %lu counted\n", what,
+			(unsigned long)found, (unsigned long)counted);
+		failures++;
+	}
+	return failures;
+}
+
+int main(int argc, char* argv[])
+{
+	const char* path = (argc > 1) ? argv[1] : DEFAULT_IMAGE_PATH;
+	PartitionParams params = { PARTITION_BACKEND_TREE };//the settings not set here are off
+	params.numThreads = 1;
+	params.bucketCapacity = BUCKET_CAPACITY;
+	pPartition part = PartitionCreate(&params);
+	if (part == NULL) return 1;
+	srand(4);
+	for (int i = 0; i < NUM_POINTS; i++) {
+		PartitionRefine(part, rand() / (double)RAND_MAX, rand() / (double)RAND_MAX);
+	}
+	//points on the edges go to the edge cells:
+	for (int i = 0; i <= 64; i++) {
+		PartitionRefine(part, 1.0, i / 64.0);
+		PartitionRefine(part, i / 64.0, 1.0);
+	}
+	int failures = CheckPartition(part, "tree");
+	if (PartitionSave(part, path) == SUCCESS && PartitionLoad(part, path) == SUCCESS) {
+		failures += CheckPartition(part, "image");
+		PartitionRefine(part, 1.0, 1.0);//thaws the image
+		failures += CheckPartition(part, "thawed tree");
+	}
+	else {
+		printf("failed to save or load %s\n", path);
+		failures++;
+	}
+	remove(path);
+	PartitionDestroy(part);
+	if (failures == 0) printf("ok\n");
+	return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,495 @@
+#ifndef TYPEDTREE_H
+#define TYPEDTREE_H
+
+#include <stdlib.h>
+#include <string.h>
+#include "defs.h"
+#include "gentree.h"
+
+/*
+** Type specialized tree.
+** DEFINE_GENTREE(name, T, K, KEY) defines a tree of nodes of type T, with
+** at most K children per node, as a set of static inline functions whose
+** names start with 'name'. KEY(p) returns the int key of the node
+** pointed to by p (a const T*), and may be a macro.
+**
+** differences from the generic tree of gentree.h:
+**  - a node is stored inside its element and copied by assignment, so T
+**    must not own memory - there are no clone, print or delete functions.
+**  - K is a compile time constant, the children are a fixed array.
+**  - elements are public: walk the tree through e->obj, e->children[slot],
+**    e->childrenCount and e->parent, with no function calls.
+**  - keys are extracted inline, but there is no key index: nameFind
+**    searches the tree. keep element pointers to reach nodes fast.
+**  - elements are allocated in slabs, and the tree is freed slab by slab.
+**    deleted elements are reused first; once more elements are free than
+**    live (and a slab more), the slabs left with no live element are
+**    returned to the allocator. a trim walks every slab, so the next one
+**    waits for a quarter as many deletions: an amortized O(1) per deletion.
+**  - nameClear empties a tree but keeps its slabs for the next elements,
+**    with no call to the allocator.
+**  - nameCompact moves the elements into new slabs in pre-order, so that
+**    walks and descents read memory in order after many insertions and
+**    deletions have scattered them.
+**  - nameIterBegin/Next/End walk in pre-order only.
+**  - a new element is fully set before nameAddLeaf stores it in its
+**    parent (TYPEDTREE_PUBLISH), so another thread that reads the slot
+**    with TYPEDTREE_OBSERVE may walk into it while the tree grows. a tree
+**    that deletes or clears must not be read meanwhile.
+** built with TREE_STATS, a tree keeps the counters of TreeStats.
+*/
+
+#define TYPEDTREE_SLAB_BYTES 65536
+#define TYPEDTREE_ITER_INIT_CAPACITY 32
+//childrenCount of a deleted element:
+#define TYPEDTREE_FREE_ELEM (-1)
+
+//stores and loads of a slot (or any field) read by other threads while it is set:
+#if defined(__GNUC__)
+#define TYPEDTREE_PUBLISH(dst, v) __atomic_store_n(&(dst), (v), __ATOMIC_RELEASE)
+#define TYPEDTREE_OBSERVE(src) __atomic_load_n(&(src), __ATOMIC_ACQUIRE)
+#else
+#define TYPEDTREE_PUBLISH(dst, v) ((dst) = (v))
+#define TYPEDTREE_OBSERVE(src) (src)
+#endif
+
+#ifdef TREE_STATS
+#define TYPEDTREE_STATS_FIELD TreeStats stats;
+#define TYPEDTREE_STAT_ADD(tree, field, value) ((tree)->stats.field += (value))
+#define TYPEDTREE_STATS_GET(tree, pStats) (*(pStats) = (tree)->stats, SUCCESS)
+#define TYPEDTREE_STATS_RESET(tree) memset(&(tree)->stats, 0, sizeof(TreeStats))
+#else
+#define TYPEDTREE_STATS_FIELD
+#define TYPEDTREE_STAT_ADD(tree, field, value) ((void)0)
+#define TYPEDTREE_STATS_GET(tree, pStats) ((void)(pStats), FAILURE)
+#define TYPEDTREE_STATS_RESET(tree) ((void)0)
+#endif
+
+//elements in a slab of a tree of element type E, at least 1:
+#define TYPEDTREE_SLAB_ELEMS(E) \
+	((TYPEDTREE_SLAB_BYTES - sizeof(void*)) / sizeof(E) > 0 ? \
+	(TYPEDTREE_SLAB_BYTES - sizeof(void*)) / sizeof(E) : 1)
+
+/*************************************************************************
+ the functions defined for a tree 'name' (pointers are named
+ name* for the tree and nameElem* for an element):
+
+Function name	: nameCreate
+Description		: creates an empty tree
+Return value	: name* - the new tree, NULL on allocation failure
+
+Function name	: nameDestroy
+Description		: frees the tree and all its elements
+
+Function name	: nameClear
+Description		: removes every element and resets the counters, keeping
+				  the slabs for the next elements. walks the slabs once,
+				  not the elements
+
+Function name	: nameRoot
+Description		: returns the root element, NULL if the tree is empty or NULL
+
+Function name	: nameCount
+Description		: returns the amount of nodes, -1 if the tree is NULL
+
+Function name	: nameAddRoot
+Description		: adds the root of an empty tree, a copy of *obj
+Return value	: nameElem* - the root, NULL if the tree has a root or on
+				  allocation failure
+
+Function name	: nameAddLeaf
+Description		: adds a copy of *obj in the first free slot of parent
+Paramerters		: slot - if not NULL, updated with the slot of the new leaf
+Return value	: nameElem* - the new element, NULL if parent has K
+				  children or on allocation failure
+
+Function name	: nameDelLeaf
+Description		: removes an element with no children
+Return value	: Result - SUCCESS, FAILURE if the element has children
+
+Function name	: nameDelSubtree
+Description		: removes an element and every element below it, walking
+				  down to a leaf and back up through the parents, with no stack
+Return value	: int - the amount of elements removed
+
+Function name	: nameTrim
+Description		: returns the slabs that hold no live element, and the
+				  slabs kept by nameClear, to the allocator - done by
+				  nameDelLeaf when enough are free
+
+Function name	: nameCompact
+Description		: moves every element into new slabs, in pre-order and
+				  in the same slots, then frees the old slabs. element
+				  pointers held outside the tree become invalid, except
+				  those passed in 'held', which are moved with them
+Paramerters		: held - live elements of the tree, may be NULL,
+				  heldCount - the amount of held elements
+Return value	: Result - SUCCESS, FAILURE on allocation failure, when
+				  the tree is left as it was
+
+Function name	: nameFind
+Description		: finds the first element in pre-order whose key is 'key'
+Return value	: nameElem* - the element, NULL if not found
+
+Function name	: nameGetStats
+Description		: as TreeGetStats
+Return value	: Result - SUCCESS, FAILURE if built without TREE_STATS
+
+Function name	: nameIterBegin, nameIterNext, nameIterEnd
+Description		: as TreeIterBegin, TreeIterNext and TreeIterEnd of
+				  gentree.h, in pre-order, with a nameIter iterator
+************************************************************************/
+#define DEFINE_GENTREE(name, T, K, KEY) \
+\
+typedef struct name##Elem { \
+	T obj; \
+	struct name##Elem* parent; \
+	struct name##Elem* children[K]; \
+	int childrenCount; \
+} name##Elem; \
+\
+typedef struct name##Slab { \
+	struct name##Slab* next; \
+	name##Elem elems[TYPEDTREE_SLAB_ELEMS(name##Elem)]; \
+} name##Slab; \
+\
+typedef struct name { \
+	name##Elem* root; \
+	int count; \
+	name##Slab* slabs;/* most recent first */ \
+	size_t slabUsed;/* elements taken from the most recent slab */ \
+	name##Slab* spareSlabs;/* emptied by nameClear, used before new ones */ \
+	name##Elem* freeElems;/* deleted elements, linked through parent */ \
+	int freeCount; \
+	int trimCountdown;/* deletions before nameDelLeaf may call nameTrim */ \
+	TYPEDTREE_STATS_FIELD \
+} name; \
+\
+typedef struct name##Iter { \
+	name##Elem** items; \
+	size_t count; \
+	size_t capacity; \
+	Bool failed; \
+} name##Iter; \
+\
+static inline name* name##Create(void) { \
+	name* tree = (name*)calloc(1, sizeof(name)); \
+	return tree; \
+} \
+\
+static inline void name##FreeSlabs(name##Slab* slab) { \
+	while (slab != NULL) { \
+		name##Slab* next = slab->next; \
+		free(slab); \
+		slab = next; \
+	} \
+} \
+\
+static inline void name##Destroy(name* tree) { \
+	if (tree == NULL) return; \
+	name##FreeSlabs(tree->slabs); \
+	name##FreeSlabs(tree->spareSlabs); \
+	free(tree); \
+} \
+\
+static inline void name##Clear(name* tree) { \
+	if (tree == NULL) return; \
+	if (tree->slabs != NULL) { \
+		name##Slab* last = tree->slabs; \
+		while (last->next != NULL) last = last->next; \
+		last->next = tree->spareSlabs; \
+		tree->spareSlabs = tree->slabs; \
+	} \
+	tree->root = NULL; \
+	tree->count = 0; \
+	tree->slabs = NULL; \
+	tree->slabUsed = 0; \
+	tree->freeElems = NULL; \
+	tree->freeCount = 0; \
+	tree->trimCountdown = 0; \
+	TYPEDTREE_STATS_RESET(tree); \
+} \
+\
+static inline name##Elem* name##Root(const name* tree) { \
+	return (tree != NULL) ? tree->root : NULL; \
+} \
+\
+static inline int name##Count(const name* tree) { \
+	return (tree != NULL) ? tree->count : -1; \
+} \
+\
+static inline name##Elem* name##NewElem(name* tree, const T* obj, name##Elem* parent) { \
+	name##Elem* elem = tree->freeElems; \
+	if (elem != NULL) { \
+		tree->freeElems = elem->parent; \
+		tree->freeCount--; \
+	} \
+	else { \
+		if (tree->slabs == NULL || tree->slabUsed == TYPEDTREE_SLAB_ELEMS(name##Elem)) { \
+			name##Slab* slab = tree->spareSlabs; \
+			if (slab != NULL) { \
+				tree->spareSlabs = slab->next; \
+			} \
+			else { \
+				slab = (name##Slab*)malloc(sizeof(name##Slab)); \
+				if (slab == NULL) return NULL; \
+				TYPEDTREE_STAT_ADD(tree, allocations, 1); \
+				TYPEDTREE_STAT_ADD(tree, allocBytes, sizeof(name##Slab)); \
+			} \
+			slab->next = tree->slabs; \
+			tree->slabs = slab; \
+			tree->slabUsed = 0; \
+		} \
+		elem = &tree->slabs->elems[tree->slabUsed++]; \
+	} \
+	TYPEDTREE_STAT_ADD(tree, clones, 1); \
+	elem->obj = *obj; \
+	elem->parent = parent; \
+	for (int i = 0; i < (K); i++) { \
+		elem->children[i] = NULL; \
+	} \
+	elem->childrenCount = 0; \
+	tree->count++; \
+	return elem; \
+} \
+\
+static inline name##Elem* name##AddRoot(name* tree, const T* obj) { \
+	if (tree == NULL || obj == NULL || tree->root != NULL) return NULL; \
+	tree->root = name##NewElem(tree, obj, NULL); \
+	return tree->root; \
+} \
+\
+static inline name##Elem* name##AddLeaf(name* tree, name##Elem* parent, const T* obj, int* slot) { \
+	if (tree == NULL || parent == NULL || obj == NULL) return NULL; \
+	if (parent->childrenCount == (K)) return NULL; \
+	name##Elem* elem = name##NewElem(tree, obj, parent); \
+	if (elem == NULL) return NULL; \
+	for (int i = 0; i < (K); i++) {/* the first free slot */ \
+		if (parent->children[i] == NULL) { \
+			TYPEDTREE_PUBLISH(parent->children[i], elem); \
+			if (slot != NULL) *slot = i; \
+			break; \
+		} \
+	} \
+	parent->childrenCount++; \
+	return elem; \
+} \
+\
+static inline void name##Trim(name* tree) { \
+	name##Slab** link; \
+	size_t used; \
+	if (tree == NULL) return; \
+	name##FreeSlabs(tree->spareSlabs); \
+	tree->spareSlabs = NULL; \
+	link = &tree->slabs; \
+	used = tree->slabUsed;/* the most recent slab is filled up to slabUsed, the others are full */ \
+	tree->freeElems = NULL; \
+	tree->freeCount = 0; \
+	while (*link != NULL) { \
+		name##Slab* slab = *link; \
+		size_t freeInSlab = 0; \
+		for (size_t i = 0; i < used; i++) { \
+			if (slab->elems[i].childrenCount == TYPEDTREE_FREE_ELEM) freeInSlab++; \
+		} \
+		if (freeInSlab == used) { \
+			if (slab == tree->slabs) tree->slabUsed = TYPEDTREE_SLAB_ELEMS(name##Elem); \
+			*link = slab->next; \
+			free(slab); \
+		} \
+		else { \
+			for (size_t i = 0; i < used; i++) { \
+				if (slab->elems[i].childrenCount != TYPEDTREE_FREE_ELEM) continue; \
+				slab->elems[i].parent = tree->freeElems; \
+				tree->freeElems = &slab->elems[i]; \
+				tree->freeCount++; \
+			} \
+			link = &slab->next; \
+		} \
+		used = TYPEDTREE_SLAB_ELEMS(name##Elem); \
+	} \
+	tree->trimCountdown = (tree->count + tree->freeCount) / 4; \
+} \
+\
+static inline Result name##DelLeaf(name* tree, name##Elem* elem) { \
+	if (tree == NULL || elem == NULL || elem->childrenCount > 0) return FAILURE; \
+	if (elem->parent == NULL) { \
+		tree->root = NULL; \
+	} \
+	else { \
+		for (int i = 0; i < (K); i++) { \
+			if (elem->parent->children[i] == elem) { \
+				elem->parent->children[i] = NULL; \
+				break; \
+			} \
+		} \
+		elem->parent->childrenCount--; \
+	} \
+	TYPEDTREE_STAT_ADD(tree, deletes, 1); \
+	elem->childrenCount = TYPEDTREE_FREE_ELEM; \
+	elem->parent = tree->freeElems; \
+	tree->freeElems = elem; \
+	tree->freeCount++; \
+	tree->count--; \
+	if (--tree->trimCountdown <= 0 && \
+		tree->freeCount > tree->count + (int)TYPEDTREE_SLAB_ELEMS(name##Elem)) { \
+		name##Trim(tree); \
+	} \
+	return SUCCESS; \
+} \
+\
+static inline int name##DelSubtree(name* tree, name##Elem* top) { \
+	name##Elem* elem = top; \
+	int removed = 0; \
+	if (tree == NULL || top == NULL) return 0; \
+	while (1) { \
+		if (elem->childrenCount > 0) { \
+			int i = 0; \
+			while (elem->children[i] == NULL) i++; \
+			elem = elem->children[i]; \
+			continue; \
+		} \
+		name##Elem* parent = elem->parent; \
+		int last = (elem == top); \
+		name##DelLeaf(tree, elem); \
+		removed++; \
+		if (last) return removed; \
+		elem = parent; \
+	} \
+} \
+\
+static inline Result name##Compact(name* tree, name##Elem** held, size_t heldCount) { \
+	name old; \
+	name##Elem* from; \
+	name##Elem* to; \
+	size_t slabCount; \
+	if (tree == NULL) return FAILURE; \
+	if (tree->root == NULL) return SUCCESS; \
+	old = *tree; \
+	/* every slab is taken first, so the copy can not fail half way: */ \
+	slabCount = ((size_t)old.count + TYPEDTREE_SLAB_ELEMS(name##Elem) - 1) / TYPEDTREE_SLAB_ELEMS(name##Elem); \
+	tree->spareSlabs = NULL; \
+	for (size_t i = 0; i < slabCount; i++) { \
+		name##Slab* slab = old.spareSlabs; \
+		if (slab != NULL) { \
+			old.spareSlabs = slab->next; \
+		} \
+		else { \
+			slab = (name##Slab*)malloc(sizeof(name##Slab)); \
+			if (slab == NULL) { \
+				name##FreeSlabs(tree->spareSlabs); \
+				tree->spareSlabs = old.spareSlabs; \
+				return FAILURE; \
+			} \
+			TYPEDTREE_STAT_ADD(tree, allocations, 1); \
+			TYPEDTREE_STAT_ADD(tree, allocBytes, sizeof(name##Slab)); \
+		} \
+		slab->next = tree->spareSlabs; \
+		tree->spareSlabs = slab; \
+	} \
+	name##FreeSlabs(old.spareSlabs); \
+	tree->root = NULL; \
+	tree->count = 0; \
+	tree->slabs = NULL; \
+	tree->slabUsed = 0; \
+	tree->freeElems = NULL; \
+	tree->freeCount = 0; \
+	tree->trimCountdown = 0; \
+	/* walks both trees at once, with no stack. an old element is left \
+	   through its parent, which then forwards it to its copy: */ \
+	from = old.root; \
+	to = tree->root = name##NewElem(tree, &from->obj, NULL); \
+	while (1) { \
+		int i = 0; \
+		while (i < (K) && from->children[i] == NULL) i++; \
+		while (i == (K) && from != old.root) {/* back up to the next sibling */ \
+			name##Elem* parent = from->parent; \
+			for (i = 0; parent->children[i] != from; i++) {} \
+			from->parent = to; \
+			for (i++; i < (K) && parent->children[i] == NULL; i++) {} \
+			from = parent; \
+			to = to->parent; \
+		} \
+		if (i == (K)) break; \
+		name##Elem* child = name##NewElem(tree, &from->children[i]->obj, to); \
+		to->children[i] = child; \
+		to->childrenCount++; \
+		from = from->children[i]; \
+		to = child; \
+	} \
+	old.root->parent = tree->root; \
+	for (size_t i = 0; i < heldCount; i++) { \
+		if (held[i] != NULL) held[i] = held[i]->parent; \
+	} \
+	name##FreeSlabs(old.slabs); \
+	return SUCCESS; \
+} \
+\
+static inline Result name##IterBegin(name* tree, name##Iter* iter) { \
+	if (iter == NULL) return FAILURE; \
+	iter->items = NULL; \
+	iter->count = 0; \
+	iter->capacity = 0; \
+	iter->failed = FALSE; \
+	if (tree == NULL) return FAILURE; \
+	if (tree->root == NULL) return SUCCESS; \
+	iter->items = (name##Elem**)malloc(TYPEDTREE_ITER_INIT_CAPACITY * sizeof(name##Elem*)); \
+	if (iter->items == NULL) { \
+		iter->failed = TRUE; \
+		return FAILURE; \
+	} \
+	iter->capacity = TYPEDTREE_ITER_INIT_CAPACITY; \
+	iter->items[iter->count++] = tree->root; \
+	return SUCCESS; \
+} \
+\
+static inline name##Elem* name##IterNext(name##Iter* iter) { \
+	if (iter == NULL || iter->failed || iter->count == 0) return NULL; \
+	name##Elem* elem = iter->items[iter->count - 1]; \
+	if (iter->count - 1 + (K) > iter->capacity) { \
+		size_t capacity = 2 * iter->capacity; \
+		while (iter->count - 1 + (K) > capacity) capacity *= 2; \
+		name##Elem** items = (name##Elem**)realloc(iter->items, capacity * sizeof(name##Elem*)); \
+		if (items == NULL) { \
+			iter->failed = TRUE; \
+			return NULL; \
+		} \
+		iter->items = items; \
+		iter->capacity = capacity; \
+	} \
+	iter->count--; \
+	/* pushed last to first, so that the first child is popped first: */ \
+	for (int i = (K) - 1; i >= 0; i--) { \
+		if (elem->children[i] != NULL) iter->items[iter->count++] = elem->children[i]; \
+	} \
+	return elem; \
+} \
+\
+static inline Result name##IterEnd(name##Iter* iter) { \
+	if (iter == NULL) return FAILURE; \
+	free(iter->items); \
+	iter->items = NULL; \
+	iter->count = 0; \
+	iter->capacity = 0; \
+	return iter->failed ? FAILURE : SUCCESS; \
+} \
+\
+static inline name##Elem* name##Find(name* tree, int key) { \
+	name##Iter iter; \
+	name##Elem* elem; \
+	if (tree == NULL) return NULL; \
+	TYPEDTREE_STAT_ADD(tree, lookups, 1); \
+	name##IterBegin(tree, &iter); \
+	while ((elem = name##IterNext(&iter)) != NULL) { \
+		TYPEDTREE_STAT_ADD(tree, lookupVisits, 1); \
+		if (KEY(&elem->obj) == key) break; \
+	} \
+	name##IterEnd(&iter); \
+	return elem; \
+} \
+\
+static inline Result name##GetStats(const name* tree, TreeStats* stats) { \
+	if (tree == NULL || stats == NULL) return FAILURE; \
+	return TYPEDTREE_STATS_GET(tree, stats); \
+}
+
+#endif
@@ -0,0 +1,311 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "defs.h"
+#include "workpool.h"
+
+#if !defined(_WIN32) && !defined(WORKPOOL_NO_THREADS)
+#define WORKPOOL_THREADS
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#ifdef WORKPOOL_THREADS
+#define ATOMIC_ADD(p, v) __atomic_add_fetch((p), (v), __ATOMIC_ACQ_REL)
+#define ATOMIC_LOAD(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define ATOMIC_STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define DEQUE_LOCK(d) pthread_mutex_lock(&(d)->lock)
+#define DEQUE_UNLOCK(d) pthread_mutex_unlock(&(d)->lock)
+#else
+#define ATOMIC_ADD(p, v) (*(p) += (v))
+#define ATOMIC_LOAD(p) (*(p))
+#define ATOMIC_STORE(p, v) (*(p) = (v))
+#define DEQUE_LOCK(d)
+#define DEQUE_UNLOCK(d)
+#endif
+
+#define DEQUE_INIT_CAPACITY 64
+
+/* definition of the deque of a worker - items[head, tail) */
+typedef struct _work_deque {
+  char* items;
+  size_t head;// oldest item, the one stolen
+  size_t tail;// one past the newest item, the one the owner takes
+  size_t capacity;
+#ifdef WORKPOOL_THREADS
+  pthread_mutex_t lock;
+#endif
+} WORKDEQUE, *PWORKDEQUE;
+
+/* definition of the pool */
+typedef struct _work_pool {
+  int numWorkers;
+  int numDeques;// numWorkers when created
+  size_t itemSize;
+  PWORKDEQUE deques;
+  char* scratch;// one item per worker, the item being processed
+  WorkFunction workFunc;// of the current run
+  void* ctx;
+  long pending;// items pushed and not processed yet
+  int failed;
+#ifdef WORKPOOL_THREADS
+  pthread_t* threads;
+  int numThreads;// threads started, numWorkers - 1 unless creating one failed
+  pthread_mutex_t lock;
+  pthread_cond_t runStart;
+  pthread_cond_t runEnd;
+  unsigned long runId;
+  int busyThreads;
+  Bool shutdown;
+#endif
+} WorkPool, *pWorkPool;
+
+/* argument of a pool thread */
+typedef struct _work_thread_arg {
+  pWorkPool pool;
+  int worker;
+} WORKTHREADARG;
+
+///////////////////  internal static functions ///////////////////////////
+
+/*************************************************************************
+Function name	: TakeItem
+Description		: copies the newest item of the worker's own deque into
+				  'item', or else steals the oldest item of another worker
+Paramerters		: pool - the pool, worker - the calling worker,
+				  item - updated with the item
+Return value	: Bool - TRUE if an item was taken
+************************************************************************/
+static Bool TakeItem(pWorkPool pool, int worker, void* item);
+
+/*************************************************************************
+Function name	: WorkerLoop
+Description		: processes items until none is left in the run
+Paramerters		: pool - the pool, worker - the calling worker
+Return value	: none
+************************************************************************/
+static void WorkerLoop(pWorkPool pool, int worker);
+
+#ifdef WORKPOOL_THREADS
+/*************************************************************************
+Function name	: WorkerThread
+Description		: main function of a pool thread - joins every run until
+				  the pool is destroyed
+Paramerters		: arg - a WORKTHREADARG
+Return value	: NULL
+************************************************************************/
+static void* WorkerThread(void* arg);
+#endif
+
+/////////////////////////////////////////////////////////////////////////
+
+static Bool TakeItem(pWorkPool pool, int worker, void* item) {
+	PWORKDEQUE deque = &pool->deques[worker];
+	DEQUE_LOCK(deque);
+	if (deque->tail > deque->head) {
+		deque->tail--;
+		memcpy(item, deque->items + deque->tail * pool->itemSize, pool->itemSize);
+		DEQUE_UNLOCK(deque);
+		return TRUE;
+	}
+	DEQUE_UNLOCK(deque);
+	for (int i = 1; i < pool->numWorkers; i++) {
+		PWORKDEQUE victim = &pool->deques[(worker + i) % pool->numWorkers];
+		DEQUE_LOCK(victim);
+		if (victim->tail > victim->head) {
+			memcpy(item, victim->items + victim->head * pool->itemSize, pool->itemSize);
+			victim->head++;
+			DEQUE_UNLOCK(victim);
+			return TRUE;
+		}
+		DEQUE_UNLOCK(victim);
+	}
+	return FALSE;
+}
+
+static void WorkerLoop(pWorkPool pool, int worker) {
+	void* item = pool->scratch + worker * pool->itemSize;
+	while (TRUE) {
+		if (TakeItem(pool, worker, item)) {
+			if (!ATOMIC_LOAD(&pool->failed) &&
+				pool->workFunc(pool, worker, item, pool->ctx) == FAILURE) {
+				ATOMIC_STORE(&pool->failed, 1);
+			}
+			ATOMIC_ADD(&pool->pending, -1);
+			continue;
+		}
+		if (ATOMIC_LOAD(&pool->pending) == 0) return;
+#ifdef WORKPOOL_THREADS
+		sched_yield();//work is left, but it is being processed by others
+#endif
+	}
+}
+
+#ifdef WORKPOOL_THREADS
+static void* WorkerThread(void* arg) {
+	pWorkPool pool = ((WORKTHREADARG*)arg)->pool;
+	int worker = ((WORKTHREADARG*)arg)->worker;
+	free(arg);
+	unsigned long seenRun = 0;
+	pthread_mutex_lock(&pool->lock);
+	while (TRUE) {
+		while (pool->runId == seenRun && !pool->shutdown) {
+			pthread_cond_wait(&pool->runStart, &pool->lock);
+		}
+		if (pool->shutdown) break;
+		seenRun = pool->runId;
+		pthread_mutex_unlock(&pool->lock);
+		WorkerLoop(pool, worker);
+		pthread_mutex_lock(&pool->lock);
+		if (--pool->busyThreads == 0) pthread_cond_signal(&pool->runEnd);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+#endif
+
+pWorkPool WorkPoolCreate(int numWorkers, size_t itemSize) {
+	if (itemSize == 0) return NULL;//input check
+	if (numWorkers < 1) numWorkers = 1;
+#ifndef WORKPOOL_THREADS
+	numWorkers = 1;
+#endif
+	pWorkPool pool = (pWorkPool)malloc(sizeof(WorkPool));
+	if (pool == NULL) return NULL;
+	pool->numWorkers = numWorkers;
+	pool->numDeques = numWorkers;
+	pool->itemSize = itemSize;
+	pool->deques = (PWORKDEQUE)calloc(numWorkers, sizeof(WORKDEQUE));
+	pool->scratch = (char*)malloc(numWorkers * itemSize);
+	if (pool->deques == NULL || pool->scratch == NULL) {
+		free(pool->deques);
+		free(pool->scratch);
+		free(pool);
+		return NULL;
+	}
+#ifdef WORKPOOL_THREADS
+	for (int i = 0; i < numWorkers; i++) {
+		pthread_mutex_init(&pool->deques[i].lock, NULL);
+	}
+#endif
+	pool->workFunc = NULL;
+	pool->ctx = NULL;
+	pool->pending = 0;
+	pool->failed = 0;
+#ifdef WORKPOOL_THREADS
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->runStart, NULL);
+	pthread_cond_init(&pool->runEnd, NULL);
+	pool->runId = 0;
+	pool->busyThreads = 0;
+	pool->shutdown = FALSE;
+	pool->numThreads = 0;
+	pool->threads = (pthread_t*)malloc(numWorkers * sizeof(pthread_t));
+	if (pool->threads == NULL) {
+		pool->numWorkers = 1;
+		return pool;
+	}
+	for (int i = 1; i < numWorkers; i++) {
+		WORKTHREADARG* arg = (WORKTHREADARG*)malloc(sizeof(WORKTHREADARG));
+		if (arg == NULL) break;
+		arg->pool = pool;
+		arg->worker = i;
+		if (pthread_create(&pool->threads[pool->numThreads], NULL, WorkerThread, arg) != 0) {
+			free(arg);
+			break;
+		}
+		pool->numThreads++;
+	}
+	pool->numWorkers = pool->numThreads + 1;//run with the threads that did start
+#endif
+	return pool;
+}
+
+void WorkPoolDestroy(pWorkPool pool) {
+	if (pool == NULL) return;
+#ifdef WORKPOOL_THREADS
+	pthread_mutex_lock(&pool->lock);
+	pool->shutdown = TRUE;
+	pthread_cond_broadcast(&pool->runStart);
+	pthread_mutex_unlock(&pool->lock);
+	for (int i = 0; i < pool->numThreads; i++) {
+		pthread_join(pool->threads[i], NULL);
+	}
+	free(pool->threads);
+	pthread_cond_destroy(&pool->runStart);
+	pthread_cond_destroy(&pool->runEnd);
+	pthread_mutex_destroy(&pool->lock);
+#endif
+	for (int i = 0; i < pool->numDeques; i++) {
+#ifdef WORKPOOL_THREADS
+		pthread_mutex_destroy(&pool->deques[i].lock);
+#endif
+		free(pool->deques[i].items);
+	}
+	free(pool->deques);
+	free(pool->scratch);
+	free(pool);
+}
+
+int WorkPoolWorkers(pWorkPool pool) {
+	if (pool == NULL) return 0;
+	return pool->numWorkers;
+}
+
+Result WorkPoolPush(pWorkPool pool, int worker, const void* item) {
+	if (pool == NULL || item == NULL) return FAILURE;//input check
+	PWORKDEQUE deque = &pool->deques[worker];
+	DEQUE_LOCK(deque);
+	if (deque->tail == deque->capacity) {
+		if (deque->head > 0) {// reuse the room left by stolen items
+			memmove(deque->items, deque->items + deque->head * pool->itemSize,
+				(deque->tail - deque->head) * pool->itemSize);
+			deque->tail -= deque->head;
+			deque->head = 0;
+		}
+		else {
+			size_t newCapacity = (deque->capacity == 0) ? DEQUE_INIT_CAPACITY : 2 * deque->capacity;
+			char* newItems = (char*)realloc(deque->items, newCapacity * pool->itemSize);
+			if (newItems == NULL) {
+				DEQUE_UNLOCK(deque);
+				return FAILURE;
+			}
+			deque->items = newItems;
+			deque->capacity = newCapacity;
+		}
+	}
+	memcpy(deque->items + deque->tail * pool->itemSize, item, pool->itemSize);
+	deque->tail++;
+	ATOMIC_ADD(&pool->pending, 1);//before the item can be taken and finished
+	DEQUE_UNLOCK(deque);
+	return SUCCESS;
+}
+
+Result WorkPoolRun(pWorkPool pool, const void* firstItem, WorkFunction workFunc, void* ctx) {
+	if (pool == NULL || firstItem == NULL || workFunc == NULL) return FAILURE;//input check
+	for (int i = 0; i < pool->numWorkers; i++) {
+		pool->deques[i].head = 0;
+		pool->deques[i].tail = 0;
+	}
+	pool->pending = 0;
+	pool->failed = 0;
+	pool->workFunc = workFunc;
+	pool->ctx = ctx;
+	if (WorkPoolPush(pool, 0, firstItem) == FAILURE) return FAILURE;
+#ifdef WORKPOOL_THREADS
+	pthread_mutex_lock(&pool->lock);
+	pool->busyThreads = pool->numThreads;
+	pool->runId++;
+	pthread_cond_broadcast(&pool->runStart);
+	pthread_mutex_unlock(&pool->lock);
+#endif
+	WorkerLoop(pool, 0);
+#ifdef WORKPOOL_THREADS
+	pthread_mutex_lock(&pool->lock);
+	while (pool->busyThreads > 0) {
+		pthread_cond_wait(&pool->runEnd, &pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+#endif
+	return pool->failed ? FAILURE : SUCCESS;
+}
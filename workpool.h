@@ -0,0 +1,76 @@
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+
+#include <stddef.h>
+#include "defs.h"
+
+/*
+** Work stealing pool.
+** a run starts from one work item; processing an item may push new items.
+** every worker keeps its own deque - it takes its newest item first, and
+** an idle worker steals the oldest item of another worker. the run ends
+** when no item is left. items are copied into the pool by value.
+** without threads support (_WIN32 or WORKPOOL_NO_THREADS) the pool has a
+** single worker, the calling thread.
+*/
+
+//the pool data structure:
+typedef struct _work_pool WorkPool, *pWorkPool;
+
+/*************************************************************************
+Function name	: WorkFunction
+Description		: processes one item of a run
+Paramerters		: pool - the pool, to push new items into,
+				  worker - the index of the calling worker,
+				  item - the item, ctx - the context given to WorkPoolRun
+Return value	: Result - FAILURE aborts the run
+************************************************************************/
+typedef Result (*WorkFunction)(pWorkPool pool, int worker, void* item, void* ctx);
+
+/*************************************************************************
+Function name	: WorkPoolCreate
+Description		: creates a pool and starts its threads
+Paramerters		: numWorkers - workers including the calling thread, at
+				  least 1, itemSize - the size of a work item
+Return value	: pWorkPool - the new pool, NULL on failure
+************************************************************************/
+pWorkPool WorkPoolCreate(int numWorkers, size_t itemSize);
+
+/*************************************************************************
+Function name	: WorkPoolDestroy
+Description		: stops the threads of a pool and frees it
+Paramerters		: pool - the pool
+Return value	: none
+************************************************************************/
+void WorkPoolDestroy(pWorkPool pool);
+
+/*************************************************************************
+Function name	: WorkPoolWorkers
+Description		: returns the amount of workers of a pool
+Paramerters		: pool - the pool
+Return value	: int - the amount of workers
+************************************************************************/
+int WorkPoolWorkers(pWorkPool pool);
+
+/*************************************************************************
+Function name	: WorkPoolRun
+Description		: processes firstItem and every item pushed while doing
+				  so, on all workers. the calling thread is worker 0.
+				  must not be called from a WorkFunction.
+Paramerters		: pool - the pool, firstItem - the first item,
+				  workFunc - processes an item, ctx - passed to workFunc
+Return value	: Result - SUCCESS, FAILURE if an item failed or could
+				  not be pushed
+************************************************************************/
+Result WorkPoolRun(pWorkPool pool, const void* firstItem, WorkFunction workFunc, void* ctx);
+
+/*************************************************************************
+Function name	: WorkPoolPush
+Description		: adds an item to the deque of a worker, from a WorkFunction
+Paramerters		: pool - the pool, worker - the calling worker,
+				  item - the item to copy
+Return value	: Result - SUCCESS, FAILURE on allocation failure
+************************************************************************/
+Result WorkPoolPush(pWorkPool pool, int worker, const void* item);
+
+#endif